@@ -0,0 +1,50 @@
+// main.cpp
+
+// N threads calling the instrumented function work() concurrently; the
+// throughput of calls when running under the profiler shows how well
+// concurrent sections scale with the number of threads
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+static std::atomic<unsigned long> sink;
+
+__attribute__((noinline)) unsigned long work(unsigned long n) {
+  unsigned long sum = 0;
+  for (unsigned long i = 0; i < n; i++)
+    sum += i * i;
+  sink.fetch_add(sum, std::memory_order_relaxed);
+  return sum;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc < 3) {
+    std::fprintf(stderr, "Usage: %s <threads> <calls per thread> [<work>]\n",
+                 argv[0]);
+    return 1;
+  }
+  unsigned long threads = std::strtoul(argv[1], nullptr, 10);
+  unsigned long calls = std::strtoul(argv[2], nullptr, 10);
+  unsigned long amount = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 1000;
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (unsigned long t = 0; t < threads; t++)
+    workers.emplace_back([=]() {
+      for (unsigned long c = 0; c < calls; c++)
+        work(amount);
+    });
+  for (auto &w : workers)
+    w.join();
+  std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  std::printf("threads=%lu calls=%lu elapsed=%.6f s throughput=%.1f calls/s\n",
+              threads, threads * calls, elapsed.count(),
+              threads * calls / elapsed.count());
+  return 0;
+}
@@ -0,0 +1,24 @@
+#!/usr/bin/env bash
+
+# Usage: run.sh [<profiler>] [<calls per thread>] [<thread counts>...]
+# Runs the benchmark under the profiler, stepping over traps in place and with
+# displaced stepping, for each thread count and prints the throughput of calls
+# of the instrumented function, along with its throughput without the profiler
+
+set -e
+
+profiler=$(realpath "${1:-$(dirname "$0")/../../bin/profiler}")
+calls=${2:-2000}
+shift 2 || true
+counts=${*:-1 2 4 8 16}
+
+cd "$(dirname "$0")"
+make -s
+
+for threads in $counts; do
+    echo "native: $(./bench.out "$threads" "$calls")"
+    for mode in "" --displaced-stepping; do
+        echo "${mode:-in-place}: $("$profiler" $mode -q -c bench.xml \
+            -o /dev/null -- ./bench.out "$threads" "$calls" | grep "^threads=")"
+    done
+done
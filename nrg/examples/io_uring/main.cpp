@@ -0,0 +1,131 @@
+#include <nonstd/expected.hpp>
+#include <nrg/nrg.hpp>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <glob.h>
+#include <unistd.h>
+
+// Benchmark of the latency of reading one sample of all RAPL domains of all
+// sockets through reader_rapl against reading the same energy_uj files one
+// after the other with pread.
+// reader_rapl submits its reads as one batch through io_uring when libnrg is
+// built with make cpp="NRG_IO_URING", and reads them one at a time otherwise.
+
+// Usage: ./main.out [samples]
+
+namespace {
+using clock_type = std::chrono::steady_clock;
+
+template <typename T> T to_scalar(std::string_view str) {
+  T value;
+  auto [dummy, ec] = std::from_chars(str.begin(), str.end(), value);
+  (void)dummy;
+  if (auto code = std::make_error_code(ec))
+    throw std::system_error(code);
+  return value;
+}
+
+// the energy_uj files of all packages and of their subdomains
+std::vector<int> open_energy_files() {
+  std::vector<int> fds;
+  for (const char *pattern :
+       {"/sys/class/powercap/intel-rapl:*/energy_uj",
+        "/sys/class/powercap/intel-rapl:*:*/energy_uj"}) {
+    glob_t g;
+    if (glob(pattern, 0, nullptr, &g))
+      continue;
+    for (size_t i = 0; i < g.gl_pathc; i++) {
+      int fd = open(g.gl_pathv[i], O_RDONLY);
+      if (fd == -1)
+        throw std::system_error(errno, std::system_category(), g.gl_pathv[i]);
+      fds.push_back(fd);
+    }
+    globfree(&g);
+  }
+  return fds;
+}
+
+void read_energy_files(const std::vector<int> &fds) {
+  char buffer[24];
+  for (int fd : fds) {
+    ssize_t ret = pread(fd, buffer, sizeof(buffer) - 1, 0);
+    if (ret <= 0)
+      throw std::system_error(errno, std::system_category(), "pread");
+    buffer[ret] = '\0';
+    volatile uint64_t value = strtoull(buffer, nullptr, 10);
+    (void)value;
+  }
+}
+
+// the latencies of <samples> calls of <fn>, in nanoseconds, sorted
+std::vector<double> measure(size_t samples, const std::function<void()> &fn) {
+  std::vector<double> latencies;
+  latencies.reserve(samples);
+  for (size_t i = 0; i < samples; i++) {
+    auto start = clock_type::now();
+    fn();
+    auto end = clock_type::now();
+    latencies.push_back(
+        std::chrono::duration<double, std::nano>(end - start).count());
+  }
+  std::sort(latencies.begin(), latencies.end());
+  return latencies;
+}
+
+void print(const char *name, size_t events,
+           const std::vector<double> &latencies) {
+  double total = 0.0;
+  for (double l : latencies)
+    total += l;
+  auto at = [&latencies](double q) {
+    return latencies[static_cast<size_t>(q * (latencies.size() - 1))];
+  };
+  std::printf("%-12s events: %2zu, mean: %9.0f ns, median: %9.0f ns, "
+              "p99: %9.0f ns, max: %9.0f ns\n",
+              name, events, total / latencies.size(), at(0.5), at(0.99),
+              latencies.back());
+}
+} // namespace
+
+int main(int argc, char *argv[]) {
+  try {
+    using namespace nrgprf;
+    size_t samples = argc > 1 ? to_scalar<size_t>(argv[1]) : 10000;
+    if (!samples)
+      throw std::invalid_argument("samples must be greater than 0");
+
+    reader_rapl reader(location_mask(~0x0), socket_mask(~0x0));
+    std::vector<int> fds = open_energy_files();
+    // warm up both paths before measuring them
+    sample s;
+    for (int i = 0; i < 100; i++) {
+      if (std::error_code ec; !reader.read(s, ec))
+        throw exception(ec);
+      read_energy_files(fds);
+    }
+
+    print("reader_rapl", reader.num_events(), measure(samples, [&] {
+            if (std::error_code ec; !reader.read(s, ec))
+              throw exception(ec);
+          }));
+    print("pread loop", fds.size(),
+          measure(samples, [&fds] { read_energy_files(fds); }));
+    for (int fd : fds)
+      close(fd);
+  } catch (const nrgprf::exception &e) {
+    std::cerr << "NRG exception: " << e.what() << '\n';
+    return 1;
+  } catch (const std::exception &e) {
+    std::cerr << e.what() << '\n';
+    return 1;
+  }
+}
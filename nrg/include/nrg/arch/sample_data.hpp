@@ -11,6 +11,9 @@ namespace detail {
 #if defined NRG_X86_64
 struct sample_data {
   std::array<uint64_t, max_cpu_events> cpu;
+  // a bit per event of <cpu>, set once it was read, since an event can also
+  // read 0; an array only so that it is handled like the other fields
+  std::array<uint32_t, 1> cpu_read;
   std::array<uint32_t, max_devices> gpu_power;
   std::array<uint64_t, max_devices> gpu_energy;
 };
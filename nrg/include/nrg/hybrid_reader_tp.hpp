@@ -9,7 +9,8 @@
 namespace nrgprf {
 class sample;
 
-// owning hybrid reader
+// owning hybrid reader, which reads its readers one after the other; to read
+// them concurrently, they can be given to a parallel_hybrid_reader instead
 template <typename... Ts> class hybrid_reader_tp : public reader {
   static_assert(sizeof...(Ts) > 0, "At least one Ts must be provided");
   static_assert(
@@ -8,6 +8,7 @@
 #include <nrg/hybrid_reader.hpp>
 #include <nrg/hybrid_reader_tp.hpp>
 #include <nrg/location.hpp>
+#include <nrg/parallel_hybrid_reader.hpp>
 #include <nrg/reader.hpp>
 #include <nrg/reader_gpu.hpp>
 #include <nrg/reader_rapl.hpp>
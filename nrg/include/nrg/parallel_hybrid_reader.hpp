@@ -0,0 +1,61 @@
+// parallel_hybrid_reader.hpp
+#pragma once
+
+#include <nrg/detail/all_reader_ptrs.hpp>
+#include <nrg/reader.hpp>
+#include <nrg/types.hpp>
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+namespace nrgprf {
+class sample;
+
+// how long after the first reader a reader was read, as the difference between
+// the midpoints of their reads, over the reads in which all readers succeeded
+struct reader_skew {
+  uint64_t count;
+  std::chrono::nanoseconds min;
+  std::chrono::nanoseconds max;
+  std::chrono::nanoseconds total;
+
+  std::chrono::nanoseconds mean() const noexcept;
+};
+
+// non-owning hybrid reader which reads all of its readers at the same time,
+// the first from the calling thread and each of the others from a worker
+// thread of its own, so that a sample takes as long as the slowest reader
+// rather than all of them together
+class parallel_hybrid_reader : public reader {
+private:
+  struct state;
+  std::unique_ptr<state> _state;
+
+public:
+  using reader::read;
+
+  template <
+      typename... Readers,
+      std::enable_if_t<detail::all_reader_ptrs_v<Readers...>, bool> = true>
+  parallel_hybrid_reader(const Readers &...);
+  explicit parallel_hybrid_reader(std::vector<const reader *>);
+  ~parallel_hybrid_reader();
+
+  parallel_hybrid_reader(parallel_hybrid_reader &&) noexcept;
+  parallel_hybrid_reader &operator=(parallel_hybrid_reader &&) noexcept;
+
+  // reads are serialised, since they share the workers
+  bool read(sample &, std::error_code &) const override;
+  bool read(sample &, uint8_t, std::error_code &) const override;
+  size_t num_events() const noexcept override;
+
+  // by reader, in the order in which they were given
+  std::vector<reader_skew> skew() const;
+};
+
+template <typename... Readers,
+          std::enable_if_t<detail::all_reader_ptrs_v<Readers...>, bool>>
+parallel_hybrid_reader::parallel_hybrid_reader(const Readers &...reader)
+    : parallel_hybrid_reader(std::vector<const nrgprf::reader *>{&reader...}) {}
+} // namespace nrgprf
@@ -9,6 +9,7 @@
 
 #include <iostream>
 #include <memory>
+#include <string_view>
 #include <vector>
 
 namespace nrgprf {
@@ -23,6 +24,11 @@ public:
   using reader::read;
 
   explicit reader_rapl(location_mask, socket_mask, std::ostream & = std::cout);
+  // the counters are read through <backend>; the MSR backend reads the files
+  // of the msr driver under <root>, which is empty unless testing, while the
+  // other backends ignore it
+  reader_rapl(location_mask, socket_mask, rapl_backend,
+              std::string_view root = "", std::ostream & = std::cout);
   explicit reader_rapl(location_mask, std::ostream & = std::cout);
   explicit reader_rapl(socket_mask, std::ostream & = std::cout);
   explicit reader_rapl(std::ostream & = std::cout);
@@ -21,4 +21,10 @@ template <typename R> using result = nonstd::expected<R, std::error_code>;
 using location_mask = std::bitset<max_locations>;
 using socket_mask = std::bitset<max_sockets>;
 using device_mask = std::bitset<max_devices>;
+
+// the interface through which the CPU energy counters are read: the files of
+// the powercap driver; the MSRs of one CPU of each package, read directly
+// through the msr driver; or the events of the power PMU of perf, read as one
+// group per package; only the first is supported other than on x86_64
+enum class rapl_backend : uint8_t { powercap, msr, perf };
 } // namespace nrgprf
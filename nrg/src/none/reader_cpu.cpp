@@ -9,6 +9,14 @@ reader_impl::reader_impl(location_mask, socket_mask, std::ostream &os) {
   os << fileline("No-op CPU reader\n");
 }
 
+reader_impl::reader_impl(location_mask lmask, socket_mask smask,
+                         rapl_backend backend, std::string_view,
+                         std::ostream &os)
+    : reader_impl(lmask, smask, os) {
+  if (backend != rapl_backend::powercap)
+    throw exception(errc::operation_not_supported);
+}
+
 bool reader_impl::read(sample &, std::error_code &) const noexcept {
   return true;
 }
@@ -4,11 +4,15 @@
 
 #include <nrg/types.hpp>
 
+#include <string_view>
+
 namespace nrgprf {
 class sample;
 
 struct NRG_LOCAL reader_impl {
   reader_impl(location_mask, socket_mask, std::ostream &);
+  reader_impl(location_mask, socket_mask, rapl_backend, std::string_view,
+              std::ostream &);
 
   bool read(sample &, std::error_code &) const noexcept;
   bool read(sample &, uint8_t, std::error_code &) const noexcept;
@@ -0,0 +1,180 @@
+// parallel_hybrid_reader.cpp
+
+#include <nrg/error.hpp>
+#include <nrg/parallel_hybrid_reader.hpp>
+#include <nrg/sample.hpp>
+
+#include <nonstd/expected.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+using namespace nrgprf;
+
+namespace {
+using clock_type = std::chrono::steady_clock;
+}
+
+struct parallel_hybrid_reader::state {
+  struct slot {
+    const reader *rdr;
+    bool ok;
+    std::error_code ec;
+    clock_type::time_point begin;
+    clock_type::time_point end;
+    reader_skew skew;
+
+    clock_type::time_point midpoint() const noexcept {
+      return begin + (end - begin) / 2;
+    }
+  };
+
+  std::vector<slot> slots;
+  // held for the whole of a read
+  std::mutex read_mx;
+  // guards the rest, which is shared with the workers
+  std::mutex mx;
+  std::condition_variable work_cv;
+  std::condition_variable done_cv;
+  sample *target;
+  uint64_t generation;
+  size_t pending;
+  bool stop;
+  std::vector<std::thread> workers;
+
+  explicit state(std::vector<const reader *> readers);
+  ~state();
+
+  void read_slot(size_t idx, sample &s);
+  void work(size_t idx);
+};
+
+parallel_hybrid_reader::state::state(std::vector<const reader *> readers)
+    : slots(), read_mx(), mx(), work_cv(), done_cv(), target(nullptr),
+      generation(0), pending(0), stop(false), workers() {
+  slots.reserve(readers.size());
+  for (const reader *r : readers) {
+    assert(r != nullptr);
+    reader_skew skew{0, std::chrono::nanoseconds::max(),
+                     std::chrono::nanoseconds::min(),
+                     std::chrono::nanoseconds::zero()};
+    slots.push_back(slot{r, false, {}, {}, {}, skew});
+  }
+  // the first reader is read by the thread which reads the sample
+  for (size_t idx = 1; idx < slots.size(); idx++)
+    workers.emplace_back(&state::work, this, idx);
+}
+
+parallel_hybrid_reader::state::~state() {
+  {
+    std::scoped_lock lock(mx);
+    stop = true;
+  }
+  work_cv.notify_all();
+  for (auto &w : workers)
+    w.join();
+}
+
+void parallel_hybrid_reader::state::read_slot(size_t idx, sample &s) {
+  slot &sl = slots[idx];
+  sl.begin = clock_type::now();
+  sl.ok = sl.rdr->read(s, sl.ec);
+  sl.end = clock_type::now();
+}
+
+void parallel_hybrid_reader::state::work(size_t idx) {
+  uint64_t seen = 0;
+  std::unique_lock lock(mx);
+  for (;;) {
+    work_cv.wait(lock, [this, seen] { return stop || generation != seen; });
+    if (stop)
+      return;
+    seen = generation;
+    sample *s = target;
+    lock.unlock();
+    // each reader writes to its own fields of the sample
+    read_slot(idx, *s);
+    lock.lock();
+    if (!--pending)
+      done_cv.notify_one();
+  }
+}
+
+std::chrono::nanoseconds reader_skew::mean() const noexcept {
+  return count ? total / static_cast<int64_t>(count)
+               : std::chrono::nanoseconds::zero();
+}
+
+parallel_hybrid_reader::parallel_hybrid_reader(
+    std::vector<const reader *> readers)
+    : _state(std::make_unique<state>(std::move(readers))) {}
+
+parallel_hybrid_reader::~parallel_hybrid_reader() = default;
+
+parallel_hybrid_reader::parallel_hybrid_reader(
+    parallel_hybrid_reader &&) noexcept = default;
+
+parallel_hybrid_reader &
+parallel_hybrid_reader::operator=(parallel_hybrid_reader &&) noexcept = default;
+
+bool parallel_hybrid_reader::read(sample &s, std::error_code &ec) const {
+  state &st = *_state;
+  std::scoped_lock read_lock(st.read_mx);
+  {
+    std::scoped_lock lock(st.mx);
+    st.target = &s;
+    st.generation++;
+    st.pending = st.workers.size();
+  }
+  st.work_cv.notify_all();
+  if (!st.slots.empty())
+    st.read_slot(0, s);
+  {
+    std::unique_lock lock(st.mx);
+    st.done_cv.wait(lock, [&st] { return !st.pending; });
+  }
+  for (const auto &sl : st.slots)
+    if (!sl.ok) {
+      ec = sl.ec;
+      return false;
+    }
+  for (auto &sl : st.slots) {
+    auto skew = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        sl.midpoint() - st.slots.front().midpoint());
+    sl.skew.count++;
+    sl.skew.min = std::min(sl.skew.min, skew);
+    sl.skew.max = std::max(sl.skew.max, skew);
+    sl.skew.total += skew;
+  }
+  ec.clear();
+  return true;
+}
+
+bool parallel_hybrid_reader::read(sample &, uint8_t,
+                                  std::error_code &ec) const {
+  ec = errc::operation_not_supported;
+  return false;
+}
+
+size_t parallel_hybrid_reader::num_events() const noexcept {
+  size_t total = 0;
+  for (const auto &sl : _state->slots)
+    total += sl.rdr->num_events();
+  return total;
+}
+
+std::vector<reader_skew> parallel_hybrid_reader::skew() const {
+  std::scoped_lock read_lock(_state->read_mx);
+  std::vector<reader_skew> retval;
+  retval.reserve(_state->slots.size());
+  for (const auto &sl : _state->slots) {
+    reader_skew skew = sl.skew;
+    if (!skew.count)
+      skew.min = skew.max = std::chrono::nanoseconds::zero();
+    retval.push_back(skew);
+  }
+  return retval;
+}
@@ -16,6 +16,11 @@
 #include <iostream>
 #include <sstream>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #if !defined(NRG_OCC_USE_DUMMY_FILE)
 #define NRG_OCC_USE_DUMMY_FILE "/sys/firmware/opal/exports/occ_inband_sensors"
 #endif
@@ -469,6 +474,31 @@ bool get_sensor_record(const sensor_buffers &buffs,
   return false;
 }
 
+// the valid byte is cleared while the OCC updates the buffer
+bool buffer_valid(const uint8_t *buffer) {
+  return __atomic_load_n(buffer, __ATOMIC_ACQUIRE);
+}
+
+// the valid buffer of the mapping whose record at <offset> is the most recent,
+// or nullptr if neither is valid
+const uint8_t *newest_buffer(const uint8_t *ping, const uint8_t *pong,
+                             uint32_t offset) {
+  bool ping_valid = buffer_valid(ping);
+  bool pong_valid = buffer_valid(pong);
+  if (ping_valid && pong_valid) {
+    uint64_t ping_ts;
+    uint64_t pong_ts;
+    detail::retrieve_field(&ping_ts, ping + offset + sizeof(uint16_t));
+    detail::retrieve_field(&pong_ts, pong + offset + sizeof(uint16_t));
+    return ping_ts > pong_ts ? ping : pong;
+  }
+  if (pong_valid)
+    return pong;
+  if (ping_valid)
+    return ping;
+  return nullptr;
+}
+
 bool get_sensor_record(const sensor_buffers &buffs,
                        const sensor_names_entry &entry,
                        sensor_structure_v1_sample &out) {
@@ -483,10 +513,9 @@ bool get_sensor_record(const sensor_buffers &buffs,
       out = get_v1_sample(buffs.ping, entry.reading_offset);
     else
       out = get_v1_sample(buffs.pong, entry.reading_offset);
-  }
-  if (buffs.pong.valid)
+  } else if (buffs.pong.valid)
     out = get_v1_sample(buffs.pong, entry.reading_offset);
-  if (buffs.ping.valid)
+  else
     out = get_v1_sample(buffs.ping, entry.reading_offset);
   return true;
 }
@@ -857,7 +886,7 @@ reader_impl::reader_impl(location_mask lmask, socket_mask smask,
                          std::ostream &os)
     : _file(std::make_shared<std::ifstream>(occ::sensors_file,
                                             std::ios::in | std::ios::binary)),
-      _event_map(), _active_events() {
+      _map(), _event_map(), _active_events() {
   if (!*_file)
     throw exception(std::error_code{errno, std::system_category()});
 
@@ -906,6 +935,50 @@ reader_impl::reader_impl(location_mask lmask, socket_mask smask,
 
   if (!num_events())
     throw exception(errc::no_events_added);
+
+  for (auto &ed : _active_events)
+    for (const auto &entry : ed.entries)
+      ed.records.emplace_back(ed.occ_num * nrgprf::max_domains +
+                                  sensor_gsid_to_index(entry.gsid),
+                              entry.reading_offset);
+  map_sensors(os);
+}
+
+void reader_impl::map_sensors(std::ostream &os) {
+  auto fail = [&os](const std::string &why) {
+    os << fileline(cmmn::concat("Reading sensors through ", occ::sensors_file,
+                                ", unable to map it: ", why, "\n"));
+  };
+  int fd = open(occ::sensors_file, O_RDONLY);
+  if (fd == -1)
+    return fail(std::strerror(errno));
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    fail(std::strerror(errno));
+    close(fd);
+    return;
+  }
+  size_t size = st.st_size;
+  // the buffers of every OCC read must lie within the file, or reading them
+  // from the mapping would fault
+  for (const auto &ed : _active_events) {
+    if ((ed.occ_num + 1) * occ::sensor_data_block_size > size) {
+      fail("file too small");
+      close(fd);
+      return;
+    }
+  }
+  void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  int errnum = errno;
+  close(fd);
+  if (addr == MAP_FAILED)
+    return fail(std::strerror(errnum));
+  _map = std::shared_ptr<const uint8_t>(
+      static_cast<const uint8_t *>(addr), [size](const uint8_t *p) {
+        munmap(const_cast<uint8_t *>(p), size);
+      });
+  os << fileline(cmmn::concat("Mapped ", std::to_string(size), " bytes of ",
+                              occ::sensors_file, "\n"));
 }
 
 std::error_code
@@ -921,7 +994,8 @@ reader_impl::add_event(const std::vector<occ::sensor_names_entry> &entries,
   // in this case, push back a new event and register its index
   if (idxref < 0) {
     idxref = _active_events.size();
-    _active_events.push_back({occ_num, std::vector<occ::sensor_names_entry>()});
+    _active_events.push_back(
+        {occ_num, std::vector<occ::sensor_names_entry>(), {}});
   }
 
   for (const auto &entry : entries) {
@@ -942,7 +1016,9 @@ reader_impl::add_event(const std::vector<occ::sensor_names_entry> &entries,
 
 bool reader_impl::read_single_occ(const event_data &ed, sensor_buffers &sbuffs,
                                   sample &s, std::error_code &ec) const {
-  ec == get_sensor_buffers(*_file, ed.occ_num, sbuffs);
+  if (_map)
+    return read_mapped(ed, s, ec);
+  ec = get_sensor_buffers(*_file, ed.occ_num, sbuffs);
   if (ec)
     return false;
   for (const auto &entry : ed.entries) {
@@ -962,6 +1038,52 @@ bool reader_impl::read_single_occ(const event_data &ed, sensor_buffers &sbuffs,
   return true;
 }
 
+// copies the records out of the buffer of the OCC which is valid and most
+// recent, instead of reading both of its buffers whole
+bool reader_impl::read_mapped(const event_data &ed, sample &s,
+                              std::error_code &ec) const {
+  if (ed.records.empty()) {
+    ec.clear();
+    return true;
+  }
+  const uint8_t *block = _map.get() + ed.occ_num * occ::sensor_data_block_size;
+  const uint8_t *ping = block + occ::sensor_ping_buffer_offset;
+  const uint8_t *pong = block + occ::sensor_pong_buffer_offset;
+  // the records are torn if the buffer was invalidated while they were being
+  // copied, in which case they are copied once more from the newest buffer
+  for (int attempt = 0; attempt < 2; attempt++) {
+    const uint8_t *buffer =
+        occ::newest_buffer(ping, pong, ed.records.front().second);
+    if (!buffer)
+      break;
+    for (auto [stride, offset] : ed.records) {
+      // skip the gsid, which was checked when the entries were parsed
+      const uint8_t *curr = buffer + offset + sizeof(uint16_t);
+      uint64_t timestamp;
+      uint16_t sample;
+      curr += occ::detail::retrieve_field(&timestamp, curr);
+      occ::detail::retrieve_field(&sample, curr);
+      s.data.timestamps[stride] = timestamp;
+      s.data.cpu[stride] = sample;
+    }
+    if (occ::buffer_valid(buffer)) {
+      ec.clear();
+      return true;
+    }
+  }
+  ec = errc::readings_not_valid;
+  return false;
+}
+
+// the OCC sensors are only read from their file
+reader_impl::reader_impl(location_mask lmask, socket_mask smask,
+                         rapl_backend backend, std::string_view,
+                         std::ostream &os)
+    : reader_impl(lmask, smask, os) {
+  if (backend != rapl_backend::powercap)
+    throw exception(errc::operation_not_supported);
+}
+
 bool reader_impl::read(sample &s, std::error_code &ec) const {
   occ::sensor_buffers sbuffs;
   for (const auto &ed : _active_events)
@@ -974,7 +1096,7 @@ bool reader_impl::read(sample &s, std::error_code &ec) const {
 // some OCC
 bool reader_impl::read(sample &s, uint8_t idx, std::error_code &ec) const {
   occ::sensor_buffers sbuffs;
-  return !read_single_occ(_active_events[idx], sbuffs, s, ec);
+  return read_single_occ(_active_events[idx], sbuffs, s, ec);
 }
 
 size_t reader_impl::num_events() const noexcept {
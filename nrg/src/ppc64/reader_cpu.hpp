@@ -7,6 +7,7 @@
 #include <array>
 #include <iosfwd>
 #include <memory>
+#include <string_view>
 #include <vector>
 
 namespace nrgprf {
@@ -35,16 +36,24 @@ struct NRG_LOCAL sensor_names_entry {
 struct NRG_LOCAL event_data {
   uint32_t occ_num;
   std::vector<sensor_names_entry> entries;
+  // the position in the sample and the offset in the readings buffers of the
+  // record of each entry, so that only these are copied from the mapping
+  std::vector<std::pair<uint32_t, uint32_t>> records;
 };
 
 struct NRG_LOCAL reader_impl {
   // the file here functions as a cache, so as to avoid opening the file every
   // time we want to read the sensors
   std::shared_ptr<std::ifstream> _file;
+  // the whole sensors file mapped once, if it can be mapped, in which case the
+  // records are read from it instead of through the file
+  std::shared_ptr<const uint8_t> _map;
   std::array<std::array<int8_t, max_domains>, max_sockets> _event_map;
   std::vector<event_data> _active_events;
 
   reader_impl(location_mask, socket_mask, std::ostream &);
+  reader_impl(location_mask, socket_mask, rapl_backend, std::string_view,
+              std::ostream &);
 
   bool read(sample &, std::error_code &) const;
   bool read(sample &, uint8_t, std::error_code &) const;
@@ -60,7 +69,9 @@ private:
                             uint32_t occ_num, uint32_t location,
                             std::ostream &);
 
+  void map_sensors(std::ostream &);
   bool read_single_occ(const event_data &, sensor_buffers &, sample &,
                        std::error_code &) const;
+  bool read_mapped(const event_data &, sample &, std::error_code &) const;
 };
 } // namespace nrgprf
@@ -20,6 +20,12 @@ reader_rapl::reader_rapl(location_mask dmask, socket_mask skt_mask,
                          std::ostream &os)
     : _impl(std::make_unique<reader_rapl::impl>(dmask, skt_mask, os)) {}
 
+reader_rapl::reader_rapl(location_mask dmask, socket_mask skt_mask,
+                         rapl_backend backend, std::string_view root,
+                         std::ostream &os)
+    : _impl(std::make_unique<reader_rapl::impl>(dmask, skt_mask, backend, root,
+                                                os)) {}
+
 reader_rapl::reader_rapl(location_mask dmask, std::ostream &os)
     : reader_rapl(dmask, socket_mask(~0x0), os) {}
 
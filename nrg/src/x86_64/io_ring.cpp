@@ -0,0 +1,212 @@
+#include "io_ring.hpp"
+
+#include <nrg/error.hpp>
+
+#ifdef NRG_IO_URING
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+namespace {
+int io_uring_setup(uint32_t entries, io_uring_params *p) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+int io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete,
+                   uint32_t flags) {
+  return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit,
+                                  min_complete, flags, nullptr, 0));
+}
+
+int io_uring_register(int fd, uint32_t opcode, const void *arg,
+                      uint32_t nr_args) {
+  return static_cast<int>(
+      syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+uint32_t *at(void *ring, uint32_t offset) {
+  return reinterpret_cast<uint32_t *>(static_cast<char *>(ring) + offset);
+}
+
+[[noreturn]] void throw_errno() {
+  throw nrgprf::exception(std::error_code{errno, std::system_category()});
+}
+} // namespace
+
+namespace nrgprf {
+io_ring::io_ring(std::vector<request> requests)
+    : _fd(-1), _sq_ring(MAP_FAILED), _sq_ring_size(0), _cq_ring(MAP_FAILED),
+      _cq_ring_size(0), _sqes(static_cast<io_uring_sqe *>(MAP_FAILED)),
+      _sqes_size(0), _sq_tail(nullptr), _sq_mask(nullptr), _sq_array(nullptr),
+      _cq_head(nullptr), _cq_tail(nullptr), _cq_mask(nullptr), _cqes(nullptr),
+      _requests(std::move(requests)),
+      _buffer(std::make_unique<char[]>(_requests.size() * slot_size)),
+      _results(_requests.size(), 0) {
+  assert(!_requests.empty());
+  io_uring_params params{};
+  _fd = io_uring_setup(static_cast<uint32_t>(_requests.size()), &params);
+  if (_fd == -1)
+    throw_errno();
+  try {
+    // the whole batch must fit in the rings, which the kernel sizes to the
+    // next power of two
+    if (params.sq_entries < _requests.size())
+      throw exception(errc::operation_not_supported);
+    _sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+    _cq_ring_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    // since 5.4, both rings share a single mapping
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+      _sq_ring_size = _cq_ring_size =
+          std::max(_sq_ring_size, _cq_ring_size);
+    _sq_ring = mmap(nullptr, _sq_ring_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+    if (_sq_ring == MAP_FAILED)
+      throw_errno();
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+      _cq_ring = _sq_ring;
+    } else {
+      _cq_ring = mmap(nullptr, _cq_ring_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+      if (_cq_ring == MAP_FAILED)
+        throw_errno();
+    }
+    _sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+    _sqes = static_cast<io_uring_sqe *>(
+        mmap(nullptr, _sqes_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES));
+    if (_sqes == MAP_FAILED)
+      throw_errno();
+    _sq_tail = at(_sq_ring, params.sq_off.tail);
+    _sq_mask = at(_sq_ring, params.sq_off.ring_mask);
+    _sq_array = at(_sq_ring, params.sq_off.array);
+    _cq_head = at(_cq_ring, params.cq_off.head);
+    _cq_tail = at(_cq_ring, params.cq_off.tail);
+    _cq_mask = at(_cq_ring, params.cq_off.ring_mask);
+    _cqes = reinterpret_cast<io_uring_cqe *>(static_cast<char *>(_cq_ring) +
+                                             params.cq_off.cqes);
+
+    // the files and the buffer are registered once, so that the kernel does
+    // not look them up and map them on every read
+    std::vector<int> fds;
+    fds.reserve(_requests.size());
+    for (const request &req : _requests) {
+      assert(req.length < slot_size);
+      fds.push_back(req.fd);
+    }
+    if (io_uring_register(_fd, IORING_REGISTER_FILES, fds.data(),
+                          static_cast<uint32_t>(fds.size())) == -1)
+      throw_errno();
+    iovec iov{_buffer.get(), _requests.size() * slot_size};
+    if (io_uring_register(_fd, IORING_REGISTER_BUFFERS, &iov, 1) == -1)
+      throw_errno();
+
+    // every batch is the same, so the entries are prepared once and only
+    // their indices are queued on each submission
+    for (uint32_t ix = 0; ix < _requests.size(); ix++) {
+      io_uring_sqe &sqe = _sqes[ix];
+      sqe = io_uring_sqe{};
+      sqe.opcode = IORING_OP_READ_FIXED;
+      sqe.flags = IOSQE_FIXED_FILE;
+      sqe.fd = static_cast<int32_t>(ix);
+      sqe.off = _requests[ix].offset;
+      sqe.addr = reinterpret_cast<uint64_t>(_buffer.get() + ix * slot_size);
+      sqe.len = _requests[ix].length;
+      sqe.buf_index = 0;
+      sqe.user_data = ix;
+    }
+  } catch (...) {
+    unmap();
+    close(_fd);
+    throw;
+  }
+}
+
+io_ring::~io_ring() noexcept {
+  unmap();
+  if (close(_fd) == -1)
+    perror("io_ring: error closing ring");
+}
+
+bool io_ring::submit(std::error_code &ec) {
+  const auto count = static_cast<uint32_t>(_requests.size());
+  // submissions are serialised by the caller, so the tail needs no
+  // synchronisation with other threads, only with the kernel which consumes up
+  // to it
+  uint32_t tail = *_sq_tail;
+  for (uint32_t ix = 0; ix < count; ix++)
+    _sq_array[(tail + ix) & *_sq_mask] = ix;
+  __atomic_store_n(_sq_tail, tail + count, __ATOMIC_RELEASE);
+
+  uint32_t reaped = 0;
+  uint32_t to_submit = count;
+  while (reaped < count) {
+    int ret = io_uring_enter(_fd, to_submit, count - reaped,
+                             IORING_ENTER_GETEVENTS);
+    if (ret == -1) {
+      if (errno == EINTR)
+        continue;
+      ec = std::error_code(errno, std::system_category());
+      return false;
+    }
+    to_submit -= std::min(to_submit, static_cast<uint32_t>(ret));
+    uint32_t head = *_cq_head;
+    uint32_t cq_tail = __atomic_load_n(_cq_tail, __ATOMIC_ACQUIRE);
+    for (; head != cq_tail; head++, reaped++) {
+      const io_uring_cqe &cqe = _cqes[head & *_cq_mask];
+      _results[cqe.user_data] = cqe.res;
+      if (cqe.res >= 0)
+        _buffer[cqe.user_data * slot_size + cqe.res] = '\0';
+    }
+    __atomic_store_n(_cq_head, head, __ATOMIC_RELEASE);
+  }
+  ec.clear();
+  return true;
+}
+
+int32_t io_ring::result(size_t idx) const noexcept { return _results[idx]; }
+
+const char *io_ring::data(size_t idx) const noexcept {
+  return _buffer.get() + idx * slot_size;
+}
+
+void io_ring::unmap() noexcept {
+  if (_sqes != MAP_FAILED)
+    munmap(_sqes, _sqes_size);
+  if (_cq_ring != MAP_FAILED && _cq_ring != _sq_ring)
+    munmap(_cq_ring, _cq_ring_size);
+  if (_sq_ring != MAP_FAILED)
+    munmap(_sq_ring, _sq_ring_size);
+}
+} // namespace nrgprf
+
+#else
+
+namespace nrgprf {
+io_ring::io_ring(std::vector<request>) {
+  throw exception(errc::operation_not_supported);
+}
+
+io_ring::~io_ring() noexcept = default;
+
+bool io_ring::submit(std::error_code &ec) {
+  ec = errc::operation_not_supported;
+  return false;
+}
+
+int32_t io_ring::result(size_t) const noexcept { return 0; }
+
+const char *io_ring::data(size_t) const noexcept { return nullptr; }
+
+void io_ring::unmap() noexcept {}
+} // namespace nrgprf
+
+#endif // NRG_IO_URING
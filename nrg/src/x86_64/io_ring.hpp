@@ -0,0 +1,65 @@
+#pragma once
+
+#include "../visibility.hpp"
+
+#include <cstdint>
+#include <memory>
+#include <system_error>
+#include <vector>
+
+struct io_uring_sqe;
+struct io_uring_cqe;
+
+namespace nrgprf {
+// a ring of io_uring through which a fixed set of reads is submitted as one
+// batch, from registered files into registered buffers, and reaped together
+class NRG_LOCAL io_ring {
+public:
+  struct request {
+    int fd;
+    uint64_t offset;
+    uint32_t length;
+  };
+
+  // each request reads into a slot of this size, followed by a null byte
+  static constexpr uint32_t slot_size = 32;
+
+private:
+  int _fd;
+  void *_sq_ring;
+  size_t _sq_ring_size;
+  void *_cq_ring;
+  size_t _cq_ring_size;
+  io_uring_sqe *_sqes;
+  size_t _sqes_size;
+  uint32_t *_sq_tail;
+  uint32_t *_sq_mask;
+  uint32_t *_sq_array;
+  uint32_t *_cq_head;
+  uint32_t *_cq_tail;
+  uint32_t *_cq_mask;
+  io_uring_cqe *_cqes;
+  std::vector<request> _requests;
+  std::unique_ptr<char[]> _buffer;
+  std::vector<int32_t> _results;
+
+public:
+  explicit io_ring(std::vector<request> requests);
+  ~io_ring() noexcept;
+
+  io_ring(const io_ring &) = delete;
+  io_ring &operator=(const io_ring &) = delete;
+
+  // submits every request and waits for all of them to complete; the ring is
+  // not thread-safe, so the caller serialises submitting and reading the
+  // results
+  bool submit(std::error_code &ec);
+
+  // the bytes read by the request, or -errno if it failed
+  int32_t result(size_t idx) const noexcept;
+  const char *data(size_t idx) const noexcept;
+
+private:
+  void unmap() noexcept;
+};
+} // namespace nrgprf
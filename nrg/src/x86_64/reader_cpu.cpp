@@ -1,5 +1,6 @@
 #include "reader_cpu.hpp"
 #include "../common/cpu/funcs.hpp"
+#include "io_ring.hpp"
 #include "../fileline.hpp"
 
 #include <nrg/location.hpp>
@@ -8,12 +9,18 @@
 #include <nonstd/expected.hpp>
 #include <util/concat.hpp>
 
+#include <algorithm>
 #include <charconv>
+#include <cstdio>
 #include <cstring>
+#include <fstream>
 #include <iostream>
+#include <optional>
 
 #include <fcntl.h>
+#include <linux/perf_event.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 namespace nrgprf::loc {
@@ -31,6 +38,32 @@ constexpr char EVENT_PP0[] = "core";
 constexpr char EVENT_PP1[] = "uncore";
 constexpr char EVENT_DRAM[] = "dram";
 
+// the RAPL MSRs, as documented in the Intel SDM, vol. 4
+constexpr uint32_t MSR_RAPL_POWER_UNIT = 0x606;
+constexpr uint32_t MSR_PKG_ENERGY_STATUS = 0x611;
+constexpr uint32_t MSR_DRAM_ENERGY_STATUS = 0x619;
+constexpr uint32_t MSR_PP0_ENERGY_STATUS = 0x639;
+constexpr uint32_t MSR_PP1_ENERGY_STATUS = 0x641;
+// the energy status MSRs are 32-bit counters, which can wrap around at most
+// once between two reads to be accumulated correctly
+constexpr uint64_t MSR_ENERGY_MASK = 0xffffffff;
+
+constexpr std::pair<int, uint32_t> MSR_DOMAINS[] = {
+    {nrgprf::loc::pkg::value, MSR_PKG_ENERGY_STATUS},
+    {nrgprf::loc::cores::value, MSR_PP0_ENERGY_STATUS},
+    {nrgprf::loc::uncore::value, MSR_PP1_ENERGY_STATUS},
+    {nrgprf::loc::mem::value, MSR_DRAM_ENERGY_STATUS},
+};
+
+// the events of the power PMU of perf, whose GPU domain is PP1
+constexpr char PERF_POWER_PMU[] = "/sys/bus/event_source/devices/power";
+constexpr std::pair<int, const char *> PERF_DOMAINS[] = {
+    {nrgprf::loc::pkg::value, "energy-pkg"},
+    {nrgprf::loc::cores::value, "energy-cores"},
+    {nrgprf::loc::uncore::value, "energy-gpu"},
+    {nrgprf::loc::mem::value, "energy-ram"},
+};
+
 // begin helper functions
 
 ssize_t read_buff(int fd, char *buffer, size_t buffsz) {
@@ -41,18 +74,126 @@ ssize_t read_buff(int fd, char *buffer, size_t buffsz) {
   return ret;
 }
 
+int parse_uint64(const char *buffer, uint64_t *res) {
+  char *end;
+  *res = static_cast<uint64_t>(strtoull(buffer, &end, 0));
+  if (buffer != end && errno != ERANGE)
+    return 0;
+  return -1;
+}
+
 int read_uint64(int fd, uint64_t *res) {
   constexpr static const size_t MAX_UINT64_SZ = 24;
   char buffer[MAX_UINT64_SZ];
-  char *end;
   if (read_buff(fd, buffer, MAX_UINT64_SZ) <= 0)
     return -1;
-  *res = static_cast<uint64_t>(strtoull(buffer, &end, 0));
-  if (buffer != end && errno != ERANGE)
+  return parse_uint64(buffer, res);
+}
+
+static_assert(nrgprf::max_cpu_events <= 32,
+              "the events which were read must fit in the mask of a sample");
+
+void set_value(nrgprf::sample &s, uint32_t ev_idx, uint64_t value) noexcept {
+  s.data.cpu[ev_idx] = value;
+  s.data.cpu_read[0] |= uint32_t(1) << ev_idx;
+}
+
+// the offset of the file of the msr driver is the address of the MSR
+int pread_msr(int fd, uint32_t msr, uint64_t *res) {
+  ssize_t ret = pread(fd, res, sizeof(*res), msr);
+  if (ret == sizeof(*res))
     return 0;
+  if (ret >= 0)
+    errno = EIO;
   return -1;
 }
 
+// the DRAM counters of these server models count units of 2^-16 joules
+// regardless of MSR_RAPL_POWER_UNIT, as also assumed by the powercap driver;
+// the model is that of the first CPU listed in <cpuinfo>, so that it comes
+// from the same file tree as the MSRs
+bool dram_fixed_unit(const char *cpuinfo) {
+  std::ifstream ifs(cpuinfo, std::ios::in);
+  std::optional<unsigned int> family;
+  std::optional<unsigned int> model;
+  std::string line;
+  while ((!family || !model) && std::getline(ifs, line)) {
+    // whitespace in the format also matches the tabs before the colons
+    unsigned int value;
+    if (sscanf(line.c_str(), "cpu family : %u", &value) == 1)
+      family = value;
+    else if (sscanf(line.c_str(), "model : %u", &value) == 1)
+      model = value;
+  }
+  if (family != 6u || !model)
+    return false;
+  switch (*model) {
+  case 0x3f: // Haswell-X
+  case 0x4f: // Broadwell-X
+  case 0x56: // Broadwell-DE
+  case 0x55: // Skylake-X, Cascade Lake-X, Cooper Lake-X
+  case 0x57: // Xeon Phi Knights Landing
+  case 0x85: // Xeon Phi Knights Mill
+  case 0x6a: // Ice Lake-X
+  case 0x6c: // Ice Lake-D
+  case 0x8f: // Sapphire Rapids-X
+  case 0xcf: // Emerald Rapids-X
+    return true;
+  }
+  return false;
+}
+
+int perf_event_open(perf_event_attr *attr, int cpu, int group_fd) {
+  return static_cast<int>(
+      syscall(SYS_perf_event_open, attr, -1, cpu, group_fd, 0));
+}
+
+// the contents of the file without the trailing newline, empty if it cannot
+// be read
+std::string read_line(const char *filename) {
+  std::ifstream ifs(filename, std::ios::in);
+  std::string line;
+  std::getline(ifs, line);
+  return line;
+}
+
+// the value of the event= term of the event descriptor of the PMU, such as
+// event=0x02
+bool parse_perf_event(const std::string &desc, uint64_t *config) {
+  constexpr char term[] = "event=";
+  size_t pos = desc.find(term);
+  if (pos == std::string::npos)
+    return false;
+  const char *begin = desc.c_str() + pos + sizeof(term) - 1;
+  char *end;
+  errno = 0;
+  *config = static_cast<uint64_t>(strtoull(begin, &end, 0));
+  return begin != end && errno != ERANGE;
+}
+
+// the CPUs of a list such as 0-3,8
+std::vector<int32_t> parse_cpu_list(const std::string &list) {
+  std::vector<int32_t> cpus;
+  const char *str = list.c_str();
+  while (*str) {
+    char *end;
+    long first = strtol(str, &end, 10);
+    if (end == str)
+      break;
+    long last = first;
+    if (*end == '-') {
+      str = end + 1;
+      last = strtol(str, &end, 10);
+      if (end == str)
+        break;
+    }
+    for (long cpu = first; cpu <= last; cpu++)
+      cpus.push_back(static_cast<int32_t>(cpu));
+    str = *end == ',' ? end + 1 : end;
+  }
+  return cpus;
+}
+
 bool is_package_domain(const char *name) {
   return !std::strncmp(EVENT_PKG_PREFIX, name, sizeof(EVENT_PKG_PREFIX) - 1);
 }
@@ -137,6 +278,8 @@ file_descriptor::file_descriptor(const char *file)
     throw exception(std::error_code{errno, std::system_category()});
 }
 
+file_descriptor::file_descriptor(int fd) noexcept : value(fd) {}
+
 file_descriptor::file_descriptor(const file_descriptor &other)
     : value(dup(other.value)) {
   if (value == -1)
@@ -158,17 +301,90 @@ file_descriptor &file_descriptor::operator=(file_descriptor &&other) noexcept {
 }
 
 event_data::event_data(file_descriptor &&fd, uint64_t max) noexcept
-    : fd(std::move(fd)), max(max), prev(0), curr_max(0) {}
+    : fd(std::move(fd)), max(max), prev(0), curr_max(0), msr(0),
+      unit_shift(0), total(0), group(-1), scale(0.0) {}
+
+event_data::event_data(file_descriptor &&fd, uint32_t msr, uint8_t unit_shift,
+                       uint64_t initial) noexcept
+    : fd(std::move(fd)), max(MSR_ENERGY_MASK), prev(0), curr_max(0), msr(msr),
+      unit_shift(unit_shift), total(initial), group(-1), scale(0.0) {}
+
+event_data::event_data(file_descriptor &&fd, int32_t group,
+                       double scale) noexcept
+    : fd(std::move(fd)), max(0), prev(0), curr_max(0), msr(0), unit_shift(0),
+      total(0), group(group), scale(scale) {}
 
 reader_impl::reader_impl(location_mask dmask, socket_mask skt_mask,
                          std::ostream &os)
-    : _event_map(), _active_events() {
+    : reader_impl(dmask, skt_mask, rapl_backend::powercap, "", os) {}
+
+reader_impl::reader_impl(location_mask dmask, socket_mask skt_mask,
+                         rapl_backend backend, std::string_view root,
+                         std::ostream &os)
+    : _event_map(), _active_events(), _groups(), _ring(), _read_mx() {
   if (dmask.none())
     throw exception(errc::invalid_location_mask);
   if (skt_mask.none())
     throw exception(errc::invalid_socket_mask);
   for (auto &skts : _event_map)
     skts.fill(-1);
+  if (backend == rapl_backend::msr)
+    add_msr_events(dmask, skt_mask, root, os);
+  else if (backend == rapl_backend::perf)
+    add_perf_events(dmask, skt_mask, os);
+  else
+    add_powercap_events(dmask, skt_mask, os);
+  if (!num_events())
+    throw exception(errc::no_events_added);
+  // the reads are batched if possible, but do not need to be
+  try {
+    if ((_ring = make_ring()))
+      os << fileline(cmmn::concat("reading ", std::to_string(num_events()),
+                                  " events in one batch through io_uring\n"));
+  } catch (const exception &e) {
+    os << fileline(cmmn::concat("io_uring unavailable, reading events one "
+                                "at a time: ",
+                                e.what(), "\n"));
+  }
+}
+
+reader_impl::reader_impl(const reader_impl &other)
+    : _event_map(other._event_map), _active_events(other._active_events),
+      _groups(other._groups), _ring(), _read_mx() {
+  // as when constructed, the copy falls back to reading one event at a time
+  if (other._ring) {
+    try {
+      _ring = make_ring();
+    } catch (const exception &e) {
+      std::cerr << fileline(cmmn::concat("io_uring unavailable, reading events "
+                                         "one at a time: ",
+                                         e.what(), "\n"));
+    }
+  }
+}
+
+reader_impl::~reader_impl() = default;
+
+std::unique_ptr<io_ring> reader_impl::make_ring() const {
+#ifdef NRG_IO_URING
+  // the events of the perf backend are already read in groups
+  if (!_groups.empty())
+    return nullptr;
+  std::vector<io_ring::request> requests;
+  requests.reserve(_active_events.size());
+  for (const event_data &ev : _active_events)
+    if (ev.msr)
+      requests.push_back({ev.fd.value, ev.msr, sizeof(uint64_t)});
+    else
+      requests.push_back({ev.fd.value, 0, io_ring::slot_size - 1});
+  return std::make_unique<io_ring>(std::move(requests));
+#else
+  return nullptr;
+#endif // NRG_IO_URING
+}
+
+void reader_impl::add_powercap_events(location_mask dmask,
+                                      socket_mask skt_mask, std::ostream &os) {
   result<uint8_t> num_skts = count_sockets();
   if (!num_skts)
     throw exception(num_skts.error());
@@ -201,11 +417,156 @@ reader_impl::reader_impl(location_mask dmask, socket_mask skt_mask,
           throw exception(ec);
     }
   }
-  if (!num_events())
-    throw exception(errc::no_events_added);
+}
+
+void reader_impl::add_msr_events(location_mask dmask, socket_mask skt_mask,
+                                 std::string_view root, std::ostream &os) {
+  const std::string prefix(root);
+  char filename[256];
+  // the counters of a package are read through the first of its CPUs which is
+  // online; the CPUs of a package need not be numbered consecutively
+  std::array<int32_t, max_sockets> cpus;
+  cpus.fill(-1);
+  snprintf(filename, sizeof(filename), "%s/sys/devices/system/cpu/online",
+           prefix.c_str());
+  for (int32_t cpu : parse_cpu_list(read_line(filename))) {
+    snprintf(filename, sizeof(filename),
+             "%s/sys/devices/system/cpu/cpu%d/topology/physical_package_id",
+             prefix.c_str(), cpu);
+    std::ifstream ifs(filename, std::ios::in);
+    uint32_t pkg;
+    if (!(ifs >> pkg))
+      throw exception(errc::package_num_error);
+    if (pkg >= max_sockets)
+      throw exception(errc::too_many_sockets);
+    if (cpus[pkg] < 0)
+      cpus[pkg] = cpu;
+  }
+  if (std::all_of(cpus.begin(), cpus.end(), [](int32_t c) { return c < 0; }))
+    throw exception(errc::no_sockets_found);
+  snprintf(filename, sizeof(filename), "%s/proc/cpuinfo", prefix.c_str());
+  bool fixed_dram = dram_fixed_unit(filename);
+  for (uint32_t pkg = 0; pkg < max_sockets; pkg++) {
+    if (cpus[pkg] < 0 || !skt_mask[pkg])
+      continue;
+    snprintf(filename, sizeof(filename), "%s/dev/cpu/%d/msr", prefix.c_str(),
+             cpus[pkg]);
+    file_descriptor filed(filename);
+    uint64_t units;
+    if (pread_msr(filed.value, MSR_RAPL_POWER_UNIT, &units) == -1)
+      throw exception(std::error_code{errno, std::system_category()});
+    // bits 12:8 are the energy status units
+    auto esu = static_cast<uint8_t>((units >> 8) & 0x1f);
+    os << fileline(cmmn::concat("registered socket: ", std::to_string(pkg),
+                                " through ", filename, ", energy unit: 2^-",
+                                std::to_string(esu), " J\n"));
+    for (auto [didx, msr] : MSR_DOMAINS) {
+      if (!dmask[didx])
+        continue;
+      char msr_name[16];
+      snprintf(msr_name, sizeof(msr_name), "0x%x", msr);
+      uint64_t initial;
+      // the domains which the package lacks cannot be read
+      if (pread_msr(filed.value, msr, &initial) == -1) {
+        os << fileline(cmmn::concat("skipped unreadable MSR ", msr_name,
+                                    " of socket ", std::to_string(pkg), "\n"));
+        continue;
+      }
+      uint8_t shift = didx == loc::mem::value && fixed_dram ? 16 : esu;
+      os << fileline(cmmn::concat("added event: MSR ", msr_name, " of socket ",
+                                  std::to_string(pkg), "\n"));
+      _event_map[pkg][didx] = _active_events.size();
+      _active_events.emplace_back(file_descriptor(filed), msr, shift,
+                                  initial & MSR_ENERGY_MASK);
+    }
+  }
+}
+
+void reader_impl::add_perf_events(location_mask dmask, socket_mask skt_mask,
+                                  std::ostream &os) {
+  char filename[256];
+  snprintf(filename, sizeof(filename), "%s/type", PERF_POWER_PMU);
+  uint64_t type;
+  {
+    file_descriptor filed(filename);
+    if (read_uint64(filed.value, &type) < 0)
+      throw exception(std::error_code{errno, std::system_category()});
+  }
+  // the PMU counts on a single CPU of each package
+  snprintf(filename, sizeof(filename), "%s/cpumask", PERF_POWER_PMU);
+  std::array<int32_t, max_sockets> cpus;
+  cpus.fill(-1);
+  for (int32_t cpu : parse_cpu_list(read_line(filename))) {
+    snprintf(filename, sizeof(filename),
+             "/sys/devices/system/cpu/cpu%d/topology/physical_package_id",
+             cpu);
+    std::ifstream ifs(filename, std::ios::in);
+    uint32_t pkg;
+    if (!(ifs >> pkg))
+      throw exception(errc::package_num_error);
+    if (pkg >= max_sockets)
+      throw exception(errc::too_many_sockets);
+    if (cpus[pkg] < 0)
+      cpus[pkg] = cpu;
+  }
+  if (std::all_of(cpus.begin(), cpus.end(), [](int32_t c) { return c < 0; }))
+    throw exception(errc::no_sockets_found);
+  for (uint32_t pkg = 0; pkg < max_sockets; pkg++) {
+    if (cpus[pkg] < 0 || !skt_mask[pkg])
+      continue;
+    os << fileline(cmmn::concat("registered socket: ", std::to_string(pkg),
+                                " through CPU ", std::to_string(cpus[pkg]),
+                                "\n"));
+    // the first event opened leads the group, which is read as a whole
+    auto group = static_cast<int32_t>(_groups.size());
+    int leader = -1;
+    std::vector<uint32_t> members;
+    for (auto [didx, name] : PERF_DOMAINS) {
+      if (!dmask[didx])
+        continue;
+      // the domains which the package lacks have no event
+      uint64_t config;
+      snprintf(filename, sizeof(filename), "%s/events/%s", PERF_POWER_PMU,
+               name);
+      if (!parse_perf_event(read_line(filename), &config))
+        continue;
+      snprintf(filename, sizeof(filename), "%s/events/%s.scale",
+               PERF_POWER_PMU, name);
+      // in joules per count
+      double scale = strtod(read_line(filename).c_str(), nullptr);
+      if (!(scale > 0.0))
+        throw exception(errc::file_format_error);
+      perf_event_attr attr{};
+      attr.type = static_cast<uint32_t>(type);
+      attr.size = sizeof(attr);
+      attr.config = config;
+      attr.read_format = PERF_FORMAT_GROUP;
+      int fd = perf_event_open(&attr, cpus[pkg], leader);
+      // requires CAP_PERFMON or a perf_event_paranoid of at most 0
+      if (fd == -1)
+        throw exception(std::error_code{errno, std::system_category()});
+      if (leader < 0)
+        leader = fd;
+      os << fileline(cmmn::concat("added event: power/", name, "/ of socket ",
+                                  std::to_string(pkg), "\n"));
+      _event_map[pkg][didx] = _active_events.size();
+      members.push_back(_active_events.size());
+      _active_events.emplace_back(file_descriptor(fd), group, scale * 1e6);
+    }
+    if (!members.empty())
+      _groups.push_back(std::move(members));
+  }
 }
 
 bool reader_impl::read(sample &s, std::error_code &ec) const {
+  if (_ring)
+    return read_ring(s, ec);
+  if (!_groups.empty()) {
+    for (size_t group = 0; group < _groups.size(); group++)
+      if (!read_group(s, group, ec))
+        return false;
+    return true;
+  }
   for (size_t ix = 0; ix < _active_events.size(); ix++)
     if (!read(s, ix, ec))
       return false;
@@ -214,17 +575,108 @@ bool reader_impl::read(sample &s, std::error_code &ec) const {
 }
 
 bool reader_impl::read(sample &s, uint8_t ev_idx, std::error_code &ec) const {
+  if (_active_events[ev_idx].group >= 0)
+    return read_group(s, _active_events[ev_idx].group, ec);
+  const event_data &ev = _active_events[ev_idx];
   uint64_t curr;
-  if (read_uint64(_active_events[ev_idx].fd.value, &curr) == -1) {
-    ec = std::error_code(errno, std::system_category());
+  if (ev.msr) {
+    // read and accumulated in turn, so that no value read before one which
+    // was already accumulated is accumulated after it
+    std::scoped_lock lock(_read_mx);
+    if (pread_msr(ev.fd.value, ev.msr, &curr)) {
+      ec = std::error_code(errno, std::system_category());
+      return false;
+    }
+    commit_msr(s, ev_idx, curr);
+  } else {
+    if (read_uint64(ev.fd.value, &curr)) {
+      ec = std::error_code(errno, std::system_category());
+      return false;
+    }
+    commit_energy(s, ev_idx, curr);
+  }
+  ec.clear();
+  return true;
+}
+
+bool reader_impl::read_ring(sample &s, std::error_code &ec) const {
+  std::scoped_lock lock(_read_mx);
+  if (!_ring->submit(ec))
     return false;
+  for (size_t ix = 0; ix < _active_events.size(); ix++) {
+    int32_t res = _ring->result(ix);
+    if (res < 0) {
+      ec = std::error_code(-res, std::system_category());
+      return false;
+    }
+    uint64_t curr;
+    if (_active_events[ix].msr) {
+      if (res != sizeof(curr)) {
+        ec = std::error_code(EIO, std::system_category());
+        return false;
+      }
+      std::memcpy(&curr, _ring->data(ix), sizeof(curr));
+      commit_msr(s, ix, curr);
+    } else {
+      if (!res || parse_uint64(_ring->data(ix), &curr) == -1) {
+        ec = errc::file_format_error;
+        return false;
+      }
+      commit_energy(s, ix, curr);
+    }
   }
-  if (curr < _active_events[ev_idx].prev) {
+  ec.clear();
+  return true;
+}
+
+void reader_impl::commit_energy(sample &s, uint8_t ev_idx,
+                                uint64_t curr) const {
+  const event_data &ev = _active_events[ev_idx];
+  if (curr < ev.prev) {
     std::cerr << fileline("detected wraparound\n");
-    _active_events[ev_idx].curr_max += _active_events[ev_idx].max;
+    ev.curr_max += ev.max;
+  }
+  ev.prev = curr;
+  set_value(s, ev_idx, curr + ev.curr_max);
+}
+
+void reader_impl::commit_msr(sample &s, uint8_t ev_idx, uint64_t curr) const {
+  const event_data &ev = _active_events[ev_idx];
+  curr &= MSR_ENERGY_MASK;
+  // the difference is taken modulo 2^32, which accounts for a wraparound as
+  // long as the counter is read at least once in between, i.e. every few
+  // minutes even at hundreds of watts
+  ev.total += (curr - ev.total) & MSR_ENERGY_MASK;
+  uint64_t value = ev.total;
+  // in microjoules, like the powercap counters, without overflowing
+  uint64_t whole = value >> ev.unit_shift;
+  uint64_t frac = value & ((uint64_t(1) << ev.unit_shift) - 1);
+  set_value(s, ev_idx, whole * 1000000 + ((frac * 1000000) >> ev.unit_shift));
+}
+
+bool reader_impl::read_group(sample &s, int32_t group,
+                             std::error_code &ec) const {
+  const std::vector<uint32_t> &members = _groups[group];
+  // the number of events followed by their counts, in the order in which they
+  // were added to the group
+  uint64_t values[1 + max_domains];
+  ssize_t ret = ::read(_active_events[members.front()].fd.value, values,
+                       sizeof(values));
+  if (ret < 0) {
+    ec = std::error_code(errno, std::system_category());
+    return false;
+  }
+  if (static_cast<size_t>(ret) < sizeof(uint64_t) ||
+      values[0] != members.size()) {
+    ec = std::error_code(EIO, std::system_category());
+    return false;
   }
-  _active_events[ev_idx].prev = curr;
-  s.data.cpu[ev_idx] = curr + _active_events[ev_idx].curr_max;
+  // the counters are 64 bits wide and do not wrap around; they count from
+  // when they were opened, so they can read 0 until the first update
+  for (size_t i = 0; i < members.size(); i++)
+    set_value(s, members[i],
+              static_cast<uint64_t>(static_cast<double>(values[1 + i]) *
+                                    _active_events[members[i]].scale));
   ec.clear();
   return true;
 }
@@ -252,10 +704,10 @@ result<sensor_value> reader_impl::value(const sample &s,
   using rettype = result<sensor_value>;
   if (event_idx<Location>(skt) < 0)
     return rettype(nonstd::unexpect, errc::no_such_event);
-  auto res = s.data.cpu[event_idx<Location>(skt)];
-  if (!res)
+  int32_t idx = event_idx<Location>(skt);
+  if (!(s.data.cpu_read[0] & (uint32_t(1) << idx)))
     return rettype(nonstd::unexpect, errc::no_such_event);
-  return sensor_value{res};
+  return sensor_value{s.data.cpu[idx]};
 }
 
 template <>
@@ -6,15 +6,21 @@
 
 #include <array>
 #include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string_view>
 #include <vector>
 
 namespace nrgprf {
 class sample;
+class io_ring;
 
 struct NRG_LOCAL file_descriptor {
   int value;
 
   explicit file_descriptor(const char *file);
+  // takes ownership of <fd>
+  explicit file_descriptor(int fd) noexcept;
   ~file_descriptor() noexcept;
 
   file_descriptor(const file_descriptor &fd);
@@ -27,14 +33,48 @@ struct NRG_LOCAL event_data {
   mutable uint64_t max;
   mutable uint64_t prev;
   mutable uint64_t curr_max;
+  // the address of the MSR read from <fd>, or 0 if <fd> is an energy_uj file
+  uint32_t msr;
+  // the MSR counts units of 1/2^<unit_shift> joules
+  uint8_t unit_shift;
+  // the counts accumulated across the wraparounds of the MSR, whose low 32 bits
+  // are the last value read; guarded by reader_impl::_read_mx
+  mutable uint64_t total;
+  // the perf event group whose leader reads the event along with the rest of
+  // its socket, or -1 if <fd> is not a perf event
+  int32_t group;
+  // the microjoules per count of the perf event
+  double scale;
+
   event_data(file_descriptor &&fd, uint64_t max) noexcept;
+  event_data(file_descriptor &&fd, uint32_t msr, uint8_t unit_shift,
+             uint64_t initial) noexcept;
+  event_data(file_descriptor &&fd, int32_t group, double scale) noexcept;
 };
 
 struct NRG_LOCAL reader_impl {
   std::array<std::array<int32_t, max_domains>, max_sockets> _event_map;
   std::vector<event_data> _active_events;
+  // the events of each perf event group, its leader first, in the order in
+  // which they are read
+  std::vector<std::vector<uint32_t>> _groups;
+  // the reads of all events of a sample submitted as one batch, if built with
+  // NRG_IO_URING and the ring could be set up
+  std::unique_ptr<io_ring> _ring;
+  // the reader is shared by the threads which sample, which take turns to
+  // submit the batch and consume its results, or to read an MSR and
+  // accumulate it into its total
+  mutable std::mutex _read_mx;
 
   reader_impl(location_mask, socket_mask, std::ostream &);
+  // the MSR backend reads <root>/dev/cpu/<cpu>/msr, finds the package of
+  // each CPU in <root>/sys/devices/system/cpu and the CPU model in
+  // <root>/proc/cpuinfo, so that it can be tested against a fake file tree;
+  // <root> is empty otherwise
+  reader_impl(location_mask, socket_mask, rapl_backend, std::string_view root,
+              std::ostream &);
+  reader_impl(const reader_impl &);
+  ~reader_impl();
 
   bool read(sample &, std::error_code &) const;
   bool read(sample &, uint8_t, std::error_code &) const;
@@ -46,7 +86,16 @@ struct NRG_LOCAL reader_impl {
   result<sensor_value> value(const sample &, uint8_t) const noexcept;
 
 private:
+  void add_powercap_events(location_mask, socket_mask, std::ostream &);
+  void add_msr_events(location_mask, socket_mask, std::string_view root,
+                      std::ostream &);
+  void add_perf_events(location_mask, socket_mask, std::ostream &);
   std::error_code add_event(const char *base, location_mask dmask, uint8_t skt,
                             std::ostream &os);
+  std::unique_ptr<io_ring> make_ring() const;
+  bool read_ring(sample &, std::error_code &) const;
+  void commit_energy(sample &, uint8_t, uint64_t curr) const;
+  void commit_msr(sample &, uint8_t, uint64_t curr) const;
+  bool read_group(sample &, int32_t group, std::error_code &) const;
 };
 } // namespace nrgprf
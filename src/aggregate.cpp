@@ -0,0 +1,104 @@
+// aggregate.cpp
+
+#include "aggregate.hpp"
+#include "output.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+
+using namespace tep;
+
+// quantile_sketch
+
+quantile_sketch::quantile_sketch()
+    : _gamma((1 + relative_accuracy) / (1 - relative_accuracy)),
+      _log_gamma(std::log(_gamma)), _buckets(), _zeros(0), _count(0) {}
+
+void quantile_sketch::add(double value) {
+  _count++;
+  // values too small to be told apart from zero are counted as zero
+  if (!(value > std::numeric_limits<double>::min())) {
+    _zeros++;
+    return;
+  }
+  _buckets[static_cast<int32_t>(std::ceil(std::log(value) / _log_gamma))]++;
+}
+
+double quantile_sketch::quantile(double q) const noexcept {
+  if (!_count)
+    return 0.0;
+  auto rank = static_cast<uint64_t>(std::clamp(q, 0.0, 1.0) * (_count - 1));
+  if (rank < _zeros)
+    return 0.0;
+  uint64_t seen = _zeros;
+  for (auto [index, count] : _buckets) {
+    seen += count;
+    if (seen > rank)
+      // the value with the same relative error to both bounds of the bucket
+      return 2 * std::pow(_gamma, index) / (_gamma + 1);
+  }
+  assert(false);
+  return 0.0;
+}
+
+// running_stats
+
+running_stats::running_stats()
+    : _count(0), _total(0.0), _min(std::numeric_limits<double>::infinity()),
+      _max(-std::numeric_limits<double>::infinity()), _sketch() {}
+
+void running_stats::add(double value) {
+  _count++;
+  _total += value;
+  _min = std::min(_min, value);
+  _max = std::max(_max, value);
+  _sketch.add(value);
+}
+
+uint64_t running_stats::count() const noexcept { return _count; }
+
+double running_stats::total() const noexcept { return _total; }
+
+double running_stats::min() const noexcept { return _count ? _min : 0.0; }
+
+double running_stats::max() const noexcept { return _count ? _max : 0.0; }
+
+double running_stats::mean() const noexcept {
+  return _count ? _total / _count : 0.0;
+}
+
+double running_stats::quantile(double q) const noexcept {
+  return _sketch.quantile(q);
+}
+
+// section_aggregate
+
+section_aggregate::section_aggregate(const readings_output &rout)
+    : _rout(&rout), _mx(), _executions(0), _duration(),
+      _energy(rout.energy_fields()), _buffer(rout.energy_fields()) {}
+
+void section_aggregate::add(const timed_execution &exec) {
+  assert(exec.size() > 1);
+  if (exec.size() < 2)
+    return;
+  std::scoped_lock lock(_mx);
+  _executions++;
+  _duration.add(static_cast<double>((exec.back() - exec.front()).count()));
+  // fields which are not read are NaN
+  _rout->energy(exec.front(), exec.back(), _buffer.data());
+  for (size_t ix = 0; ix < _buffer.size(); ix++)
+    if (!std::isnan(_buffer[ix]))
+      _energy[ix].add(_buffer[ix]);
+}
+
+uint64_t section_aggregate::executions() const noexcept { return _executions; }
+
+const running_stats &section_aggregate::duration() const noexcept {
+  return _duration;
+}
+
+const std::vector<running_stats> &section_aggregate::energy() const noexcept {
+  return _energy;
+}
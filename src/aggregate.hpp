@@ -0,0 +1,86 @@
+// aggregate.hpp
+
+#pragma once
+
+#include "timed_sample.hpp"
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <vector>
+
+namespace tep {
+
+class readings_output;
+
+// estimates the quantiles of a stream of non-negative values in constant
+// memory by counting them in buckets whose bounds grow geometrically, so
+// that any quantile is within <relative_accuracy> of the exact one
+class quantile_sketch {
+public:
+  static constexpr double relative_accuracy = 0.01;
+
+private:
+  // values are in bucket i if gamma^(i-1) < value <= gamma^i
+  double _gamma;
+  double _log_gamma;
+  std::map<int32_t, uint64_t> _buckets;
+  uint64_t _zeros;
+  uint64_t _count;
+
+public:
+  quantile_sketch();
+
+  void add(double value);
+  // q in [0, 1]; 0 if there are no values
+  double quantile(double q) const noexcept;
+};
+
+// the count, sum, extremes and quantiles of a stream of values
+class running_stats {
+private:
+  uint64_t _count;
+  double _total;
+  double _min;
+  double _max;
+  quantile_sketch _sketch;
+
+public:
+  running_stats();
+
+  void add(double value);
+
+  uint64_t count() const noexcept;
+  double total() const noexcept;
+  double min() const noexcept;
+  double max() const noexcept;
+  double mean() const noexcept;
+  double quantile(double q) const noexcept;
+};
+
+// folds the executions of a section into statistics of their duration and
+// of the energy consumed by each of the readings of the section as they
+// complete, instead of keeping their samples
+class section_aggregate {
+private:
+  const readings_output *_rout;
+  std::mutex _mx;
+  uint64_t _executions;
+  // in nanoseconds
+  running_stats _duration;
+  // in joules, by the fields of the readings output
+  std::vector<running_stats> _energy;
+  std::vector<double> _buffer;
+
+public:
+  explicit section_aggregate(const readings_output &rout);
+
+  // adds the execution from its first to its last sample
+  void add(const timed_execution &exec);
+
+  uint64_t executions() const noexcept;
+  const running_stats &duration() const noexcept;
+  const std::vector<running_stats> &energy() const noexcept;
+};
+
+} // namespace tep
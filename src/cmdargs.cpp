@@ -10,6 +10,8 @@
 #include <iostream>
 
 #include <getopt.h>
+#include <sched.h>
+#include <unistd.h>
 
 using namespace tep;
 
@@ -42,6 +44,94 @@ std::optional<unsigned long long> parse_mask_argument(std::string_view option,
   return retval;
 }
 
+std::optional<unsigned int> parse_count_argument(std::string_view option,
+                                                 std::string_view value) {
+  unsigned int retval;
+  auto [ptr, ec] = std::from_chars(value.begin(), value.end(), retval);
+  if (auto err = std::make_error_code(ec)) {
+    std::cerr << "--" << option << ": " << err << "\n";
+    return std::nullopt;
+  }
+  if (ptr != value.end() || !retval) {
+    std::cerr << "--" << option << ": "
+              << "'" << value << "' is not a positive integer"
+              << "\n";
+    return std::nullopt;
+  }
+  return retval;
+}
+
+std::optional<unsigned int> parse_cpu_argument(std::string_view option,
+                                               std::string_view value) {
+  unsigned int retval;
+  auto [ptr, ec] = std::from_chars(value.begin(), value.end(), retval);
+  if (auto err = std::make_error_code(ec)) {
+    std::cerr << "--" << option << ": " << err << "\n";
+    return std::nullopt;
+  }
+  if (ptr != value.end() || retval >= CPU_SETSIZE) {
+    std::cerr << "--" << option << ": "
+              << "'" << value << "' is not a valid CPU"
+              << "\n";
+    return std::nullopt;
+  }
+  return retval;
+}
+
+// a comma-separated list of CPUs and ranges of CPUs, e.g. 0-3,8
+std::optional<std::vector<unsigned int>>
+parse_cpu_list_argument(std::string_view option, std::string_view value) {
+  std::vector<unsigned int> cpus;
+  auto invalid = [option, value]() {
+    std::cerr << "--" << option << ": "
+              << "'" << value << "' is not a valid list of CPUs"
+              << "\n";
+    return std::nullopt;
+  };
+  for (std::string_view rest = value; !rest.empty();) {
+    std::string_view item = rest.substr(0, rest.find(','));
+    rest.remove_prefix(std::min(rest.size(), item.size() + 1));
+    std::string_view last = item;
+    if (auto dash = item.find('-'); dash != std::string_view::npos) {
+      last = item.substr(dash + 1);
+      item = item.substr(0, dash);
+    }
+    auto first_cpu = parse_cpu_argument(option, item);
+    if (!first_cpu)
+      return std::nullopt;
+    auto last_cpu = parse_cpu_argument(option, last);
+    if (!last_cpu)
+      return std::nullopt;
+    if (*last_cpu < *first_cpu)
+      return invalid();
+    for (unsigned int cpu = *first_cpu; cpu <= *last_cpu; cpu++)
+      cpus.push_back(cpu);
+  }
+  if (cpus.empty())
+    return invalid();
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+  return cpus;
+}
+
+std::optional<int> parse_fifo_priority_argument(std::string_view option,
+                                                std::string_view value) {
+  int retval;
+  auto [ptr, ec] = std::from_chars(value.begin(), value.end(), retval);
+  if (auto err = std::make_error_code(ec)) {
+    std::cerr << "--" << option << ": " << err << "\n";
+    return std::nullopt;
+  }
+  if (ptr != value.end() || retval < sched_get_priority_min(SCHED_FIFO) ||
+      retval > sched_get_priority_max(SCHED_FIFO)) {
+    std::cerr << "--" << option << ": "
+              << "'" << value << "' is not a valid SCHED_FIFO priority"
+              << "\n";
+    return std::nullopt;
+  }
+  return retval;
+}
+
 struct parameter {
   inline static const auto pad = std::setw(30);
 
@@ -106,13 +196,16 @@ std::ostream &tep::operator<<(std::ostream &os, const arguments &args) {
   os << "flags: " << args.profiler_flags;
   os << ", output: " << args.output;
   os << ", config: " << args.config;
+  if (args.pid)
+    os << ", pid: " << args.pid;
   os << ", exec: " << args.target;
   return os;
 }
 
 void print_usage(const char *profiler_name) {
   std::cout << "Usage:\n\n";
-  std::cout << profiler_name << " <options> [--] <executable>\n\n";
+  std::cout << profiler_name << " <options> [--] <executable>\n";
+  std::cout << profiler_name << " <options> --pid <PID>\n\n";
 
   std::ios::fmtflags flags(std::cout.flags());
 
@@ -167,6 +260,20 @@ void print_usage(const char *profiler_name) {
                "overwrites config value (default: use value in config)"
                "\n";
 
+  std::cout << parameter{"--cpu-msr"}
+            << "read the CPU energy counters from the MSRs of one CPU of each "
+               "socket through /dev/cpu/<CPU>/msr instead of through the "
+               "powercap driver; requires the msr module and CAP_SYS_RAWIO "
+               "(x86_64 only)"
+               "\n";
+
+  std::cout << parameter{"--cpu-perf"}
+            << "read the CPU energy counters as one group of events of the "
+               "power PMU of perf per socket instead of through the powercap "
+               "driver; requires CAP_PERFMON or a perf_event_paranoid of at "
+               "most 0 (x86_64 only)"
+               "\n";
+
   std::cout << parameter{"--exec <path>"}
             << "evaluate executable <path> instead of <executable>; "
                "used when <executable> is some wrapper program "
@@ -178,6 +285,66 @@ void print_usage(const char *profiler_name) {
                " application"
                "\n";
 
+  std::cout << parameter{"--displaced-stepping"}
+            << "step over traps by executing a relocated copy of the original"
+               " instruction instead of temporarily removing the trap"
+               "\n";
+
+  std::cout << parameter{"--tracer-threads <N>"}
+            << "(optional) trace the target with a pool of <N> threads "
+               "instead of one thread per target thread (default: one per "
+               "target thread)"
+               "\n";
+
+  std::cout << parameter{"--sampling-spin <US>"}
+            << "(optional) busy-wait for the last <US> microseconds before "
+               "each periodic sample instead of sleeping, for more accurate "
+               "sampling intervals at the cost of a core; with this or "
+               "--sampling-cpu, samplers with intervals under 1 ms are "
+               "busy-waited for throughout (default: 0)"
+               "\n";
+
+  std::cout << parameter{"--sampling-cpu <CPU>"}
+            << "(optional) pin the thread which takes the periodic samples "
+               "to <CPU> (default: not pinned)"
+               "\n";
+
+  std::cout << parameter{"--sampling-fifo <PRIO>"}
+            << "(optional) run the thread which takes the periodic samples "
+               "under SCHED_FIFO with priority <PRIO>, so that it is not "
+               "preempted by the target; best combined with --sampling-cpu, "
+               "since it otherwise competes with the tracers while "
+               "busy-waiting (default: not real-time)"
+               "\n";
+
+  std::cout << parameter{"--housekeeping-cpus <LIST>"}
+            << "(optional) run the threads of the profiler, i.e. the tracers "
+               "and the sampling threads, on the comma-separated list of CPUs "
+               "and ranges of CPUs <LIST>, e.g. 0-3,8; the target runs on the "
+               "CPUs the profiler was started on (default: not restricted)"
+               "\n";
+
+  std::cout << parameter{"--clock <SOURCE>"}
+            << "(optional) source of the timestamps of the samples: steady "
+               "(CLOCK_MONOTONIC), system (CLOCK_REALTIME), monotonic-raw "
+               "(CLOCK_MONOTONIC_RAW) or tsc (the invariant time-stamp "
+               "counter, calibrated against CLOCK_MONOTONIC_RAW); the time of "
+               "day at which profiling started is output alongside (default: "
+            << sample_clock::to_string(sample_clock::default_source) << ")"
+            << "\n";
+
+  std::cout << parameter{"--parallel-hybrid"}
+            << "read the CPU and GPU readers of sections of both targets "
+               "concurrently, each from its own thread, instead of one after "
+               "the other; how far apart they were read is output"
+               "\n";
+
+  std::cout << parameter{"--pid <PID>"}
+            << "profile the already running process <PID> instead of "
+               "launching <executable>, and detach from it on SIGINT or "
+               "SIGTERM; implies --tracer-threads (default: 1)"
+               "\n";
+
   std::cout.flush();
   std::cout.flags(flags);
 }
@@ -188,6 +355,16 @@ std::optional<arguments> tep::parse_arguments(int argc, char *const argv[]) {
   int idle = 0;
   bool quiet = false;
   bool randomize = false;
+  bool displaced = false;
+  nrgprf::rapl_backend cpu_backend = nrgprf::rapl_backend::powercap;
+  unsigned int tracer_threads = 0;
+  unsigned int sampling_spin = 0;
+  std::optional<unsigned int> sampling_cpu;
+  std::optional<int> sampling_fifo;
+  std::vector<unsigned int> housekeeping_cpus;
+  sample_clock::source clock = sample_clock::default_source;
+  bool parallel_hybrid = false;
+  pid_t pid = 0;
   std::string output;
   std::string config;
   std::string logpath;
@@ -212,6 +389,17 @@ std::optional<arguments> tep::parse_arguments(int argc, char *const argv[]) {
       {"exec", required_argument, nullptr, 0x103},
       {"debug-dump", required_argument, nullptr, 0x104},
       {"enable-randomization", no_argument, nullptr, 0x105},
+      {"displaced-stepping", no_argument, nullptr, 0x106},
+      {"tracer-threads", required_argument, nullptr, 0x107},
+      {"pid", required_argument, nullptr, 0x108},
+      {"sampling-spin", required_argument, nullptr, 0x109},
+      {"sampling-cpu", required_argument, nullptr, 0x10a},
+      {"sampling-fifo", required_argument, nullptr, 0x10b},
+      {"housekeeping-cpus", required_argument, nullptr, 0x10c},
+      {"clock", required_argument, nullptr, 0x10d},
+      {"cpu-msr", no_argument, nullptr, 0x10e},
+      {"cpu-perf", no_argument, nullptr, 0x10f},
+      {"parallel-hybrid", no_argument, nullptr, 0x110},
       {nullptr, 0, nullptr, 0}};
 
   while ((c = getopt_long(argc, argv, "hqc:o:l:", long_options,
@@ -260,6 +448,70 @@ std::optional<arguments> tep::parse_arguments(int argc, char *const argv[]) {
     case 0x105:
       randomize = true;
       break;
+    case 0x106:
+      displaced = true;
+      break;
+    case 0x107: {
+      auto parsed_value =
+          parse_count_argument(long_options[option_index].name, optarg);
+      if (!parsed_value)
+        return std::nullopt;
+      tracer_threads = *parsed_value;
+    } break;
+    case 0x108: {
+      auto parsed_value =
+          parse_count_argument(long_options[option_index].name, optarg);
+      if (!parsed_value)
+        return std::nullopt;
+      pid = *parsed_value;
+    } break;
+    case 0x109: {
+      auto parsed_value =
+          parse_count_argument(long_options[option_index].name, optarg);
+      if (!parsed_value)
+        return std::nullopt;
+      sampling_spin = *parsed_value;
+    } break;
+    case 0x10a: {
+      auto parsed_value =
+          parse_cpu_argument(long_options[option_index].name, optarg);
+      if (!parsed_value)
+        return std::nullopt;
+      sampling_cpu = *parsed_value;
+    } break;
+    case 0x10b: {
+      auto parsed_value = parse_fifo_priority_argument(
+          long_options[option_index].name, optarg);
+      if (!parsed_value)
+        return std::nullopt;
+      sampling_fifo = *parsed_value;
+    } break;
+    case 0x10c: {
+      auto parsed_value =
+          parse_cpu_list_argument(long_options[option_index].name, optarg);
+      if (!parsed_value)
+        return std::nullopt;
+      housekeeping_cpus = *std::move(parsed_value);
+    } break;
+    case 0x10d: {
+      auto parsed_value = sample_clock::from_string(optarg);
+      if (!parsed_value) {
+        std::cerr << "--" << long_options[option_index].name << ": "
+                  << "'" << optarg << "' is not a clock source"
+                  << "\n";
+        return std::nullopt;
+      }
+      clock = *parsed_value;
+    } break;
+    case 0x10e:
+      cpu_backend = nrgprf::rapl_backend::msr;
+      break;
+    case 0x10f:
+      cpu_backend = nrgprf::rapl_backend::perf;
+      break;
+    case 0x110:
+      parallel_hybrid = true;
+      break;
     case 'c':
       config = optarg;
       break;
@@ -282,7 +534,16 @@ std::optional<arguments> tep::parse_arguments(int argc, char *const argv[]) {
     }
   }
 
-  if (optind == argc) {
+  if (pid) {
+    if (optind != argc) {
+      std::cerr << "--pid provided along with a target executable\n";
+      return std::nullopt;
+    }
+    if (!executable.empty()) {
+      std::cerr << "both --pid and --exec provided\n";
+      return std::nullopt;
+    }
+  } else if (optind == argc) {
     std::cerr << "missing target executable name\n";
     return std::nullopt;
   }
@@ -318,7 +579,16 @@ std::optional<arguments> tep::parse_arguments(int argc, char *const argv[]) {
     return std::nullopt;
   }
 
-  if (executable.empty()) {
+  if (pid) {
+    // the executable of the process, which may since have been replaced or
+    // deleted, is only accessible through its link
+    executable = "/proc/" + std::to_string(pid) + "/exe";
+    if (access(executable.c_str(), R_OK) != 0) {
+      std::cerr << "error accessing executable of process " << pid << ": "
+                << strerror(errno) << "\n";
+      return std::nullopt;
+    }
+  } else if (executable.empty()) {
     executable = argv[optind];
   } else {
     auto it = std::find_if(
@@ -331,12 +601,18 @@ std::optional<arguments> tep::parse_arguments(int argc, char *const argv[]) {
     }
   }
 
-  return arguments{flags{bool(idle), cpu_sensors, cpu_sockets, gpu_devices},
+  return arguments{flags{bool(idle), cpu_sensors, cpu_sockets, gpu_devices,
+                         cpu_backend, displaced, tracer_threads,
+                         std::chrono::microseconds(sampling_spin),
+                         sampling_cpu, sampling_fifo,
+                         std::move(housekeeping_cpus), clock,
+                         parallel_hybrid},
                    randomize,
                    std::move(config),
                    std::move(of),
                    std::move(dd),
                    log_args{bool(quiet), std::move(logpath)},
+                   pid,
                    std::move(executable),
                    &argv[optind]};
 }
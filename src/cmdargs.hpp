@@ -9,6 +9,8 @@
 #include <optional>
 #include <string>
 
+#include <sys/types.h>
+
 namespace tep {
 class optional_output_file {
   std::ofstream _file;
@@ -42,6 +44,8 @@ struct arguments {
   optional_output_file output;
   std::ofstream debug_dump;
   log_args logargs;
+  // the process to attach to, if any, in which case <target> is its executable
+  pid_t pid;
   std::string target;
   char *const *argv;
 
@@ -0,0 +1,245 @@
+// compact_execution.cpp
+
+#include "compact_execution.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <type_traits>
+
+using namespace tep;
+
+namespace {
+using sample_data = nrgprf::detail::sample_data;
+
+// calls <fn> with each array of fields of the sample, in order, until it
+// returns true
+template <typename Data, typename Fn> void for_each_array(Data &d, Fn fn) {
+#if defined NRG_X86_64
+  fn(d.cpu) || fn(d.cpu_read) || fn(d.gpu_power) || fn(d.gpu_energy);
+#elif defined NRG_PPC64
+  fn(d.timestamps) || fn(d.cpu) || fn(d.gpu_power) || fn(d.gpu_energy);
+#endif // defined NRG_X86_64
+}
+
+size_t num_columns() noexcept {
+  static const size_t count = [] {
+    size_t total = 0;
+    const sample_data data{};
+    for_each_array(data, [&total](const auto &arr) {
+      total += arr.size();
+      return false;
+    });
+    return total;
+  }();
+  return count;
+}
+
+uint64_t get_column(const sample_data &d, size_t col) noexcept {
+  uint64_t value = 0;
+  for_each_array(d, [&col, &value](const auto &arr) {
+    if (col < arr.size()) {
+      value = arr[col];
+      return true;
+    }
+    col -= arr.size();
+    return false;
+  });
+  return value;
+}
+
+void set_column(sample_data &d, size_t col, uint64_t value) noexcept {
+  for_each_array(d, [&col, value](auto &arr) {
+    using type = typename std::remove_reference_t<decltype(arr)>::value_type;
+    if (col < arr.size()) {
+      arr[col] = static_cast<type>(value);
+      return true;
+    }
+    col -= arr.size();
+    return false;
+  });
+}
+
+int64_t timestamp_ns(const timed_sample &s) noexcept {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             s.timestamp.time_since_epoch())
+      .count();
+}
+
+// signed integers are zigzag-encoded so that small differences of either
+// sign are encoded in few bytes
+uint64_t zigzag(int64_t value) noexcept {
+  return (static_cast<uint64_t>(value) << 1) ^
+         static_cast<uint64_t>(value >> 63);
+}
+
+int64_t unzigzag(uint64_t value) noexcept {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+void put_varint(std::vector<uint8_t> &bytes, uint64_t value) {
+  while (value >= 0x80) {
+    bytes.push_back(static_cast<uint8_t>(value) | 0x80);
+    value >>= 7;
+  }
+  bytes.push_back(static_cast<uint8_t>(value));
+}
+
+uint64_t get_varint(const std::vector<uint8_t> &bytes,
+                    size_t &offset) noexcept {
+  uint64_t value = 0;
+  for (unsigned int shift = 0;; shift += 7) {
+    assert(offset < bytes.size());
+    uint8_t byte = bytes[offset++];
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80))
+      break;
+  }
+  return value;
+}
+} // namespace
+
+// const_iterator
+
+compact_execution::const_iterator::const_iterator() noexcept
+    : _exec(nullptr), _index(0), _offset(0), _sample() {}
+
+compact_execution::const_iterator::const_iterator(
+    const compact_execution &exec, size_t index)
+    : _exec(&exec), _index(index), _offset(0), _sample() {
+  // only the first sample can be decoded from nothing
+  assert(index == 0 || index == exec.size());
+  if (_index < _exec->size())
+    decode();
+}
+
+compact_execution::const_iterator &
+compact_execution::const_iterator::operator++() {
+  if (++_index < _exec->size())
+    decode();
+  return *this;
+}
+
+void compact_execution::const_iterator::decode() {
+  _exec->decode(_offset, _sample);
+}
+
+// compact_execution
+
+compact_execution::compact_execution() noexcept
+    : _columns(), _bytes(), _checkpoints(), _checkpoint_values(), _size(0),
+      _last_timestamp(0), _last_values() {}
+
+compact_execution::compact_execution(const timed_execution &exec)
+    : compact_execution() {
+  for (const auto &s : exec)
+    push_back(s);
+  shrink_to_fit();
+}
+
+void compact_execution::push_back(const timed_sample &s) {
+  // fields which are read are non-zero; those which were zero until now are
+  // only added to the previous samples when this is no longer the case
+  std::vector<uint16_t> added;
+  for (size_t col = 0; col < num_columns(); col++)
+    if (get_column(s.sample.data, col) &&
+        !std::binary_search(_columns.begin(), _columns.end(), col))
+      added.push_back(static_cast<uint16_t>(col));
+  if (!added.empty())
+    add_columns(added);
+  encode(s);
+}
+
+void compact_execution::shrink_to_fit() {
+  _bytes.shrink_to_fit();
+  _checkpoints.shrink_to_fit();
+  _checkpoint_values.shrink_to_fit();
+}
+
+size_t compact_execution::size() const noexcept { return _size; }
+
+bool compact_execution::empty() const noexcept { return !_size; }
+
+size_t compact_execution::encoded_size() const noexcept {
+  return _bytes.size() + _checkpoints.size() * sizeof(checkpoint) +
+         _checkpoint_values.size() * sizeof(uint64_t);
+}
+
+timed_sample compact_execution::operator[](size_t index) const {
+  assert(index < _size);
+  size_t cp_index = index / checkpoint_interval;
+  const checkpoint &cp = _checkpoints[cp_index];
+  timed_sample s;
+  s.timestamp = timed_sample::time_point(
+      std::chrono::duration_cast<timed_sample::clock::duration>(
+          std::chrono::nanoseconds(cp.timestamp)));
+  for (size_t i = 0; i < _columns.size(); i++)
+    set_column(s.sample.data, _columns[i],
+               _checkpoint_values[cp_index * _columns.size() + i]);
+  size_t offset = cp.offset;
+  for (size_t i = cp_index * checkpoint_interval; i <= index; i++)
+    decode(offset, s);
+  return s;
+}
+
+compact_execution::const_iterator compact_execution::begin() const {
+  return const_iterator(*this, 0);
+}
+
+compact_execution::const_iterator compact_execution::end() const {
+  return const_iterator(*this, _size);
+}
+
+timed_execution compact_execution::expand() const {
+  timed_execution exec;
+  exec.reserve(_size);
+  for (const auto &s : *this)
+    exec.push_back(s);
+  return exec;
+}
+
+void compact_execution::add_columns(const std::vector<uint16_t> &columns) {
+  // the samples are encoded anew, which only happens as many times as there
+  // are fields which were zero in the first samples and read afterwards
+  timed_execution exec = expand();
+  std::vector<uint16_t> merged;
+  merged.reserve(_columns.size() + columns.size());
+  std::merge(_columns.begin(), _columns.end(), columns.begin(), columns.end(),
+             std::back_inserter(merged));
+  _columns = std::move(merged);
+  _bytes.clear();
+  _checkpoints.clear();
+  _checkpoint_values.clear();
+  _size = 0;
+  _last_timestamp = 0;
+  _last_values.assign(_columns.size(), 0);
+  for (const auto &s : exec)
+    encode(s);
+}
+
+void compact_execution::encode(const timed_sample &s) {
+  if (_size % checkpoint_interval == 0) {
+    _checkpoints.push_back(checkpoint{_bytes.size(), _last_timestamp});
+    _checkpoint_values.insert(_checkpoint_values.end(), _last_values.begin(),
+                              _last_values.end());
+  }
+  int64_t timestamp = timestamp_ns(s);
+  put_varint(_bytes, zigzag(timestamp - _last_timestamp));
+  _last_timestamp = timestamp;
+  for (size_t i = 0; i < _columns.size(); i++) {
+    uint64_t value = get_column(s.sample.data, _columns[i]);
+    // the difference wraps around, as does its inverse when decoded
+    put_varint(_bytes, zigzag(static_cast<int64_t>(value - _last_values[i])));
+    _last_values[i] = value;
+  }
+  _size++;
+}
+
+void compact_execution::decode(size_t &offset, timed_sample &into) const {
+  into.timestamp += std::chrono::duration_cast<timed_sample::clock::duration>(
+      std::chrono::nanoseconds(unzigzag(get_varint(_bytes, offset))));
+  for (uint16_t col : _columns) {
+    auto delta = static_cast<uint64_t>(unzigzag(get_varint(_bytes, offset)));
+    set_column(into.sample.data, col,
+               get_column(into.sample.data, col) + delta);
+  }
+}
@@ -0,0 +1,106 @@
+// compact_execution.hpp
+
+#pragma once
+
+#include "timed_sample.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <vector>
+
+namespace tep {
+
+// stores the samples of an execution as the differences between consecutive
+// samples, encoded as variable-length integers, and only of the fields of the
+// samples which were read, i.e. which were non-zero in any sample; a sample
+// takes a few bytes instead of the whole nrgprf::sample, and is decoded when
+// accessed, either in sequence or from the nearest checkpoint
+class compact_execution {
+public:
+  // decodes each sample into the same one, which is only valid until the
+  // iterator is advanced
+  class const_iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = timed_sample;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const timed_sample *;
+    using reference = const timed_sample &;
+
+    const_iterator() noexcept;
+
+    reference operator*() const noexcept { return _sample; }
+    pointer operator->() const noexcept { return &_sample; }
+
+    const_iterator &operator++();
+
+    bool operator==(const const_iterator &rhs) const noexcept {
+      return _index == rhs._index;
+    }
+    bool operator!=(const const_iterator &rhs) const noexcept {
+      return !(*this == rhs);
+    }
+
+  private:
+    friend class compact_execution;
+
+    const compact_execution *_exec;
+    size_t _index;
+    size_t _offset;
+    timed_sample _sample;
+
+    const_iterator(const compact_execution &exec, size_t index);
+    void decode();
+  };
+
+  using value_type = timed_sample;
+  using size_type = size_t;
+  using iterator = const_iterator;
+
+  // samples between checkpoints, i.e. the most decoded to access a sample
+  static constexpr size_t checkpoint_interval = 64;
+
+  compact_execution() noexcept;
+  explicit compact_execution(const timed_execution &exec);
+
+  void push_back(const timed_sample &);
+  void shrink_to_fit();
+
+  size_t size() const noexcept;
+  bool empty() const noexcept;
+  // the number of bytes used by the encoded samples and their checkpoints
+  size_t encoded_size() const noexcept;
+
+  timed_sample operator[](size_t) const;
+
+  const_iterator begin() const;
+  const_iterator end() const;
+
+  timed_execution expand() const;
+
+private:
+  // the state from which the samples from <offset> onwards are decoded,
+  // i.e. the values of the sample before them
+  struct checkpoint {
+    size_t offset;
+    int64_t timestamp;
+  };
+
+  // indices of the fields stored, in the order they are encoded
+  std::vector<uint16_t> _columns;
+  std::vector<uint8_t> _bytes;
+  std::vector<checkpoint> _checkpoints;
+  // the values of the stored fields at each checkpoint
+  std::vector<uint64_t> _checkpoint_values;
+  size_t _size;
+  // the last sample appended, from which the next one is encoded
+  int64_t _last_timestamp;
+  std::vector<uint64_t> _last_values;
+
+  void add_columns(const std::vector<uint16_t> &columns);
+  void encode(const timed_sample &);
+  void decode(size_t &offset, timed_sample &into) const;
+};
+
+} // namespace tep
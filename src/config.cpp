@@ -1,13 +1,16 @@
 // config.cpp
 
 #include "config.hpp"
+#include "syscall_types.hpp"
 
 #include <algorithm>
 #include <cassert>
 #include <charconv>
+#include <cmath>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 
 #include <nonstd/expected.hpp>
 #include <pugixml.hpp>
@@ -27,11 +30,13 @@ static constexpr std::string_view error_messages[] = {
     "section: label cannot be empty",
     "section: extra data cannot be empty",
     "section: frequency must be a positive decimal number",
-    "section: interval must be a positive integer",
+    "section: interval must be a positive decimal number",
     "section: method must be 'profile' or 'total'",
     "section: executions must be a positive integer",
+    "section: every must be a positive integer",
     "section: samples must be a positive integer",
     "section: duration must be a positive integer",
+    "section: max samples must be an integer greater than 1",
     "section: section label already exists",
     "section: cannot have both <short/> and <long/> tags",
     "section: invalid <method></method> for <short/>",
@@ -67,10 +72,19 @@ static constexpr std::string_view error_messages[] = {
     "addr: no end address",
     "addr: invalid address value; must be positive, hexadecimal and begin with "
     "0x or 0X",
+
+    "syscall: attribute 'name' or 'nr' not found",
+    "syscall: unknown system call name",
+    "syscall: invalid system call number: must be a non-negative integer",
+    "syscall: too many <arg/> conditions: at most 6 are allowed",
+    "syscall arg: index must be an integer between 0 and 5",
+    "syscall arg: attribute 'value' not found",
+    "syscall arg: invalid value: must be an integer",
+    "syscall arg: invalid mask: must be an integer",
 };
 
 static_assert(
-    static_cast<size_t>(tep::cfg::errc::addr_range_invalid_value) ==
+    static_cast<size_t>(tep::cfg::errc::syscall_arg_invalid_mask) ==
         sizeof(error_messages) / sizeof(error_messages[0]),
     "cfg_error_code number of entries does not match message array size");
 
@@ -83,7 +97,7 @@ struct config_category_t : std::error_category {
   std::string message(int ev) const override {
     using tep::cfg::errc;
     auto ec = static_cast<errc>(ev);
-    if (ec >= errc::config_io_error && ec <= errc::addr_range_invalid_value)
+    if (ec >= errc::config_io_error && ec <= errc::syscall_arg_invalid_mask)
       return std::string(error_messages[ev - 1]);
     return "(unrecognized error code)";
   }
@@ -249,35 +263,54 @@ std::optional<uint32_t> get_hex_value(std::string_view data) noexcept {
   return std::nullopt;
 }
 
-result<std::chrono::milliseconds> get_interval(const pugi::xml_node &nsection) {
+// a decimal, hexadecimal (0x) or octal (0) integer
+std::optional<uint64_t> get_integer_value(std::string_view data) noexcept {
+  int base = 10;
+  if (valid_hex_prefix(data)) {
+    data.remove_prefix(2);
+    base = 16;
+  } else if (data.size() > 1 && data[0] == '0') {
+    data.remove_prefix(1);
+    base = 8;
+  }
+  uint64_t value;
+  auto [ptr, ec] =
+      std::from_chars(data.data(), data.data() + data.size(), value, base);
+  if (std::make_error_code(ec) || ptr != data.data() + data.size())
+    return std::nullopt;
+  return value;
+}
+
+result<std::chrono::microseconds> get_interval(const pugi::xml_node &nsection) {
   using namespace pugi;
   using tep::cfg::errc;
   using rettype = decltype(get_interval(std::declval<decltype(nsection)>()));
+  using std::chrono::microseconds;
   xml_node nfreq = nsection.child("freq");
   xml_node nint = nsection.child("interval");
   // <interval/> overrides <freq></freq>
   if (nint) {
-    // <interval/> must be a valid, positive integer
-    int interval = nint.text().as_int(0);
-    if (interval <= 0)
+    // <interval/> must be a positive decimal number of milliseconds, which
+    // is rounded to the nearest microsecond
+    double interval = std::round(nint.text().as_double(0.0) * 1000.0);
+    if (!(interval >= 1.0))
       return rettype(nonstd::unexpect, errc::sec_invalid_interval);
-    return std::chrono::milliseconds(interval);
+    return microseconds(static_cast<microseconds::rep>(interval));
   }
   if (nfreq) {
     // <freq/> must be a positive decimal number
     double freq = nfreq.text().as_double(0.0);
     if (freq <= 0.0)
       return rettype(nonstd::unexpect, errc::sec_invalid_freq);
-    return std::chrono::milliseconds(
-        static_cast<std::chrono::milliseconds::rep>(
-            std::clamp(1000.0 / freq, 1.0, 1000.0 / freq)));
+    return microseconds(static_cast<microseconds::rep>(
+        std::max(std::round(1000000.0 / freq), 1.0)));
   }
   return rettype(nonstd::unexpect, errc::sec_no_interval);
 }
 
 result<std::optional<uint32_t>>
 get_samples(const pugi::xml_node &nsection,
-            const std::chrono::milliseconds &interval) {
+            const std::chrono::microseconds &interval) {
   using namespace pugi;
   using tep::cfg::errc;
   using rettype = result<std::optional<uint32_t>>;
@@ -289,7 +322,8 @@ get_samples(const pugi::xml_node &nsection,
     int duration = ndur.text().as_int(0);
     if (duration <= 0)
       return rettype(nonstd::unexpect, errc::sec_invalid_duration);
-    return duration / interval.count() + (duration % interval.count() != 0);
+    std::chrono::microseconds dur = std::chrono::milliseconds(duration);
+    return dur / interval + (dur % interval != dur.zero());
   }
   if (nsamp) {
     // <samples/> must be a valid, positive integer
@@ -301,6 +335,21 @@ get_samples(const pugi::xml_node &nsection,
   return std::nullopt;
 }
 
+result<std::optional<uint32_t>>
+get_positive_value(const pugi::xml_node &nsection, const char *name,
+                   tep::cfg::errc ec) {
+  using namespace pugi;
+  using rettype = result<std::optional<uint32_t>>;
+  xml_node nvalue = nsection.child(name);
+  if (!nvalue)
+    return std::nullopt;
+  // must be a valid, positive integer
+  int value = nvalue.text().as_int(0);
+  if (value <= 0)
+    return rettype(nonstd::unexpect, ec);
+  return value;
+}
+
 result<std::string> get_method(const pugi::xml_node &nsection) {
   using namespace pugi;
   using tep::cfg::errc;
@@ -448,6 +497,53 @@ function_t::function_t(const config_entry &entry)
   name = name_attr.value();
 }
 
+syscall_arg_t::syscall_arg_t(const config_entry &entry)
+    : index(0), value(0), mask(~uint64_t{0}) {
+  using namespace pugi;
+  auto res_index = get_integer_value(entry.node.attribute("index").value());
+  if (!res_index || *res_index >= syscall_entry::max_args)
+    throw exception(errc::syscall_arg_invalid_index);
+  index = *res_index;
+  xml_attribute value_attr = entry.node.attribute("value");
+  if (!value_attr)
+    throw exception(errc::syscall_arg_no_value);
+  auto res_value = get_integer_value(value_attr.value());
+  if (!res_value)
+    throw exception(errc::syscall_arg_invalid_value);
+  value = *res_value;
+  // mask - optional, all bits by default
+  if (xml_attribute mask_attr = entry.node.attribute("mask")) {
+    auto res_mask = get_integer_value(mask_attr.value());
+    if (!res_mask)
+      throw exception(errc::syscall_arg_invalid_mask);
+    mask = *res_mask;
+  }
+}
+
+syscall_t::syscall_t(const config_entry &entry) : number(0) {
+  using namespace pugi;
+  // attribute "name" takes precedence over "nr"
+  if (xml_attribute name_attr = entry.node.attribute("name")) {
+    auto res_number = syscall_number(name_attr.value());
+    if (!res_number)
+      throw exception(errc::syscall_invalid_name);
+    number = *res_number;
+  } else if (xml_attribute nr_attr = entry.node.attribute("nr")) {
+    auto res_number = get_integer_value(nr_attr.value());
+    if (!res_number || *res_number > std::numeric_limits<int32_t>::max())
+      throw exception(errc::syscall_invalid_nr);
+    number = *res_number;
+  } else {
+    throw exception(errc::syscall_no_name);
+  }
+  // <arg/> - optional, all of which must match
+  for (config_entry narg{entry.node.child("arg")}; narg;
+       narg = config_entry{narg.node.next_sibling("arg")})
+    args.emplace_back(narg);
+  if (args.size() > syscall_entry::max_args)
+    throw exception(errc::syscall_too_many_args);
+}
+
 bounds_t::bounds_t(const config_entry &entry, key<section_t>) {
   using namespace pugi;
   // <start/>
@@ -458,9 +554,12 @@ bounds_t::bounds_t(const config_entry &entry, key<section_t>) {
   config_entry nfunc{entry.node.child("func")};
   // <addr/>
   config_entry naddr{entry.node.child("addr")};
+  // <syscall/>
+  config_entry nsyscall{entry.node.child("syscall")};
 
   if ((nstart && nfunc) || (nend && nfunc) || (nstart && naddr) ||
-      (nend && naddr) || (nfunc && naddr)) {
+      (nend && naddr) || (nfunc && naddr) ||
+      (nsyscall && (nstart || nend || nfunc || naddr))) {
     throw exception(errc::bounds_too_many);
   } else if (nstart || nend) {
     assert(!nfunc && !naddr);
@@ -475,6 +574,8 @@ bounds_t::bounds_t(const config_entry &entry, key<section_t>) {
   } else if (naddr) {
     assert(!nstart && !nend && !nfunc);
     _value = address_range_t(naddr);
+  } else if (nsyscall) {
+    _value = syscall_t(nsyscall);
   } else {
     throw exception(errc::bounds_empty);
   }
@@ -517,6 +618,7 @@ method_total_t::method_total_t(const config_entry &entry) {
   if (*res_method == "profile")
     throw exception(errc::sec_invalid_method_for_short);
   short_section = bool(nshort);
+  aggregate = bool(entry.node.child("aggregate"));
 }
 
 method_profile_t::method_profile_t(const config_entry &entry) {
@@ -529,6 +631,15 @@ method_profile_t::method_profile_t(const config_entry &entry) {
     throw exception(res_samples.error());
   interval = *std::move(res_interval);
   samples = *std::move(res_samples);
+  // <max_samples></max_samples> - optional, at least the first and last
+  auto res_max = get_positive_value(entry.node, "max_samples",
+                                    errc::sec_invalid_max_samples);
+  if (!res_max)
+    throw exception(res_max.error());
+  if (*res_max && **res_max < 2)
+    throw exception(errc::sec_invalid_max_samples);
+  max_samples = *res_max;
+  phase_lock = bool(entry.node.child("phase_lock"));
 }
 
 misc_attributes_t::misc_attributes_t(const config_entry &entry,
@@ -550,8 +661,21 @@ section_t::section_t(const config_entry &entry)
     : label(std::nullopt), extra(std::nullopt), targets(target::cpu),
       misc(entry, key<section_t>{}),
       bounds(config_entry{entry.node.child("bounds")}, key<section_t>{}),
-      allow_concurrency(bool(entry.node.child("allow_concurrency"))) {
+      allow_concurrency(bool(entry.node.child("allow_concurrency"))),
+      every(1), max_executions(std::nullopt) {
   using namespace pugi;
+  // <every></every> - optional
+  auto res_every =
+      get_positive_value(entry.node, "every", errc::sec_invalid_every);
+  if (!res_every)
+    throw exception(res_every.error());
+  every = res_every->value_or(1);
+  // <max_executions></max_executions> - optional
+  auto res_execs = get_positive_value(entry.node, "max_executions",
+                                      errc::sec_invalid_execs);
+  if (!res_execs)
+    throw exception(res_execs.error());
+  max_executions = *res_execs;
   if (xml_attribute label_attr = entry.node.attribute("label")) {
     if (!*label_attr.value())
       throw exception(errc::sec_invalid_label);
@@ -722,6 +846,25 @@ std::ostream &operator<<(std::ostream &os, const function_t &x) {
   return os;
 }
 
+std::ostream &operator<<(std::ostream &os, const syscall_arg_t &x) {
+  std::ios::fmtflags flags(os.flags());
+  os << "arg" << x.index << " & 0x" << std::hex << x.mask << " == 0x"
+     << x.value;
+  os.flags(flags);
+  return os;
+}
+
+std::ostream &operator<<(std::ostream &os, const syscall_t &x) {
+  os << "syscall ";
+  if (auto name = syscall_name(x.number); !name.empty())
+    os << name;
+  else
+    os << x.number;
+  for (const auto &arg : x.args)
+    os << ", " << arg;
+  return os;
+}
+
 std::ostream &operator<<(std::ostream &os,
                          const bounds_t::position_range_t &x) {
   os << x.first << " - " << x.second;
@@ -740,17 +883,24 @@ std::ostream &operator<<(std::ostream &os, const bounds_t &x) {
 std::ostream &operator<<(std::ostream &os, const method_total_t &x) {
   os << "total energy method, short section? "
      << (x.short_section ? "yes" : "no");
+  os << ", aggregate? " << (x.aggregate ? "yes" : "no");
   return os;
 }
 
 std::ostream &operator<<(std::ostream &os, const method_profile_t &x) {
   os << "full profile method, interval: ";
-  os << x.interval.count() << "ms";
+  os << x.interval.count() << "us";
   os << ", samples: ";
   if (x.samples)
     os << *x.samples;
   else
     os << "n/a";
+  os << ", max samples: ";
+  if (x.max_samples)
+    os << *x.max_samples;
+  else
+    os << "unbounded";
+  os << ", phase lock? " << (x.phase_lock ? "yes" : "no");
   return os;
 }
 
@@ -780,6 +930,12 @@ std::ostream &operator<<(std::ostream &os, const section_t &x) {
   os << "\n" << indent << "misc: " << x.misc;
   os << "\n"
      << indent << "allow concurrency? " << (x.allow_concurrency ? "yes" : "no");
+  os << "\n" << indent << "every: " << x.every;
+  os << "\n" << indent << "max executions: ";
+  if (x.max_executions)
+    os << *x.max_executions;
+  else
+    os << "n/a";
   return os;
 }
 
@@ -839,17 +995,29 @@ bool operator==(const function_t &lhs, const function_t &rhs) {
   return lhs.compilation_unit == rhs.compilation_unit && lhs.name == rhs.name;
 }
 
+bool operator==(const syscall_arg_t &lhs, const syscall_arg_t &rhs) {
+  return lhs.index == rhs.index && lhs.value == rhs.value &&
+         lhs.mask == rhs.mask;
+}
+
+bool operator==(const syscall_t &lhs, const syscall_t &rhs) {
+  return lhs.number == rhs.number && lhs.args == rhs.args;
+}
+
 bool operator==(const bounds_t &lhs, const bounds_t &rhs) {
   return lhs._value == rhs._value;
 }
 
 static bool operator==(const method_total_t &lhs, const method_total_t &rhs) {
-  return lhs.short_section == rhs.short_section;
+  return lhs.short_section == rhs.short_section &&
+         lhs.aggregate == rhs.aggregate;
 }
 
 static bool operator==(const method_profile_t &lhs,
                        const method_profile_t &rhs) {
-  return lhs.interval == rhs.interval && lhs.samples == rhs.samples;
+  return lhs.interval == rhs.interval && lhs.samples == rhs.samples &&
+         lhs.max_samples == rhs.max_samples &&
+         lhs.phase_lock == rhs.phase_lock;
 }
 
 bool operator==(const misc_attributes_t &lhs, const misc_attributes_t &rhs) {
@@ -859,7 +1027,9 @@ bool operator==(const misc_attributes_t &lhs, const misc_attributes_t &rhs) {
 bool operator==(const section_t &lhs, const section_t &rhs) {
   return lhs.label == rhs.label && lhs.extra == rhs.extra &&
          lhs.targets == rhs.targets && lhs.bounds == rhs.bounds &&
-         lhs.allow_concurrency == rhs.allow_concurrency && lhs.misc == rhs.misc;
+         lhs.allow_concurrency == rhs.allow_concurrency &&
+         lhs.every == rhs.every && lhs.max_executions == rhs.max_executions &&
+         lhs.misc == rhs.misc;
 }
 
 bool operator==(const group_t &lhs, const group_t &rhs) {
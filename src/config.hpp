@@ -42,8 +42,10 @@ enum class errc : uint32_t {
   sec_invalid_interval,
   sec_invalid_method,
   sec_invalid_execs,
+  sec_invalid_every,
   sec_invalid_samples,
   sec_invalid_duration,
+  sec_invalid_max_samples,
   sec_label_already_exists,
   sec_both_short_and_long,
   sec_invalid_method_for_short,
@@ -70,6 +72,14 @@ enum class errc : uint32_t {
   addr_range_no_start,
   addr_range_no_end,
   addr_range_invalid_value,
+  syscall_no_name,
+  syscall_invalid_name,
+  syscall_invalid_nr,
+  syscall_too_many_args,
+  syscall_arg_invalid_index,
+  syscall_arg_no_value,
+  syscall_arg_invalid_value,
+  syscall_arg_invalid_mask,
 };
 
 struct exception : std::system_error {
@@ -136,6 +146,23 @@ struct function_t {
   explicit function_t(const config_entry &);
 };
 
+// a condition on an argument of a system call: (arg & mask) == value
+struct syscall_arg_t {
+  uint32_t index;
+  uint64_t value;
+  uint64_t mask;
+
+  explicit syscall_arg_t(const config_entry &);
+};
+
+// a system call which bounds a section from its entry to its exit
+struct syscall_t {
+  long number;
+  std::vector<syscall_arg_t> args;
+
+  explicit syscall_t(const config_entry &);
+};
+
 class bounds_t {
 public:
   using position_range_t = std::pair<position_t, position_t>;
@@ -153,19 +180,25 @@ public:
 
 private:
   using holder_type = std::variant<std::monostate, address_range_t,
-                                   position_range_t, function_t>;
+                                   position_range_t, function_t, syscall_t>;
   holder_type _value;
 };
 
 struct method_total_t {
   bool short_section;
+  // whether executions are folded into statistics instead of being kept
+  bool aggregate;
 
   explicit method_total_t(const config_entry &);
 };
 
 struct method_profile_t {
-  std::chrono::milliseconds interval;
+  std::chrono::microseconds interval;
   std::optional<uint32_t> samples;
+  // the most samples kept of each execution, if bounded
+  std::optional<uint32_t> max_samples;
+  // whether samples are taken in phase with the updates of the sensors
+  bool phase_lock;
 
   explicit method_profile_t(const config_entry &);
 };
@@ -195,6 +228,9 @@ struct section_t {
   misc_attributes_t misc;
   bounds_t bounds;
   bool allow_concurrency;
+  // only every <every>-th execution is measured, up to <max_executions>
+  uint32_t every;
+  std::optional<uint32_t> max_executions;
 
   explicit section_t(const config_entry &);
 };
@@ -226,6 +262,8 @@ std::ostream &operator<<(std::ostream &, const params_t &);
 std::ostream &operator<<(std::ostream &, const address_range_t &);
 std::ostream &operator<<(std::ostream &, const function_t &);
 std::ostream &operator<<(std::ostream &, const position_t &);
+std::ostream &operator<<(std::ostream &, const syscall_arg_t &);
+std::ostream &operator<<(std::ostream &, const syscall_t &);
 std::ostream &operator<<(std::ostream &, const bounds_t::position_range_t &);
 std::ostream &operator<<(std::ostream &, const bounds_t &);
 std::ostream &operator<<(std::ostream &, const method_total_t &);
@@ -239,6 +277,8 @@ bool operator==(const params_t &, const params_t &);
 bool operator==(const address_range_t &, const address_range_t &);
 bool operator==(const position_t &, const position_t &);
 bool operator==(const function_t &, const function_t &);
+bool operator==(const syscall_arg_t &, const syscall_arg_t &);
+bool operator==(const syscall_t &, const syscall_t &);
 bool operator==(const bounds_t &, const bounds_t &);
 bool operator==(const misc_attributes_t &, const misc_attributes_t &);
 bool operator==(const section_t &, const section_t &);
@@ -10,6 +10,8 @@ struct params_t;
 struct address_range_t;
 struct position_t;
 struct function_t;
+struct syscall_arg_t;
+struct syscall_t;
 class bounds_t;
 struct method_total_t;
 struct method_profile_t;
@@ -0,0 +1,591 @@
+// displaced_step.cpp
+
+#include "displaced_step.hpp"
+#include "error.hpp"
+#include "log.hpp"
+#include "ptrace_misc.hpp"
+#include "registers.hpp"
+#include "trap.hpp"
+#include "util.hpp"
+
+#include <nonstd/expected.hpp>
+
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+using namespace tep;
+
+namespace {
+// number of slots for instructions relocated on demand
+constexpr size_t dynamic_slots = 256;
+
+template <typename T> bool fits(int64_t value) {
+  return value >= std::numeric_limits<T>::min() &&
+         value <= std::numeric_limits<T>::max();
+}
+
+#if defined(__x86_64__)
+
+// size of the slot of each displaced instruction in the scratch area
+constexpr size_t slot_size = 16;
+// int3
+constexpr uint8_t slot_fill = 0xcc;
+
+// one-byte opcode map, 64-bit mode
+// m: ModRM, b: imm8, w: imm16, z: imm16/32, v: imm16/32/64, o: moffs,
+// r: rel8, R: rel32, e: ModRM and immediate depends on the ModRM reg field,
+// i: imm16 + imm8 (enter), p: prefix/escape, x: invalid or unsupported,
+// .: no operands
+constexpr const char one_byte_map[] =
+    //0123456789abcdef
+    "mmmmbzxxmmmmbzxp" // 0
+    "mmmmbzxxmmmmbzxx" // 1
+    "mmmmbzpxmmmmbzpx" // 2
+    "mmmmbzpxmmmmbzpx" // 3
+    "pppppppppppppppp" // 4
+    "................" // 5
+    "xxpmppppzmbm...." // 6
+    "rrrrrrrrrrrrrrrr" // 7
+    "mmxmmmmmmmmmmmmm" // 8
+    "..........x....." // 9
+    "oooo....bz......" // a
+    "bbbbbbbbvvvvvvvv" // b
+    "mmw.ppmmi.w.xb.." // c
+    "mmmmxxx.mmmmmmmm" // d
+    "rrrrbbbbRRxr...." // e
+    "p.pp..ee......mm" // f
+    ;
+
+// two-byte opcode map (0x0f xx), same notation
+constexpr const char two_byte_map[] =
+    //0123456789abcdef
+    "mmmmx.....x.xm.x" // 0
+    "mmmmmmmmmmmmmmmm" // 1
+    "mmmmxxxxmmmmmmmm" // 2
+    "........pxpxxxxx" // 3
+    "mmmmmmmmmmmmmmmm" // 4
+    "mmmmmmmmmmmmmmmm" // 5
+    "mmmmmmmmmmmmmmmm" // 6
+    "eeeemmm.mmxxmmmm" // 7
+    "RRRRRRRRRRRRRRRR" // 8
+    "mmmmmmmmmmmmmmmm" // 9
+    "...mem....xmemmm" // a
+    "mmmmmmmmmmemmmmm" // b
+    "mmemeeem........" // c
+    "mmmmmmmmmmmmmmmm" // d
+    "mmmmmmmmmmmmmmmm" // e
+    "mmmmmmmmmmmmmmmm" // f
+    ;
+
+bool is_legacy_prefix(uint8_t b) {
+  switch (b) {
+  case 0xf0:
+  case 0xf2:
+  case 0xf3:
+  case 0x2e:
+  case 0x36:
+  case 0x3e:
+  case 0x26:
+  case 0x64:
+  case 0x65:
+  case 0x66:
+  case 0x67:
+    return true;
+  default:
+    return false;
+  }
+}
+
+bool is_string_op(uint8_t op) {
+  return (op >= 0x6c && op <= 0x6f) || (op >= 0xa4 && op <= 0xa7) ||
+         (op >= 0xaa && op <= 0xaf);
+}
+
+struct x86_insn {
+  size_t length = 0;
+  size_t opcode_offset = 0;
+  uint8_t opcode = 0;
+  bool two_byte = false;
+  // offset of the RIP-relative disp32, if any
+  size_t rip_disp_offset = 0;
+  // relative branch operand
+  size_t rel_offset = 0;
+  size_t rel_size = 0;
+  uint8_t modrm_reg = 0;
+  bool has_modrm = false;
+  uint8_t modrm = 0;
+};
+
+// decodes the length and the position-dependent operands of an instruction
+std::optional<x86_insn> decode(const uint8_t *code, size_t size) {
+  x86_insn insn;
+  size_t ix = 0;
+  bool opsize16 = false;
+  bool addr32 = false;
+  bool rep = false;
+  bool rex_w = false;
+  auto next = [&](uint8_t &b) {
+    if (ix >= size || ix >= 15)
+      return false;
+    b = code[ix++];
+    return true;
+  };
+
+  uint8_t b;
+  if (!next(b))
+    return std::nullopt;
+  while (is_legacy_prefix(b)) {
+    opsize16 |= b == 0x66;
+    addr32 |= b == 0x67;
+    rep |= b == 0xf2 || b == 0xf3;
+    if (!next(b))
+      return std::nullopt;
+  }
+  if ((b & 0xf0) == 0x40) {
+    rex_w = b & 0x08;
+    if (!next(b))
+      return std::nullopt;
+  }
+
+  insn.opcode_offset = ix - 1;
+  insn.opcode = b;
+  char kind;
+  size_t imm = 0;
+  if (b == 0xc4 || b == 0xc5 || b == 0x62) {
+    // VEX and EVEX prefixes; in 64-bit mode these opcodes are always prefixes
+    uint8_t p0, p1, p2, map = 1;
+    if (!next(p0))
+      return std::nullopt;
+    if (b == 0xc4) {
+      if (!next(p1))
+        return std::nullopt;
+      map = p0 & 0x1f;
+    } else if (b == 0x62) {
+      if (!next(p1) || !next(p2))
+        return std::nullopt;
+      map = p0 & 0x07;
+    }
+    uint8_t op;
+    if (!next(op))
+      return std::nullopt;
+    if (map != 1 && map != 2 && map != 3 && map != 5 && map != 6)
+      return std::nullopt;
+    kind = (map == 1 && op == 0x77) ? '.' : 'm';
+    if (map == 3 ||
+        (map == 1 && ((op >= 0x70 && op <= 0x73) || op == 0xc2 ||
+                      (op >= 0xc4 && op <= 0xc6))))
+      imm = 1;
+  } else if (b == 0x0f) {
+    uint8_t op;
+    if (!next(op))
+      return std::nullopt;
+    insn.two_byte = true;
+    insn.opcode = op;
+    if (op == 0x38 || op == 0x3a) {
+      uint8_t op3;
+      if (!next(op3))
+        return std::nullopt;
+      kind = 'm';
+      imm = op == 0x3a ? 1 : 0;
+    } else {
+      kind = two_byte_map[op];
+    }
+  } else {
+    kind = one_byte_map[b];
+    // XOP prefix shares its opcode with pop r/m
+    if (b == 0x8f && ix < size && (code[ix] & 0x38) != 0)
+      return std::nullopt;
+    // rep-prefixed string operations are not completed by a single step
+    if (rep && is_string_op(b))
+      return std::nullopt;
+  }
+
+  switch (kind) {
+  case 'x':
+  case 'p':
+    return std::nullopt;
+  case 'b':
+    imm = 1;
+    break;
+  case 'w':
+    imm = 2;
+    break;
+  case 'z':
+    imm = opsize16 ? 2 : 4;
+    break;
+  case 'v':
+    imm = rex_w ? 8 : (opsize16 ? 2 : 4);
+    break;
+  case 'o':
+    imm = addr32 ? 4 : 8;
+    break;
+  case 'i':
+    imm = 3;
+    break;
+  case 'r':
+    insn.rel_size = 1;
+    break;
+  case 'R':
+    insn.rel_size = 4;
+    break;
+  default:
+    break;
+  }
+
+  if (kind == 'm' || kind == 'e') {
+    uint8_t modrm;
+    if (!next(modrm))
+      return std::nullopt;
+    insn.has_modrm = true;
+    insn.modrm = modrm;
+    uint8_t mod = modrm >> 6;
+    uint8_t rm = modrm & 0x07;
+    insn.modrm_reg = (modrm >> 3) & 0x07;
+    size_t disp = 0;
+    if (mod != 3) {
+      if (rm == 4) {
+        uint8_t sib;
+        if (!next(sib))
+          return std::nullopt;
+        if (mod == 0 && (sib & 0x07) == 5)
+          disp = 4;
+      } else if (mod == 0 && rm == 5) {
+        insn.rip_disp_offset = ix;
+        disp = 4;
+      }
+      if (mod == 1)
+        disp = 1;
+      else if (mod == 2)
+        disp = 4;
+    }
+    ix += disp;
+    if (kind == 'e') {
+      if (insn.two_byte) // group 12, 13, 14 shifts with imm8
+        imm = 1;
+      else if (insn.modrm_reg < 2) // test r/m, imm
+        imm = b == 0xf6 ? 1 : (opsize16 ? 2 : 4);
+    }
+    // mod r/m of opcodes with an immediate
+    if (!insn.two_byte && b != 0x0f && b != 0xc4 && b != 0xc5 && b != 0x62) {
+      if (b == 0x69 || b == 0x81 || b == 0xc7)
+        imm = opsize16 ? 2 : 4;
+      else if (b == 0x6b || b == 0x80 || b == 0x83 || b == 0xc0 ||
+               b == 0xc1 || b == 0xc6)
+        imm = 1;
+    }
+  }
+
+  if (insn.rel_size) {
+    insn.rel_offset = ix;
+    ix += insn.rel_size;
+  }
+  ix += imm;
+  if (ix > size || ix > 15)
+    return std::nullopt;
+  insn.length = ix;
+  return insn;
+}
+
+void write_rel32(uint8_t *dst, int64_t value) {
+  int32_t v = static_cast<int32_t>(value);
+  std::memcpy(dst, &v, sizeof(v));
+}
+
+#elif defined(__powerpc64__)
+
+constexpr size_t slot_size = 4;
+constexpr uint8_t slot_fill = 0;
+
+#else
+
+constexpr size_t slot_size = 16;
+constexpr uint8_t slot_fill = 0;
+
+#endif // defined(__x86_64__)
+
+std::vector<uint8_t> slot_filler(size_t size) {
+  std::vector<uint8_t> buf(size, slot_fill);
+#if defined(__powerpc64__)
+  // tw 31, 0, 0
+  constexpr uint32_t trap_insn = 0x7fe00008;
+  for (size_t ix = 0; ix + sizeof(trap_insn) <= size; ix += sizeof(trap_insn))
+    std::memcpy(&buf[ix], &trap_insn, sizeof(trap_insn));
+#endif // defined(__powerpc64__)
+  return buf;
+}
+} // namespace
+
+#if defined(__x86_64__)
+
+std::optional<relocated_insn> tep::relocate_instruction(const uint8_t *code,
+                                                        size_t size,
+                                                        uintptr_t from,
+                                                        uintptr_t to) {
+  auto insn = decode(code, size);
+  if (!insn)
+    return std::nullopt;
+  uint8_t op = insn->opcode;
+  // int3; already a trap
+  if (!insn->two_byte && op == 0xcc)
+    return std::nullopt;
+  // loop, loope, loopne, jrcxz have no rel32 form
+  if (!insn->two_byte && op >= 0xe0 && op <= 0xe3)
+    return std::nullopt;
+  // xbegin, whose abort handler is relative
+  if (!insn->two_byte && op == 0xc7 && insn->modrm == 0xf8)
+    return std::nullopt;
+  // far call through memory
+  if (!insn->two_byte && op == 0xff && insn->modrm_reg == 3)
+    return std::nullopt;
+
+  relocated_insn rel{};
+  rel.length = insn->length;
+  rel.sets_return = !insn->two_byte &&
+                    (op == 0xe8 || (op == 0xff && insn->modrm_reg == 2));
+  int64_t delta = static_cast<int64_t>(from - to);
+
+  if (insn->rel_size == 1) {
+    // jmp rel8 and jcc rel8 are converted to their rel32 forms
+    int64_t target = static_cast<int8_t>(code[insn->rel_offset]) + delta;
+    size_t pfx = insn->opcode_offset;
+    std::memcpy(rel.bytes, code, pfx);
+    size_t ix = pfx;
+    if (op == 0xeb) {
+      rel.bytes[ix++] = 0xe9;
+    } else {
+      rel.bytes[ix++] = 0x0f;
+      rel.bytes[ix++] = 0x80 | (op & 0x0f);
+    }
+    if (ix + sizeof(int32_t) > displaced_insn::max_length)
+      return std::nullopt;
+    // the rel32 form is longer, which moves the end of the instruction
+    target += static_cast<int64_t>(insn->length) -
+              static_cast<int64_t>(ix + sizeof(int32_t));
+    if (!fits<int32_t>(target))
+      return std::nullopt;
+    write_rel32(&rel.bytes[ix], target);
+    rel.slot_length = ix + sizeof(int32_t);
+    return rel;
+  }
+
+  std::memcpy(rel.bytes, code, insn->length);
+  rel.slot_length = insn->length;
+  auto adjust_disp32 = [&](size_t offset) {
+    int32_t disp;
+    std::memcpy(&disp, &code[offset], sizeof(disp));
+    int64_t adjusted = disp + delta;
+    if (!fits<int32_t>(adjusted))
+      return false;
+    write_rel32(&rel.bytes[offset], adjusted);
+    return true;
+  };
+  if (insn->rel_size == 4 && !adjust_disp32(insn->rel_offset))
+    return std::nullopt;
+  if (insn->rip_disp_offset && !adjust_disp32(insn->rip_disp_offset))
+    return std::nullopt;
+  return rel;
+}
+
+#elif defined(__powerpc64__)
+
+std::optional<relocated_insn> tep::relocate_instruction(const uint8_t *code,
+                                                        size_t size,
+                                                        uintptr_t from,
+                                                        uintptr_t to) {
+  if (size < sizeof(uint32_t))
+    return std::nullopt;
+  uint32_t insn;
+  std::memcpy(&insn, code, sizeof(insn));
+  uint32_t opcode = insn >> 26;
+  bool absolute = insn & 0x2;
+  bool link = insn & 0x1;
+  int64_t delta = static_cast<int64_t>(from - to);
+
+  relocated_insn rel{};
+  rel.length = sizeof(insn);
+  rel.slot_length = sizeof(insn);
+  switch (opcode) {
+  case 1: // prefixed instructions may be PC-relative
+    return std::nullopt;
+  case 16: // bc
+    if (!absolute) {
+      int64_t target = static_cast<int16_t>(insn & 0xfffc) + delta;
+      if (!fits<int16_t>(target))
+        return std::nullopt;
+      insn = (insn & ~0xfffcU) | (static_cast<uint32_t>(target) & 0xfffc);
+    }
+    rel.sets_return = link;
+    break;
+  case 18: // b
+    if (!absolute) {
+      int64_t li = static_cast<int32_t>((insn & 0x03fffffc) << 6) >> 6;
+      int64_t target = li + delta;
+      if (target < -(1 << 25) || target >= (1 << 25))
+        return std::nullopt;
+      insn = (insn & ~0x03fffffcU) |
+             (static_cast<uint32_t>(target) & 0x03fffffc);
+    }
+    rel.sets_return = link;
+    break;
+  case 19:
+    switch ((insn >> 1) & 0x3ff) {
+    case 2: // addpcis
+      return std::nullopt;
+    case 16:  // bclr
+    case 528: // bcctr
+    case 560: // bctar
+      rel.sets_return = link;
+      break;
+    }
+    break;
+  }
+  std::memcpy(rel.bytes, &insn, sizeof(insn));
+  return rel;
+}
+
+#else
+
+std::optional<relocated_insn> tep::relocate_instruction(const uint8_t *,
+                                                        size_t, uintptr_t,
+                                                        uintptr_t) {
+  return std::nullopt;
+}
+
+#endif // defined(__x86_64__)
+
+scratch_area::scratch_area(uintptr_t base, size_t slots) noexcept
+    : _base(base), _slots(slots), _next(0) {}
+
+nonstd::expected<const displaced_insn *, tracer_error>
+scratch_area::relocate(const mem_file &mem, uintptr_t addr) {
+  using unexpected =
+      nonstd::expected<const displaced_insn *, tracer_error>::unexpected_type;
+  std::scoped_lock lock(_mx);
+  if (auto it = _relocated.find(addr); it != _relocated.end())
+    return it->second ? &*it->second : nullptr;
+
+  std::optional<displaced_insn> &insn = _relocated[addr];
+  if (_next == _slots) {
+    log::logline(log::warning,
+                 "[%d] no free slot to relocate instruction @ 0x%" PRIxPTR,
+                 mem.pid(), addr);
+    return nullptr;
+  }
+  uint8_t code[displaced_insn::max_length];
+  ssize_t read = pread(mem.get(), code, sizeof(code), addr);
+  if (read <= 0)
+    return unexpected{get_syserror(read ? errno : EIO,
+                                   tracer_errcode::SYSTEM_ERROR, mem.pid(),
+                                   "scratch_area::relocate: pread")};
+  uintptr_t slot = _base + _next * slot_size;
+  auto rel = relocate_instruction(code, read, addr, slot);
+  if (!rel) {
+    log::logline(log::warning,
+                 "[%d] unable to relocate instruction @ 0x%" PRIxPTR, mem.pid(),
+                 addr);
+    return nullptr;
+  }
+  ssize_t written = pwrite(mem.get(), rel->bytes, rel->slot_length, slot);
+  if (written != rel->slot_length)
+    return unexpected{get_syserror(written == -1 ? errno : EIO,
+                                   tracer_errcode::SYSTEM_ERROR, mem.pid(),
+                                   "scratch_area::relocate: pwrite")};
+  _next++;
+  insn = displaced_insn{slot, rel->length, rel->slot_length, rel->sets_return};
+  log::logline(log::debug,
+               "[%d] relocated instruction @ 0x%" PRIxPTR " to 0x%" PRIxPTR,
+               mem.pid(), addr, slot);
+  return &*insn;
+}
+
+tracer_error tep::prepare_displaced_steps(pid_t pid, registered_traps &traps) {
+  std::vector<uintptr_t> addrs = traps.addresses();
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  // slots of the registered traps, followed by those relocated on demand
+  size_t area_size =
+      ((addrs.size() + dynamic_slots) * slot_size + page_size - 1) &
+      ~(page_size - 1);
+
+  // map the scratch area right below the executable, so that RIP-relative
+  // operands and relative branches can still reach their targets; its first
+  // mapping is looked for by path, since in a process which was attached to
+  // other mappings may lie below it
+  uintptr_t base;
+  if (get_load_address(pid, base) == -1)
+    return get_syserror(errno, tracer_errcode::SYSTEM_ERROR, pid,
+                        "prepare_displaced_steps: get_load_address");
+  uintptr_t hint = base > area_size + page_size + (1 << 16)
+                       ? base - area_size - page_size
+                       : 0;
+  auto area = remote_mmap(pid, hint, area_size, PROT_READ | PROT_EXEC,
+                          MAP_PRIVATE | MAP_ANONYMOUS);
+  if (!area)
+    return std::move(area).error();
+  log::logline(log::debug,
+               "[%d] mapped scratch area for displaced stepping @ 0x%" PRIxPTR
+               " (%zu bytes)",
+               pid, *area, area_size);
+
+  mem_file mem(pid);
+  if (mem.get() == -1)
+    return get_syserror(errno, tracer_errcode::SYSTEM_ERROR, pid,
+                        "prepare_displaced_steps: open");
+
+  std::vector<uint8_t> slots = slot_filler(area_size);
+  size_t relocated = 0;
+  for (size_t ix = 0; ix < addrs.size(); ix++) {
+    uint8_t code[displaced_insn::max_length];
+    ssize_t read = pread(mem.get(), code, sizeof(code), addrs[ix]);
+    if (read <= 0)
+      return get_syserror(read ? errno : EIO, tracer_errcode::SYSTEM_ERROR,
+                          pid, "prepare_displaced_steps: pread");
+    uintptr_t slot = *area + ix * slot_size;
+    auto rel = relocate_instruction(code, read, addrs[ix], slot);
+    if (!rel) {
+      log::logline(log::warning,
+                   "[%d] unable to relocate instruction @ 0x%" PRIxPTR
+                   "; falling back to in-place single-stepping",
+                   pid, addrs[ix]);
+      continue;
+    }
+    std::memcpy(&slots[ix * slot_size], rel->bytes, rel->slot_length);
+    traps.set_displaced(
+        addrs[ix],
+        displaced_insn{slot, rel->length, rel->slot_length, rel->sets_return});
+    relocated++;
+  }
+
+  ssize_t written = pwrite(mem.get(), slots.data(), slots.size(), *area);
+  if (written != static_cast<ssize_t>(slots.size()))
+    return get_syserror(written == -1 ? errno : EIO,
+                        tracer_errcode::SYSTEM_ERROR, pid,
+                        "prepare_displaced_steps: pwrite");
+  // the remaining slots are handed out on demand
+  traps.set_scratch_area(std::make_unique<scratch_area>(
+      *area + addrs.size() * slot_size, area_size / slot_size - addrs.size()));
+  log::logline(log::success, "[%d] relocated %zu out of %zu instructions", pid,
+               relocated, addrs.size());
+  return tracer_error::success();
+}
+
+tracer_error tep::finish_displaced_step(cpu_gp_regs &regs, uintptr_t from,
+                                        const displaced_insn &insn) {
+  uintptr_t slot_end = insn.slot + insn.slot_length;
+  // fell through to the next instruction; branches taken already point to
+  // their original targets
+  if (regs.get_ip() == slot_end)
+    regs.set_ip(from + insn.length);
+  if (insn.sets_return) {
+    auto ret_addr = regs.get_return_address();
+    if (!ret_addr)
+      return std::move(ret_addr).error();
+    if (*ret_addr == slot_end)
+      if (auto error = regs.set_return_address(from + insn.length))
+        return error;
+  }
+  return regs.setregs();
+}
@@ -0,0 +1,104 @@
+// displaced_step.hpp
+
+#pragma once
+
+#include <util/expectedfwd.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <sys/types.h>
+
+namespace tep {
+
+class cpu_gp_regs;
+class mem_file;
+class registered_traps;
+class tracer_error;
+
+// the instruction replaced by a trap, relocated to a slot of a scratch area
+// mapped into the tracee, from where it is single-stepped instead of
+// temporarily restoring the original instruction
+struct displaced_insn {
+  static constexpr size_t max_length = 16;
+
+  uintptr_t slot;
+  uint8_t length;
+  uint8_t slot_length;
+  // the instruction sets a return address pointing past itself (a call)
+  bool sets_return;
+};
+
+// relocated copy of an instruction, not yet placed in the tracee
+struct relocated_insn {
+  uint8_t bytes[displaced_insn::max_length];
+  uint8_t length;
+  uint8_t slot_length;
+  bool sets_return;
+};
+
+// free slots of the scratch area, for instructions relocated while tracing,
+// such as those at the return address of functions
+class scratch_area {
+  uintptr_t _base;
+  size_t _slots;
+  size_t _next;
+  std::mutex _mx;
+  std::unordered_map<uintptr_t, std::optional<displaced_insn>> _relocated;
+
+public:
+  scratch_area(uintptr_t base, size_t slots) noexcept;
+
+  // relocates the instruction at <addr>, only the first time it is requested;
+  // nullptr if it cannot be relocated or there are no free slots left
+  nonstd::expected<const displaced_insn *, tracer_error>
+  relocate(const mem_file &mem, uintptr_t addr);
+};
+
+/**
+ * @brief Relocate the instruction at <from> so that it can execute at <to>
+ *
+ * @param code the bytes at <from>
+ * @param size the number of bytes available in <code>
+ * @param from the original address of the instruction
+ * @param to the address the instruction will be executed from
+ * @return std::optional<relocated_insn> the relocated instruction or nothing
+ * if it cannot be executed out-of-line
+ */
+std::optional<relocated_insn> relocate_instruction(const uint8_t *code,
+                                                   size_t size, uintptr_t from,
+                                                   uintptr_t to);
+
+/**
+ * @brief Relocate the instructions of all registered traps to a scratch area
+ *
+ * Must be called before the traps are installed. Traps whose instruction
+ * cannot be relocated are left without a displaced instruction and are
+ * stepped over by restoring the original word. The free slots left in the
+ * scratch area are handed to <traps>.
+ *
+ * @param pid the pid of the stopped tracee
+ * @param traps the registered traps
+ * @return tracer_error
+ */
+tracer_error prepare_displaced_steps(pid_t pid, registered_traps &traps);
+
+/**
+ * @brief Finish the single-step of a displaced instruction
+ *
+ * The tracee must have single-stepped the instruction in its slot, with
+ * <regs> holding its current registers; they are changed to the state the
+ * tracee would be in had the original instruction executed at <from>, and
+ * written back.
+ *
+ * @param regs the registers of the tracee
+ * @param from the address of the trap
+ * @param insn the displaced instruction
+ * @return tracer_error
+ */
+tracer_error finish_displaced_step(cpu_gp_regs &regs, uintptr_t from,
+                                   const displaced_insn &insn);
+
+} // namespace tep
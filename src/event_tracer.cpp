@@ -0,0 +1,1169 @@
+// event_tracer.cpp
+
+#include "event_tracer.hpp"
+#include "log.hpp"
+#include "ptrace_misc.hpp"
+#include "ptrace_wrapper.hpp"
+#include "registers.hpp"
+#include "trap.hpp"
+#include "trap_stepper.hpp"
+#include "trap_types.hpp"
+#include "util.hpp"
+
+#include <nonstd/expected.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <csignal>
+#include <cstring>
+#include <future>
+#include <optional>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace tep;
+
+// begin helper functions
+
+template <typename T> static std::string to_string(const T &obj) {
+  std::stringstream ss;
+  ss << obj;
+  return ss.str();
+}
+
+// only the children and tracees of the calling worker are waited for, since
+// only the thread attached to a tracee can issue requests for it
+static constexpr int wait_options = __WALL | __WNOTHREAD | WUNTRACED;
+
+// the stop with which a new tracee is handed to the worker it is attached to
+static constexpr int initial_stop = W_STOPCODE(SIGSTOP);
+
+static constexpr int ptrace_event(int wait_status) { return wait_status >> 16; }
+
+// the tracer whose workers are rung whenever a child changes state
+static std::atomic<const event_tracer *> running_tracer = nullptr;
+
+// end helper functions
+
+struct event_tracer::tracee_state {
+  std::shared_ptr<mem_file> mem;
+  // the initial stop of the new tracee is yet to be handled
+  bool starting = false;
+  // whether the tracee is in a ptrace-stop, as far as the worker knows, and
+  // whether it was interrupted to stop it while a non-concurrent section runs
+  bool stopped = true;
+  bool interrupted = false;
+  // the signal to deliver when detaching, if held in a signal-delivery-stop
+  int detach_signal = 0;
+  // whether the hit of the start of a section was already counted, if its
+  // start was deferred
+  bool counted = false;
+  // the section being executed, if any
+  const start_trap *strap = nullptr;
+  uintptr_t start = 0;
+  std::optional<return_frame> func_return;
+  // the index and number of the system call bounding the section, if any,
+  // during which the tracee is resumed until the system call returns
+  std::optional<size_t> syscall;
+  long syscall_number = 0;
+  std::unique_ptr<sampler> smp;
+  sampler_promise promise;
+};
+
+struct event_tracer::worker {
+  size_t index;
+  pid_t tid = 0;
+  // written to by other threads and on every SIGCHLD to interrupt the wait of
+  // the worker, since the stops of its tracees cannot be polled for
+  int doorbell = -1;
+  // whether another thread has something for the worker to answer
+  std::atomic<bool> rung = false;
+  // the state of the tracees attached to this worker, keyed by tid
+  std::unordered_map<pid_t, tracee_state> tracees;
+  // new tracees whose initial stop was waited for before their creation was
+  // reported by their parent
+  std::unordered_set<pid_t> unannounced;
+  // stops which can only be handled after a section of this worker has ended
+  std::vector<std::pair<pid_t, int>> deferred;
+  // the number of tracees of this worker executing a section
+  unsigned int sections = 0;
+  gathered_results results;
+
+  // guarded by event_tracer::_mx
+  std::vector<std::pair<cpu_gp_regs, std::shared_ptr<mem_file>>> released;
+  size_t load = 0;
+  // whether a non-concurrent section of another worker started and the
+  // tracees of this worker must be interrupted
+  bool interrupt = false;
+
+  explicit worker(size_t ix) : index(ix) {}
+
+  ~worker() {
+    if (doorbell != -1)
+      close(doorbell);
+  }
+};
+
+event_tracer::event_tracer(const registered_traps &traps, pid_t tracee_pid,
+                           uintptr_t ep, unsigned int workers,
+                           std::vector<pid_t> seized)
+    : _traps(traps), _tracee_tgid(tracee_pid), _ep(ep),
+      _seized(std::move(seized)), _workers(), _group_stop(), _mx(), _cv(),
+      _attached(0), _released(0), _exclusive(0), _concurrent(0), _done(false),
+      _error(tracer_error::success()), _detaching(false), _detach_ready(0),
+      _traps_removed(false) {
+  assert(workers > 0);
+  for (unsigned int ix = 0; ix < workers; ix++)
+    _workers.push_back(std::make_unique<worker>(ix));
+}
+
+event_tracer::~event_tracer() = default;
+
+tracer_expected<event_tracer::gathered_results> event_tracer::results() {
+  using unexpected = tracer_expected<gathered_results>::unexpected_type;
+  pid_t tid = gettid();
+
+  // the calling thread is attached to the tracee and becomes the first worker
+  worker &first = *_workers.front();
+  auto mem = std::make_shared<mem_file>(_tracee_tgid);
+  if (mem->get() == -1)
+    return unexpected{get_syserror(errno, tracer_errcode::SYSTEM_ERROR, tid,
+                                   "open tracee memory")};
+  first.tid = tid;
+  for (auto &w : _workers) {
+    w->doorbell = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (w->doorbell == -1)
+      return unexpected{
+          get_syserror(errno, tracer_errcode::SYSTEM_ERROR, tid, "eventfd")};
+  }
+  struct sigaction sa = {};
+  struct sigaction old_sa;
+  sa.sa_handler = ring_all;
+  sa.sa_flags = SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  if (sigaction(SIGCHLD, &sa, &old_sa) == -1)
+    return unexpected{
+        get_syserror(errno, tracer_errcode::SYSTEM_ERROR, tid, "sigaction")};
+  if (_seized.empty())
+    first.tracees[_tracee_tgid].mem = std::move(mem);
+  else
+    for (pid_t seized : _seized)
+      first.tracees[seized].mem = mem;
+  first.load = first.tracees.size();
+  _attached = first.load;
+
+  // SIGCHLD is only taken by a worker waiting for its doorbell, and the
+  // signals which stop tracing a seized process only by the watcher, so they
+  // are blocked before any worker starts
+  sigset_t blocked;
+  sigset_t old_mask;
+  sigemptyset(&blocked);
+  sigaddset(&blocked, SIGCHLD);
+  sigset_t stop_signals;
+  std::future<void> watcher;
+  if (!_seized.empty()) {
+    sigemptyset(&stop_signals);
+    sigaddset(&stop_signals, SIGINT);
+    sigaddset(&stop_signals, SIGTERM);
+    sigaddset(&blocked, SIGINT);
+    sigaddset(&blocked, SIGTERM);
+  }
+  pthread_sigmask(SIG_BLOCK, &blocked, &old_mask);
+  running_tracer = this;
+  if (!_seized.empty()) {
+    watcher = std::async(std::launch::async, [this, &stop_signals]() {
+      await_detach_signal(stop_signals);
+    });
+  }
+
+  // every worker must be able to be rung before any tracee is handed to it
+  std::vector<std::future<tracer_error>> pool;
+  std::vector<std::promise<void>> ready(_workers.size());
+  std::vector<std::future<void>> started;
+  for (auto &r : ready)
+    started.push_back(r.get_future());
+  for (size_t ix = 1; ix < _workers.size(); ix++) {
+    pool.push_back(std::async(std::launch::async, [this, ix, &ready]() {
+      worker &w = *_workers[ix];
+      w.tid = gettid();
+      ready[ix].set_value();
+      return run_worker(w);
+    }));
+  }
+  for (size_t ix = 1; ix < started.size(); ix++)
+    started[ix].wait();
+  log::logline(log::info, "[%d] started %zu tracer workers", tid,
+               _workers.size());
+
+  run_worker(first);
+  for (auto &worker_ftr : pool)
+    worker_ftr.wait();
+  if (watcher.valid())
+    watcher.wait();
+  running_tracer = nullptr;
+  pthread_sigmask(SIG_SETMASK, &old_mask, nullptr);
+  sigaction(SIGCHLD, &old_sa, nullptr);
+  if (_error)
+    return unexpected{std::move(_error)};
+
+  gathered_results results;
+  for (auto &w : _workers)
+    results.insert(results.end(), std::make_move_iterator(w->results.begin()),
+                   std::make_move_iterator(w->results.end()));
+  return results;
+}
+
+tracer_error event_tracer::run_worker(worker &w) {
+  tracer_error error = work(w);
+  finish(error);
+  // same as when a tracer exits
+  ptrace_wrapper &pw = ptrace_wrapper::instance;
+  for (const auto &[tid, ts] : w.tracees) {
+    int errnum;
+    if (pw.ptrace(errnum, PTRACE_DETACH, tid, 0, ts.detach_signal) == -1 &&
+        errnum != ESRCH)
+      get_syserror(errnum, tracer_errcode::PTRACE_ERROR, w.tid,
+                   "PTRACE_DETACH");
+  }
+  log::logline(log::debug, "[%d] tracer worker %zu exited", w.tid, w.index);
+  return error;
+}
+
+tracer_error event_tracer::work(worker &w) {
+  log::logline(log::debug, "[%d] started tracer worker %zu", w.tid, w.index);
+  // resume the tracees attached before the workers started
+  for (auto &[tid, ts] : w.tracees)
+    if (auto error = resume(ts, tid, 0))
+      return error;
+  while (!_done) {
+    if (_detaching && !w.sections)
+      return detach(w);
+    if (w.rung.exchange(false)) {
+      if (auto error = answer_doorbell(w))
+        return error;
+      continue;
+    }
+    int wait_status;
+    auto waited = wait_event(w, wait_status);
+    if (!waited)
+      return std::move(waited).error();
+    if (*waited)
+      if (auto error = dispatch(w, *waited, wait_status))
+        return error;
+  }
+  return tracer_error::success();
+}
+
+tracer_expected<pid_t> event_tracer::wait_event(worker &w, int &wait_status) {
+  using unexpected = tracer_expected<pid_t>::unexpected_type;
+  pid_t waited = waitpid(-1, &wait_status, wait_options | WNOHANG);
+  if (waited > 0)
+    return waited;
+  if (waited == -1 && errno == EINTR)
+    return 0;
+  // a worker whose tracees were all handed over has no children to wait for
+  if (waited == -1 && errno != ECHILD)
+    return unexpected{
+        get_syserror(errno, tracer_errcode::SYSTEM_ERROR, w.tid, "waitpid")};
+  // no stop is pending, so wait until the doorbell is rung by another thread
+  // or by a SIGCHLD, which is only unblocked while waiting; any stop reported
+  // by a SIGCHLD taken before is waited for once the doorbell is reset
+  sigset_t unblocked;
+  pthread_sigmask(SIG_SETMASK, nullptr, &unblocked);
+  sigdelset(&unblocked, SIGCHLD);
+  pollfd pfd{w.doorbell, POLLIN, 0};
+  if (ppoll(&pfd, 1, nullptr, &unblocked) == -1 && errno != EINTR)
+    return unexpected{
+        get_syserror(errno, tracer_errcode::SYSTEM_ERROR, w.tid, "ppoll")};
+  uint64_t count;
+  if (read(w.doorbell, &count, sizeof(count)) == -1 && errno != EAGAIN)
+    return unexpected{
+        get_syserror(errno, tracer_errcode::SYSTEM_ERROR, w.tid, "read")};
+  return 0;
+}
+
+void event_tracer::finish(tracer_error error) {
+  std::scoped_lock lock(_mx);
+  if (error && !_error)
+    _error = std::move(error);
+  _done = true;
+  _cv.notify_all();
+  for (const auto &w : _workers)
+    ring(*w);
+}
+
+void event_tracer::ring(worker &w) {
+  w.rung = true;
+  ring_doorbell(w);
+}
+
+void event_tracer::ring_doorbell(const worker &w) {
+  uint64_t one = 1;
+  // the counter only saturates if the worker is not waiting anyway
+  if (w.doorbell != -1)
+    [[maybe_unused]] auto ret = write(w.doorbell, &one, sizeof(one));
+}
+
+void event_tracer::ring_all(int) {
+  int saved_errno = errno;
+  // the stopped child can be attached to any worker, and the signal is
+  // delivered to any thread which does not block it
+  if (const event_tracer *trc = running_tracer)
+    for (const auto &w : trc->_workers)
+      ring_doorbell(*w);
+  errno = saved_errno;
+}
+
+void event_tracer::await_detach_signal(const sigset_t &signals) {
+  const timespec timeout{0, 100000000};
+  while (!_done) {
+    int signal = sigtimedwait(&signals, nullptr, &timeout);
+    if (signal == -1)
+      continue;
+    log::logline(log::info, "[%d] received %s, detaching from process %d",
+                 gettid(), strsignal(signal), _tracee_tgid);
+    request_detach();
+    return;
+  }
+}
+
+void event_tracer::request_detach() {
+  std::scoped_lock lock(_mx);
+  _detaching = true;
+  _cv.notify_all();
+  for (const auto &w : _workers)
+    ring(*w);
+}
+
+tracer_error event_tracer::resume(tracee_state &ts, pid_t tid,
+                                  int signal) const {
+  int errnum;
+  // a section bounded by a system call ends once it returns
+  auto request = ts.syscall ? PTRACE_SYSCALL : PTRACE_CONT;
+  const char *request_str = ts.syscall ? "PTRACE_SYSCALL" : "PTRACE_CONT";
+  if (ptrace_wrapper::instance.ptrace(errnum, request, tid, 0, signal) == -1) {
+    // the tracee was killed while stopped and its exit is yet to be waited for
+    if (errnum == ESRCH) {
+      log::logline(log::warning, "[%d] %s failed with ESRCH for tracee %d",
+                   gettid(), request_str, tid);
+      return tracer_error::success();
+    }
+    return get_syserror(errnum, tracer_errcode::PTRACE_ERROR, gettid(),
+                        request_str);
+  }
+  ts.stopped = false;
+  return tracer_error::success();
+}
+
+tracer_error event_tracer::set_child_tracing(pid_t tid, bool enable) const {
+  int errnum;
+  if (ptrace_wrapper::instance.ptrace(errnum, PTRACE_SETOPTIONS, tid, 0,
+                                      get_ptrace_opts(enable,
+                                                      _seized.empty())) == -1)
+    return get_syserror(errnum, tracer_errcode::PTRACE_ERROR, gettid(),
+                        "PTRACE_SETOPTIONS");
+  return tracer_error::success();
+}
+
+tracer_error event_tracer::dispatch(worker &w, pid_t tid, int wait_status) {
+  const char *sigstr = sig_str(WSTOPSIG(wait_status));
+  log::logline(log::debug,
+               "[%d] waited for tracee %d with signal: %s (status 0x%x)", w.tid,
+               tid, sigstr ? sigstr : "<no stop signal>", wait_status);
+  auto it = w.tracees.find(tid);
+  if (it == w.tracees.end()) {
+    log::logline(log::debug, "[%d] initial stop of new tracee %d", w.tid, tid);
+    w.unannounced.insert(tid);
+    return tracer_error::success();
+  }
+  // a tracee is in a single stop at a time, which supersedes a deferred one
+  w.deferred.erase(std::remove_if(w.deferred.begin(), w.deferred.end(),
+                                  [tid](const auto &d) {
+                                    return d.first == tid;
+                                  }),
+                   w.deferred.end());
+
+  tracee_state &ts = it->second;
+  ts.stopped = true;
+  if (WIFEXITED(wait_status) || WIFSIGNALED(wait_status))
+    return handle_exit(w, tid, wait_status);
+  // an interrupt issued while the tracee was already stopping for another
+  // reason remains pending and is reported once the tracee is resumed
+  if (ts.interrupted && is_interrupt_stop(wait_status)) {
+    ts.interrupted = false;
+    _group_stop.stopped(w.tid);
+  }
+  if (ts.strap)
+    return handle_section_stop(w, tid, ts, wait_status);
+  if (_detaching)
+    return hold_for_detach(w, tid, ts, wait_status);
+  auto handle_now = await_exclusive(w, tid, wait_status);
+  if (!handle_now)
+    return std::move(handle_now).error();
+  if (!*handle_now)
+    return tracer_error::success();
+
+  if (ts.starting) {
+    ts.starting = false;
+    log::logline(log::info, "[%d] started tracing new tracee %d", w.tid, tid);
+    return resume(ts, tid, 0);
+  }
+  if (is_child_event(wait_status))
+    return handle_new_tracee(w, tid, ts, wait_status);
+  if (is_exit_event(wait_status)) {
+    int errnum;
+    unsigned long exit_status;
+    if (ptrace_wrapper::instance.ptrace(errnum, PTRACE_GETEVENTMSG, tid, 0,
+                                        &exit_status) == -1)
+      return get_syserror(errnum, tracer_errcode::PTRACE_ERROR, w.tid,
+                          "PTRACE_GETEVENTMSG");
+    log::logline(log::debug, "[%d] tracee %d PTRACE_O_TRACEEXIT status %d",
+                 w.tid, tid, static_cast<int>(exit_status));
+    return resume(ts, tid, 0);
+  }
+  if (is_interrupt_stop(wait_status)) {
+    log::logline(log::info, "[%d] continued tracee with tid=%d", w.tid, tid);
+    return resume(ts, tid, 0);
+  }
+  if (is_seccomp_event(wait_status))
+    return start_syscall_section(w, tid, ts, wait_status);
+  if (ptrace_event(wait_status)) {
+    log::logline(log::debug, "[%d] tracee %d ptrace event %d", w.tid, tid,
+                 ptrace_event(wait_status));
+    return resume(ts, tid, 0);
+  }
+  if (is_breakpoint_trap(wait_status))
+    return start_section(w, tid, ts, wait_status);
+  if (WIFSTOPPED(wait_status)) {
+    cpu_gp_regs regs(tid);
+    if (tracer_error err = regs.getregs())
+      return err;
+    log::logline(log::debug,
+                 "[%d] tracee %d ptrace-stop with signal: %s @ 0x%" PRIxPTR,
+                 w.tid, tid, strsignal(WSTOPSIG(wait_status)), regs.get_ip());
+    return resume(ts, tid, WSTOPSIG(wait_status));
+  }
+  log::logline(log::error, "[%d] tracee %d with unknown ptrace-stop status",
+               w.tid, tid);
+  return resume(ts, tid, 0);
+}
+
+tracer_error event_tracer::answer_doorbell(worker &w) {
+  bool interrupt;
+  {
+    std::scoped_lock lock(_mx);
+    interrupt = std::exchange(w.interrupt, false);
+  }
+  if (interrupt) {
+    tracer_error error = interrupt_tracees(w, 0);
+    _group_stop.requested();
+    if (error)
+      return error;
+  }
+  return adopt_released(w);
+}
+
+tracer_error event_tracer::adopt_released(worker &w) {
+  decltype(w.released) released;
+  {
+    std::scoped_lock lock(_mx);
+    released.swap(w.released);
+  }
+  for (auto &[regs, mem] : released) {
+    pid_t tid = regs.pid();
+    if (auto error =
+            adopt_tracee(w.tid, regs, get_ptrace_opts(true, _seized.empty())))
+      return error;
+    {
+      std::scoped_lock lock(_mx);
+      _released--;
+      _attached++;
+    }
+    tracee_state &ts = w.tracees[tid];
+    ts.mem = std::move(mem);
+    ts.starting = true;
+    log::logline(log::info, "[%d] new child adopted with tid=%d", w.tid, tid);
+    if (auto error = dispatch(w, tid, initial_stop))
+      return error;
+  }
+  return tracer_error::success();
+}
+
+tracer_error event_tracer::handle_new_tracee(worker &w, pid_t parent,
+                                             tracee_state &ts,
+                                             int wait_status) {
+  int errnum;
+  unsigned long msg;
+  if (ptrace_wrapper::instance.ptrace(errnum, PTRACE_GETEVENTMSG, parent, 0,
+                                      &msg) == -1)
+    return get_syserror(errnum, tracer_errcode::PTRACE_ERROR, w.tid,
+                        "PTRACE_GETEVENTMSG");
+  pid_t new_child = static_cast<pid_t>(msg);
+
+  // threads share the memory of their parent, other children have their own
+  std::shared_ptr<mem_file> mem = ts.mem;
+  if (!is_clone_event(wait_status)) {
+    mem = std::make_shared<mem_file>(new_child);
+    if (mem->get() == -1)
+      return get_syserror(errno, tracer_errcode::SYSTEM_ERROR, w.tid,
+                          "open tracee memory");
+  }
+  bool stopped = w.unannounced.erase(new_child) > 0;
+  bool detaching = _detaching;
+
+  // the new child is auto-attached to this worker; hand it over to the worker
+  // with the fewest tracees, if it is another one and tracing is not being
+  // stopped
+  worker *target = &w;
+  {
+    std::scoped_lock lock(_mx);
+    for (const auto &other : _workers)
+      if (!detaching && other->load < target->load)
+        target = other.get();
+    target->load++;
+    if (target == &w)
+      _attached++;
+    else
+      _released++;
+  }
+
+  if (target == &w) {
+    tracee_state &child = w.tracees[new_child];
+    child.mem = std::move(mem);
+    child.starting = true;
+    // its initial stop must be waited for before detaching from it
+    child.stopped = stopped || !detaching;
+    log::logline(log::info, "[%d] new child created with tid=%d", w.tid,
+                 new_child);
+    if (stopped)
+      if (auto error = dispatch(w, new_child, initial_stop))
+        return error;
+  } else {
+    auto released = release_tracee(w.tid, new_child, stopped);
+    if (!released)
+      return std::move(released).error();
+    std::scoped_lock lock(_mx);
+    target->released.emplace_back(std::move(*released), std::move(mem));
+    ring(*target);
+    _cv.notify_all();
+    log::logline(log::info,
+                 "[%d] new child created with tid=%d, handed to worker %zu",
+                 w.tid, new_child, target->index);
+  }
+  if (detaching)
+    return tracer_error::success();
+  return resume(ts, parent, 0);
+}
+
+tracer_error event_tracer::handle_exit(worker &w, pid_t tid, int wait_status) {
+  if (WIFEXITED(wait_status))
+    log::logline(log::success, "[%d] tracee %d exited with status %d", w.tid,
+                 tid, WEXITSTATUS(wait_status));
+  else
+    log::logline(log::success, "[%d] tracee %d signaled: %s", w.tid, tid,
+                 sig_str(WTERMSIG(wait_status)));
+
+  auto it = w.tracees.find(tid);
+  assert(it != w.tracees.end());
+  bool in_section = it->second.strap != nullptr;
+  if (in_section) {
+    it->second.promise();
+    leave_section(w, tid);
+  }
+  w.tracees.erase(it);
+
+  bool last = false;
+  {
+    std::scoped_lock lock(_mx);
+    _attached--;
+    w.load--;
+    last = !_attached && !_released;
+  }
+  if (in_section) {
+    log::logline(log::error, "[%d] tracee %d exited mid-section", w.tid, tid);
+    return {tracer_errcode::UNKNOWN_ERROR, "Tracee exited mid-section"};
+  }
+  if (last)
+    finish(tracer_error::success());
+  return tracer_error::success();
+}
+
+tracer_expected<bool> event_tracer::await_exclusive(worker &w, pid_t tid,
+                                                    int wait_status) {
+  std::unique_lock lock(_mx);
+  if (!_exclusive || _exclusive == tid)
+    return true;
+  if (w.sections) {
+    // the non-concurrent section is being executed by a tracee of this worker
+    w.deferred.emplace_back(tid, wait_status);
+    log::logline(log::info, "[%d] stopped tracee with tid=%d", w.tid, tid);
+    return false;
+  }
+  // no tracee of this worker can be executing a section, so none of them
+  // depend on this worker handling their stops in the meantime
+  log::logline(log::info, "[%d] stopped tracee with tid=%d", w.tid, tid);
+  if (auto error = wait_barrier(w, lock, [this] { return !_exclusive; }))
+    return tracer_expected<bool>::unexpected_type{std::move(error)};
+  return true;
+}
+
+template <typename Predicate>
+tracer_error event_tracer::wait_barrier(worker &w,
+                                        std::unique_lock<std::mutex> &lock,
+                                        Predicate pred) {
+  // the worker does not wait for its tracees while blocked, so it must still
+  // interrupt them when another worker starts a non-concurrent section
+  while (!pred() && !_done) {
+    if (std::exchange(w.interrupt, false)) {
+      lock.unlock();
+      tracer_error error = interrupt_tracees(w, 0);
+      _group_stop.requested();
+      lock.lock();
+      if (error)
+        return error;
+      continue;
+    }
+    _cv.wait(lock);
+  }
+  return tracer_error::success();
+}
+
+void event_tracer::leave_section(worker &w, pid_t tid) {
+  {
+    std::scoped_lock lock(_mx);
+    if (_exclusive == tid)
+      _exclusive = 0;
+    else
+      _concurrent--;
+  }
+  _cv.notify_all();
+  w.sections--;
+  log::logline(log::debug, "[%d] exited tracer barrier", w.tid);
+}
+
+tracer_error event_tracer::hold_for_detach(worker &w, pid_t tid,
+                                           tracee_state &ts,
+                                           int wait_status) {
+  if (is_child_event(wait_status))
+    return handle_new_tracee(w, tid, ts, wait_status);
+  if (ts.starting) {
+    ts.starting = false;
+  } else if (is_breakpoint_trap(wait_status) && !ptrace_event(wait_status)) {
+    // as when tracing, every trap is assumed to be one of the profiler, so the
+    // trapped instruction is executed once the traps are removed
+    cpu_gp_regs regs(tid);
+    if (auto error = regs.getregs())
+      return error;
+    regs.rewind_trap();
+    if (auto error = regs.setregs())
+      return error;
+  } else if (WIFSTOPPED(wait_status) && !ptrace_event(wait_status)) {
+    ts.detach_signal = WSTOPSIG(wait_status);
+  }
+  log::logline(log::debug, "[%d] holding tracee %d until detached", w.tid, tid);
+  return tracer_error::success();
+}
+
+tracer_error event_tracer::detach(worker &w) {
+  {
+    // sections which started before tracing was stopped are left to end
+    std::unique_lock lock(_mx);
+    if (auto error = wait_barrier(w, lock, [this] {
+          return !_exclusive && !_concurrent;
+        }))
+      return error;
+  }
+
+  // stop every tracee of this worker, including those created in the meantime
+  for (auto &[tid, ts] : w.tracees)
+    if (!ts.stopped)
+      if (auto error = interrupt_tracee(w.tid, tid))
+        return error;
+  log::logline(log::info, "[%d] stopping %zu tracees to detach from them",
+               w.tid, w.tracees.size());
+  auto all_stopped = [&w] {
+    return std::all_of(w.tracees.begin(), w.tracees.end(),
+                       [](const auto &t) { return t.second.stopped; });
+  };
+  while (!_done && !all_stopped()) {
+    if (w.rung.exchange(false)) {
+      if (auto error = adopt_released(w))
+        return error;
+      continue;
+    }
+    int wait_status;
+    auto waited = wait_event(w, wait_status);
+    if (!waited)
+      return std::move(waited).error();
+    if (*waited)
+      if (auto error = dispatch(w, *waited, wait_status))
+        return error;
+  }
+
+  // the traps can only be removed once no tracee can reach them, and no tracee
+  // can be detached from while they remain
+  std::unique_lock lock(_mx);
+  _detach_ready++;
+  while (!_done && !_traps_removed) {
+    if (!w.released.empty()) {
+      lock.unlock();
+      if (auto error = adopt_released(w))
+        return error;
+      lock.lock();
+      continue;
+    }
+    if (_detach_ready == _workers.size() && !_released) {
+      if (auto error = remove_traps())
+        return error;
+      _traps_removed = true;
+      _cv.notify_all();
+      break;
+    }
+    _cv.wait(lock);
+  }
+  log::logline(log::info, "[%d] detaching from %zu tracees", w.tid,
+               w.tracees.size());
+  return tracer_error::success();
+}
+
+tracer_error event_tracer::remove_traps() const {
+  pid_t tid = gettid();
+  mem_file mem(_tracee_tgid);
+  if (mem.get() == -1)
+    return get_syserror(errno, tracer_errcode::SYSTEM_ERROR, tid,
+                        "open tracee memory");
+  // the scratch area of displaced instructions, if any, is left mapped
+  std::vector<uintptr_t> addrs = _traps.addresses();
+  std::vector<long> words = _traps.origwords(addrs);
+  for (size_t ix = 0; ix < addrs.size(); ix++)
+    if (auto error = write_trap_bytes(mem, addrs[ix], words[ix]))
+      return error;
+  log::logline(log::success, "[%d] removed %zu traps from process %d", tid,
+               addrs.size(), _tracee_tgid);
+  return tracer_error::success();
+}
+
+tracer_error event_tracer::stop_tracees(worker &w, pid_t excl) {
+  // only the worker attached to a tracee can interrupt it, so every other
+  // worker is asked to interrupt its own tracees
+  _group_stop.start();
+  {
+    std::scoped_lock lock(_mx);
+    for (const auto &other : _workers) {
+      if (other.get() == &w)
+        continue;
+      _group_stop.requesting();
+      other->interrupt = true;
+      ring(*other);
+    }
+  }
+  _cv.notify_all();
+  if (auto error = interrupt_tracees(w, excl))
+    return error;
+  // the section must not start before all other tracees were interrupted,
+  // since they could otherwise run past its trap while it is stepped over
+  // a worker which failed never fulfills its request, so whether tracing
+  // stopped is checked between shorter waits
+  auto deadline = std::chrono::steady_clock::now() + group_stop::timeout;
+  while (!_done && !_group_stop.await_requests(std::chrono::milliseconds(10)))
+    if (std::chrono::steady_clock::now() >= deadline)
+      return tracer_error(tracer_errcode::UNKNOWN_ERROR,
+                          "Timed out interrupting the other tracees");
+  _group_stop.complete(w.tid);
+  return tracer_error::success();
+}
+
+tracer_error event_tracer::interrupt_tracees(worker &w, pid_t excl) {
+  // tracees already in a ptrace-stop are kept stopped by this worker
+  size_t count = 0;
+  for (const auto &[tid, ts] : w.tracees)
+    if (tid != excl && !ts.stopped)
+      count++;
+  _group_stop.interrupting(count);
+  for (auto &[tid, ts] : w.tracees) {
+    if (tid == excl || ts.stopped)
+      continue;
+    if (auto error = interrupt_tracee(w.tid, tid))
+      return error;
+    ts.interrupted = true;
+  }
+  log::logline(log::info, "[%d] interrupted %zu tracees", w.tid, count);
+  return tracer_error::success();
+}
+
+tracer_error event_tracer::start_section(worker &w, pid_t tid,
+                                         tracee_state &ts, int wait_status) {
+  cpu_gp_regs regs(tid);
+  if (auto err = regs.getregs())
+    return err;
+  regs.rewind_trap();
+  uintptr_t start = regs.get_ip();
+  log::logline(log::info,
+               "[%d] tracee %d reached breakpoint @ 0x%" PRIxPTR
+               " (0x%" PRIxPTR ")",
+               w.tid, tid, start, start - _ep);
+  trap_stepper stepper(tid, *ts.mem, _ep);
+  const start_trap *strap = _traps.find(start_addr{start});
+  if (!strap) {
+    auto stepped = stepper.step_over_return_trap(regs);
+    if (!stepped)
+      return std::move(stepped).error();
+    if (*stepped)
+      return resume(ts, tid, 0);
+    // the end of an execution which was not measured
+    stepped = stepper.step_over_end_trap(regs, _traps);
+    if (!stepped)
+      return std::move(stepped).error();
+    if (*stepped)
+      return resume(ts, tid, 0);
+    log::logline(log::error,
+                 "[%d] reached start trap which is not registered as "
+                 "a start trap @ 0x%" PRIxPTR " (offset = 0x%" PRIxPTR ")",
+                 w.tid, start, start - _ep);
+    return tracer_error(tracer_errcode::NO_TRAP, "No such trap registered");
+  }
+  log::logline(log::info, "[%d] reached starting trap located @ %s", w.tid,
+               to_string(strap->context()).c_str());
+
+  // executions which are not measured neither stop other tracees nor create a
+  // sampler
+  auto exec = std::exchange(ts.counted, false) ? start_trap::execution::measured
+                                               : strap->hit();
+  if (exec != start_trap::execution::measured) {
+    bool exhausted = exec == start_trap::execution::exhausted;
+    log::logline(log::debug, "[%d] execution not measured%s", w.tid,
+                 exhausted ? "; budget exhausted" : "");
+    // a trap which is also the end of another section is never removed
+    if (auto error = stepper.skip_execution(
+            regs, *strap, exhausted && !_traps.find(end_addr{start})))
+      return error;
+    return resume(ts, tid, 0);
+  }
+
+  auto entered = enter_section(w, tid, ts, *strap, wait_status);
+  if (!entered)
+    return std::move(entered).error();
+  if (!*entered) {
+    ts.counted = true;
+    return tracer_error::success();
+  }
+  ts.start = start;
+
+  if (strap->context().is_function_call()) {
+    auto res = stepper.handle_function_entry(regs, _traps.scratch());
+    if (!res)
+      return std::move(res).error();
+    ts.func_return = *std::move(res);
+  }
+  // the trap is re-armed as soon as it is stepped over, so that the executions
+  // of concurrent sections by other tracees are measured too
+  if (auto error = stepper.handle_breakpoint(regs, *strap, true))
+    return error;
+  ts.smp = strap->create_sampler();
+  ts.promise = ts.smp->run();
+  return resume(ts, tid, 0);
+}
+
+tracer_error event_tracer::handle_section_stop(worker &w, pid_t tid,
+                                               tracee_state &ts,
+                                               int wait_status) {
+  // children created mid-section, which remain traced if the target has
+  // sections bounded by system calls
+  if (is_child_event(wait_status))
+    return handle_new_tracee(w, tid, ts, wait_status);
+  // otherwise, this is either the exit of the tracee, a group-stop or an
+  // interrupt which predates the section
+  if (is_interrupt_stop(wait_status)) {
+    log::logline(log::warning,
+                 "[%d] interrupt ignored mid-section for tracee %d", w.tid,
+                 tid);
+    return resume(ts, tid, 0);
+  }
+  if (ptrace_event(wait_status)) {
+    log::logline(log::debug, "[%d] tracee %d ptrace event %d mid-section",
+                 w.tid, tid, ptrace_event(wait_status));
+    return resume(ts, tid, 0);
+  }
+  cpu_gp_regs regs(tid);
+  if (auto error = regs.getregs())
+    return error;
+  if (ts.syscall && is_syscall_trap(wait_status))
+    return end_syscall_section(w, tid, ts, regs);
+  if (!is_breakpoint_trap(wait_status)) {
+    if (WIFSTOPPED(wait_status)) {
+      log::logline(log::warning,
+                   "[%d] received a signal mid-section: %s @ 0x%" PRIxPTR,
+                   w.tid, strsignal(WSTOPSIG(wait_status)), regs.get_ip());
+      return resume(ts, tid, WSTOPSIG(wait_status));
+    }
+    log::logline(log::error,
+                 "[%d] tracee %d with unknown ptrace-stop status "
+                 "mid-section @ 0x%" PRIxPTR,
+                 w.tid, tid, regs.get_ip());
+    return {tracer_errcode::UNKNOWN_ERROR,
+            "Tracee received unknown ptrace-stop status mid-section"};
+  }
+
+  log::logline(log::info,
+               "[%d] tracee %d reached breakpoint @ 0x%" PRIxPTR
+               " (0x%" PRIxPTR ")",
+               w.tid, tid, regs.get_ip(), regs.get_ip() - _ep);
+  regs.rewind_trap();
+  trap_stepper stepper(tid, *ts.mem, _ep);
+  // a recursive invocation reaches the start trap, which is re-armed once the
+  // section starts, so step over it
+  if (regs.get_ip() == ts.start) {
+    log::logline(log::info, "[%d] reached starting trap mid-section", w.tid);
+    if (auto error = stepper.handle_breakpoint(regs, *ts.strap, true))
+      return error;
+    return resume(ts, tid, 0);
+  }
+  // the return trap of a section of another tracee, which the tracee is not
+  // the target of, or of a deeper recursive invocation
+  bool own_end = ts.func_return
+                     ? ts.func_return->returned(regs)
+                     : _traps.find(end_addr{regs.get_ip()},
+                                   start_addr{ts.start}) != nullptr;
+  if (!own_end) {
+    auto stepped = stepper.step_over_return_trap(regs);
+    if (!stepped)
+      return std::move(stepped).error();
+    if (*stepped)
+      return resume(ts, tid, 0);
+    stepped = stepper.step_over_end_trap(regs, _traps);
+    if (!stepped)
+      return std::move(stepped).error();
+    if (*stepped)
+      return resume(ts, tid, 0);
+  }
+  return end_section(w, tid, ts, regs);
+}
+
+tracer_error event_tracer::end_section(worker &w, pid_t tid, tracee_state &ts,
+                                       cpu_gp_regs &regs) {
+  auto sampling_results = ts.promise();
+  trap_stepper stepper(tid, *ts.mem, _ep);
+
+  const trap_context *end_ctx = nullptr;
+  if (ts.func_return) {
+    const trap_context &ctx = ts.func_return->context;
+    if (regs.get_ip() != ctx.addr()) {
+      log::logline(log::error,
+                   "[%d] reached trap @ 0x%" PRIxPTR " (0x%" PRIxPTR
+                   ") which is not %s's return @ 0x%" PRIxPTR,
+                   w.tid, regs.get_ip(), regs.get_ip() - _ep,
+                   to_string(ts.strap->context()).c_str(), ctx.addr());
+      return tracer_error(tracer_errcode::NO_TRAP, "Not a return trap reached");
+    }
+    if (auto error = stepper.handle_function_return(regs, ctx.addr()))
+      return error;
+    end_ctx = &ctx;
+  } else {
+    end_addr end_bp_addr = regs.get_ip();
+    const end_trap *etrap = _traps.find(end_bp_addr, start_addr{ts.start});
+    if (!etrap) {
+      log::logline(log::error,
+                   "[%d] reached end trap @ 0x%" PRIxPTR
+                   " (offset = 0x%" PRIxPTR
+                   ") which does not exist or is not registered as "
+                   "an end trap for starting trap @ 0x%" PRIxPTR
+                   " (offset = 0x%" PRIxPTR ")",
+                   w.tid, end_bp_addr.val(), end_bp_addr.val() - _ep, ts.start,
+                   ts.start - _ep);
+      return tracer_error(tracer_errcode::NO_TRAP, "No such trap registered");
+    }
+    log::logline(log::info, "[%d] reached ending trap located @ %s", w.tid,
+                 to_string(etrap->context()).c_str());
+    if (auto error = stepper.handle_breakpoint(regs, *etrap, true))
+      return error;
+    end_ctx = &etrap->context();
+  }
+  ts.strap->finish();
+  if (auto err =
+          ts.strap->exhausted() && !_traps.find(end_addr{ts.start})
+              ? stepper.remove_trap(*ts.strap, ts.start)
+              : stepper.reset_trap(*ts.strap, ts.start))
+    return err;
+
+  // if sampling thread generated an error, register execution as a failed
+  // one in the gathered results collection
+  if (!sampling_results)
+    log::logline(log::error, "[%d] sampling thread exited with error", w.tid);
+  else
+    log::logline(log::success,
+                 "[%d] sampling thread exited successfully with %zu samples",
+                 w.tid, sampling_results->size());
+  return close_section(w, tid, ts,
+                       results_entry{ts.strap->context(), *end_ctx,
+                                     std::move(sampling_results)});
+}
+
+tracer_error event_tracer::start_syscall_section(worker &w, pid_t tid,
+                                                 tracee_state &ts,
+                                                 int wait_status) {
+  // the message is the data of the filter rule which stopped the tracee, which
+  // is the index of the section
+  int errnum;
+  unsigned long index;
+  if (ptrace_wrapper::instance.ptrace(errnum, PTRACE_GETEVENTMSG, tid, 0,
+                                      &index) == -1)
+    return get_syserror(errnum, tracer_errcode::PTRACE_ERROR, w.tid,
+                        "PTRACE_GETEVENTMSG");
+  const start_trap *strap = _traps.find_syscall(index);
+  if (!strap) {
+    log::logline(log::warning,
+                 "[%d] tracee %d stopped at system call of unknown section %lu",
+                 w.tid, tid, index);
+    return resume(ts, tid, 0);
+  }
+  cpu_gp_regs regs(tid);
+  if (auto err = regs.getregs())
+    return err;
+  log::logline(log::info, "[%d] tracee %d reached %s @ 0x%" PRIxPTR, w.tid,
+               tid, to_string(strap->context()).c_str(), regs.get_ip());
+  // system calls have no trap to step over, so executions which are not
+  // measured simply proceed
+  auto exec = std::exchange(ts.counted, false) ? start_trap::execution::measured
+                                               : strap->hit();
+  if (exec != start_trap::execution::measured) {
+    log::logline(log::debug, "[%d] execution not measured%s", w.tid,
+                 exec == start_trap::execution::exhausted
+                     ? "; budget exhausted"
+                     : "");
+    return resume(ts, tid, 0);
+  }
+  auto entered = enter_section(w, tid, ts, *strap, wait_status);
+  if (!entered)
+    return std::move(entered).error();
+  if (!*entered) {
+    ts.counted = true;
+    return tracer_error::success();
+  }
+  ts.syscall = index;
+  ts.syscall_number = regs.get_syscall_entry().number;
+  ts.smp = strap->create_sampler();
+  ts.promise = ts.smp->run();
+  return resume(ts, tid, 0);
+}
+
+tracer_error event_tracer::end_syscall_section(worker &w, pid_t tid,
+                                               tracee_state &ts,
+                                               cpu_gp_regs &regs) {
+  auto sampling_results = ts.promise();
+  ts.strap->finish();
+  trap_context end_ctx{system_call_return{{regs.get_ip(), nullptr},
+                                          ts.syscall_number,
+                                          regs.get_syscall_return()}};
+  log::logline(log::info, "[%d] tracee %d reached %s", w.tid, tid,
+               to_string(end_ctx).c_str());
+  if (!sampling_results)
+    log::logline(log::error, "[%d] sampling thread exited with error", w.tid);
+  else
+    log::logline(log::success,
+                 "[%d] sampling thread exited successfully with %zu samples",
+                 w.tid, sampling_results->size());
+  return close_section(w, tid, ts,
+                       results_entry{ts.strap->context(), std::move(end_ctx),
+                                     std::move(sampling_results), ts.syscall});
+}
+
+tracer_expected<bool> event_tracer::enter_section(worker &w, pid_t tid,
+                                                  tracee_state &ts,
+                                                  const start_trap &strap,
+                                                  int wait_status) {
+  using unexpected = tracer_expected<bool>::unexpected_type;
+  // concurrent sections only exclude non-concurrent ones, which keep all
+  // other tracees stopped for their whole duration
+  bool concurrent = strap.allow_concurrency();
+  {
+    std::unique_lock lock(_mx);
+    // no section starts once tracing is being stopped
+    auto admitted = [this, concurrent] {
+      return _detaching || (!_exclusive && (concurrent || !_concurrent));
+    };
+    if (!admitted()) {
+      // only wait if no section of this worker depends on it
+      if (w.sections) {
+        w.deferred.emplace_back(tid, wait_status);
+        log::logline(log::debug, "[%d] deferred section start of tracee %d",
+                     w.tid, tid);
+        return false;
+      }
+      if (auto error = wait_barrier(w, lock, admitted))
+        return unexpected{std::move(error)};
+      if (_done)
+        return false;
+    }
+    if (_detaching) {
+      lock.unlock();
+      if (auto error = hold_for_detach(w, tid, ts, wait_status))
+        return unexpected{std::move(error)};
+      return false;
+    }
+    if (concurrent)
+      _concurrent++;
+    else
+      _exclusive = tid;
+  }
+  w.sections++;
+  ts.strap = &strap;
+  log::logline(log::debug, "[%d] entered %s tracer barrier", w.tid,
+               concurrent ? "shared" : "exclusive");
+
+  // disable tracing of children during execution of section, unless they
+  // would then fail the system calls selected by the seccomp filter of the
+  // target
+  if (!_traps.has_syscalls()) {
+    if (auto error = set_child_tracing(tid, false))
+      return unexpected{std::move(error)};
+    log::logline(log::info, "[%d] child tracing disabled", w.tid);
+  }
+
+  if (!concurrent) {
+    log::logline(log::info, "[%d] concurrency not allowed; stopping tracees",
+                 w.tid);
+    if (auto error = stop_tracees(w, tid))
+      return unexpected{std::move(error)};
+  } else
+    log::logline(log::info, "[%d] concurrency allowed; not stopping tracees",
+                 w.tid);
+  return true;
+}
+
+tracer_error event_tracer::close_section(worker &w, pid_t tid,
+                                         tracee_state &ts,
+                                         results_entry &&entry) {
+  if (const results_consumer &consume = ts.strap->consumer())
+    consume(std::move(entry));
+  else
+    w.results.emplace_back(std::move(entry));
+
+  if (!_traps.has_syscalls()) {
+    if (auto error = set_child_tracing(tid, true))
+      return error;
+    log::logline(log::info, "[%d] child tracing re-enabled", w.tid);
+  }
+  ts.strap = nullptr;
+  ts.func_return.reset();
+  ts.syscall.reset();
+  ts.smp.reset();
+  ts.promise = nullptr;
+  leave_section(w, tid);
+  if (auto error = resume(ts, tid, 0))
+    return error;
+
+  // the stops deferred while the section executed can be handled now
+  auto deferred = std::move(w.deferred);
+  w.deferred.clear();
+  for (auto [dtid, dstatus] : deferred)
+    if (auto error = dispatch(w, dtid, dstatus))
+      return error;
+  return tracer_error::success();
+}
@@ -0,0 +1,133 @@
+// event_tracer.hpp
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <signal.h>
+
+#include "error.hpp"
+#include "group_stop.hpp"
+#include "tracer.hpp"
+
+#include <util/expectedfwd.hpp>
+
+namespace tep {
+
+class cpu_gp_regs;
+class registered_traps;
+class start_trap;
+
+// traces all threads of the tracee with a fixed pool of workers instead of one
+// thread per tracee; each worker waits for the stops of any of the tracees
+// attached to it and dispatches them to the state of the respective tracee,
+// so that the number of tracer threads does not grow with that of the tracee;
+// it can also trace the threads of a process which was already running, which
+// are detached from, instead of killed, once tracing is stopped by SIGINT or
+// SIGTERM
+class event_tracer {
+public:
+  using gathered_results = tracer::gathered_results;
+
+private:
+  struct tracee_state;
+  struct worker;
+
+  const registered_traps &_traps;
+  pid_t _tracee_tgid;
+  uintptr_t _ep;
+  // the seized threads of a running process, if the tracee was not launched
+  std::vector<pid_t> _seized;
+  std::vector<std::unique_ptr<worker>> _workers;
+  group_stop _group_stop;
+
+  // guards all members below and the handoffs and load of each worker
+  std::mutex _mx;
+  std::condition_variable _cv;
+  // the number of tracees attached to any worker
+  size_t _attached;
+  // tracees released by one worker and not yet adopted by another
+  size_t _released;
+  // the tracee executing a non-concurrent section, if any, and the number of
+  // tracees executing concurrent sections
+  pid_t _exclusive;
+  unsigned int _concurrent;
+  std::atomic<bool> _done;
+  tracer_error _error;
+  // whether tracing is being stopped to detach from the tracee, the number of
+  // workers whose tracees are all stopped to that end and whether the traps
+  // were removed, after which they can be detached from
+  std::atomic<bool> _detaching;
+  size_t _detach_ready;
+  bool _traps_removed;
+
+public:
+  event_tracer(const registered_traps &traps, pid_t tracee_pid, uintptr_t ep,
+               unsigned int workers, std::vector<pid_t> seized = {});
+  ~event_tracer();
+
+  // traces the tracee, which must be attached to the calling thread, until
+  // all of its threads have exited or, if it was seized while running, until
+  // it is detached from
+  tracer_expected<gathered_results> results();
+
+private:
+  tracer_error run_worker(worker &w);
+  tracer_error work(worker &w);
+  void finish(tracer_error error);
+  // a stop of a tracee, or 0 if the doorbell of the worker was rung instead
+  tracer_expected<pid_t> wait_event(worker &w, int &wait_status);
+  static void ring(worker &w);
+  static void ring_doorbell(const worker &w);
+  static void ring_all(int);
+  void await_detach_signal(const sigset_t &signals);
+  void request_detach();
+
+  tracer_error resume(tracee_state &ts, pid_t tid, int signal) const;
+  tracer_error set_child_tracing(pid_t tid, bool enable) const;
+  tracer_error dispatch(worker &w, pid_t tid, int wait_status);
+  tracer_error answer_doorbell(worker &w);
+  tracer_error adopt_released(worker &w);
+  tracer_error handle_new_tracee(worker &w, pid_t parent, tracee_state &ts,
+                                 int wait_status);
+  tracer_error handle_exit(worker &w, pid_t tid, int wait_status);
+  tracer_error start_section(worker &w, pid_t tid, tracee_state &ts,
+                             int wait_status);
+  tracer_error start_syscall_section(worker &w, pid_t tid, tracee_state &ts,
+                                     int wait_status);
+  tracer_error handle_section_stop(worker &w, pid_t tid, tracee_state &ts,
+                                   int wait_status);
+  tracer_error end_section(worker &w, pid_t tid, tracee_state &ts,
+                           cpu_gp_regs &regs);
+  tracer_error end_syscall_section(worker &w, pid_t tid, tracee_state &ts,
+                                   cpu_gp_regs &regs);
+
+  // whether the section was entered, which it is not if its start was
+  // deferred or if tracing is being stopped
+  tracer_expected<bool> enter_section(worker &w, pid_t tid, tracee_state &ts,
+                                      const start_trap &strap, int wait_status);
+  tracer_error close_section(worker &w, pid_t tid, tracee_state &ts,
+                             results_entry &&entry);
+
+  // whether the stop can be handled now, waiting for the non-concurrent
+  // section of another worker to end if needed
+  tracer_expected<bool> await_exclusive(worker &w, pid_t tid, int wait_status);
+  template <typename Predicate>
+  tracer_error wait_barrier(worker &w, std::unique_lock<std::mutex> &lock,
+                            Predicate pred);
+  void leave_section(worker &w, pid_t tid);
+  // keeps a tracee stopped until it is detached from
+  tracer_error hold_for_detach(worker &w, pid_t tid, tracee_state &ts,
+                               int wait_status);
+  tracer_error detach(worker &w);
+  tracer_error remove_traps() const;
+  // interrupts all tracees but <excl>, those of other workers through them
+  tracer_error stop_tracees(worker &w, pid_t excl);
+  tracer_error interrupt_tracees(worker &w, pid_t excl);
+};
+
+} // namespace tep
@@ -8,6 +8,45 @@ std::ostream &tep::operator<<(std::ostream &os, const flags &f) {
   os << "collect idle readings? " << (f.obtain_idle ? "yes" : "no") << ", ";
   os << "CPU sensor location mask: " << f.locations << ", ";
   os << "CPU socket mask: " << f.sockets << ", ";
-  os << "GPU device mask: " << f.devices;
+  os << "GPU device mask: " << f.devices << ", ";
+  os << "CPU counters read from: ";
+  switch (f.cpu_backend) {
+  case nrgprf::rapl_backend::powercap:
+    os << "powercap";
+    break;
+  case nrgprf::rapl_backend::msr:
+    os << "MSRs";
+    break;
+  case nrgprf::rapl_backend::perf:
+    os << "perf";
+    break;
+  }
+  os << ", ";
+  os << "displaced stepping? " << (f.displaced_stepping ? "yes" : "no")
+     << ", ";
+  os << "tracer threads: ";
+  if (f.tracer_threads)
+    os << f.tracer_threads;
+  else
+    os << "one per tracee";
+  os << ", sampling spin: " << f.sampling_spin.count() << " us";
+  os << ", sampling CPU: ";
+  if (f.sampling_cpu)
+    os << *f.sampling_cpu;
+  else
+    os << "any";
+  os << ", sampling SCHED_FIFO priority: ";
+  if (f.sampling_fifo)
+    os << *f.sampling_fifo;
+  else
+    os << "not real-time";
+  os << ", housekeeping CPUs: ";
+  if (f.housekeeping_cpus.empty())
+    os << "any";
+  for (auto it = f.housekeeping_cpus.begin(); it != f.housekeeping_cpus.end();
+       it++)
+    os << (it == f.housekeeping_cpus.begin() ? "" : ",") << *it;
+  os << ", sample clock: " << sample_clock::to_string(f.clock);
+  os << ", parallel hybrid reads? " << (f.parallel_hybrid ? "yes" : "no");
   return os;
 }
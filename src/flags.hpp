@@ -2,9 +2,14 @@
 
 #pragma once
 
+#include "sample_clock.hpp"
+
 #include <nrg/types.hpp>
 
+#include <chrono>
 #include <iosfwd>
+#include <optional>
+#include <vector>
 
 namespace tep {
 
@@ -13,6 +18,20 @@ struct flags {
   nrgprf::location_mask locations;
   nrgprf::socket_mask sockets;
   nrgprf::device_mask devices;
+  // how the CPU energy counters are read
+  nrgprf::rapl_backend cpu_backend;
+  bool displaced_stepping;
+  unsigned int tracer_threads;
+  std::chrono::microseconds sampling_spin;
+  std::optional<unsigned int> sampling_cpu;
+  // the SCHED_FIFO priority of the sampling thread, if real-time
+  std::optional<int> sampling_fifo;
+  // the CPUs the threads of the profiler run on, if restricted
+  std::vector<unsigned int> housekeeping_cpus;
+  // the source of the timestamps of the samples
+  sample_clock::source clock;
+  // whether the readers of sections of multiple targets are read concurrently
+  bool parallel_hybrid;
 };
 
 std::ostream &operator<<(std::ostream &os, const flags &f);
@@ -0,0 +1,88 @@
+// group_stop.cpp
+
+#include "group_stop.hpp"
+#include "log.hpp"
+
+#include <cerrno>
+#include <ctime>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace tep;
+
+group_stop::group_stop() noexcept
+    : _start(), _requests(0), _pending(0), _interrupted(0) {}
+
+void group_stop::start() noexcept {
+  _start = clock::now();
+  _interrupted.store(0, std::memory_order_relaxed);
+  _requests.store(0, std::memory_order_relaxed);
+  // held by the tracer which started the group-stop until complete()
+  _pending.store(1, std::memory_order_release);
+}
+
+void group_stop::requesting() noexcept {
+  _requests.fetch_add(1, std::memory_order_relaxed);
+}
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "the requests must be usable as a futex word");
+
+static uint32_t *futex_word(std::atomic<uint32_t> &word) noexcept {
+  return reinterpret_cast<uint32_t *>(&word);
+}
+
+void group_stop::requested() noexcept {
+  // the futex system call is async-signal-safe
+  if (_requests.fetch_sub(1, std::memory_order_release) == 1)
+    syscall(SYS_futex, futex_word(_requests), FUTEX_WAKE_PRIVATE, INT32_MAX,
+            nullptr, nullptr, 0);
+}
+
+bool group_stop::await_requests(std::chrono::milliseconds timeout) noexcept {
+  auto deadline = clock::now() + timeout;
+  uint32_t requests;
+  while ((requests = _requests.load(std::memory_order_acquire)) != 0) {
+    auto remaining = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        deadline - clock::now());
+    if (remaining.count() <= 0)
+      return false;
+    timespec ts{static_cast<time_t>(remaining.count() / 1000000000),
+                static_cast<long>(remaining.count() % 1000000000)};
+    // woken once the last request is fulfilled, or returns immediately if
+    // the count changed in the meantime
+    syscall(SYS_futex, futex_word(_requests), FUTEX_WAIT_PRIVATE, requests,
+            &ts, nullptr, 0);
+  }
+  return true;
+}
+
+void group_stop::interrupting(size_t count) noexcept {
+  _interrupted.fetch_add(count, std::memory_order_relaxed);
+  _pending.fetch_add(count, std::memory_order_relaxed);
+}
+
+void group_stop::complete(pid_t tid) noexcept { release(tid); }
+
+void group_stop::stopped(pid_t tid) noexcept { release(tid); }
+
+void group_stop::release(pid_t tid) noexcept {
+  // stops reported after the group-stop completed, e.g. those of tracees
+  // which were already stopping for another reason when interrupted, are not
+  // accounted for
+  size_t pending = _pending.load(std::memory_order_acquire);
+  do {
+    if (!pending)
+      return;
+  } while (!_pending.compare_exchange_weak(pending, pending - 1,
+                                           std::memory_order_acq_rel));
+  if (pending != 1)
+    return;
+  auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+      clock::now() - _start);
+  log::logline(log::debug, "[%d] group-stop of %zu tracees took %lld us", tid,
+               _interrupted.load(std::memory_order_relaxed),
+               static_cast<long long>(elapsed.count()));
+}
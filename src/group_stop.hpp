@@ -0,0 +1,57 @@
+// group_stop.hpp
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+#include <sys/types.h>
+
+namespace tep {
+
+// the stop of all other tracees while a non-concurrent section executes;
+// a tracee can only be interrupted by the thread attached to it, so the
+// tracer which starts the section requests the others to interrupt their
+// tracees and waits until they all have, and the latency from the start of
+// the section until every interrupted tracee has reported its stop is
+// reported in the debug log
+class group_stop {
+  using clock = std::chrono::steady_clock;
+
+  clock::time_point _start;
+  // a futex word, waited on until all requests were fulfilled
+  std::atomic<uint32_t> _requests;
+  std::atomic<size_t> _pending;
+  std::atomic<size_t> _interrupted;
+
+public:
+  // how long the requests can take to be fulfilled before the group-stop is
+  // considered to have failed; a request is fulfilled as soon as the thread
+  // it was sent to is scheduled, so this is only reached if that thread is
+  // stuck
+  static constexpr std::chrono::milliseconds timeout{1000};
+
+  group_stop() noexcept;
+
+  void start() noexcept;
+  // another thread is requested to interrupt its tracees
+  void requesting() noexcept;
+  // the request was fulfilled; async-signal-safe
+  void requested() noexcept;
+  // blocks until all requests were fulfilled, or until <timeout> elapsed, in
+  // which case false is returned
+  bool await_requests(std::chrono::milliseconds timeout) noexcept;
+  // <count> tracees are about to be interrupted
+  void interrupting(size_t count) noexcept;
+  // all requests were fulfilled
+  void complete(pid_t tid) noexcept;
+  // an interrupted tracee reported its stop
+  void stopped(pid_t tid) noexcept;
+
+private:
+  void release(pid_t tid) noexcept;
+};
+
+} // namespace tep
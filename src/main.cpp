@@ -7,7 +7,9 @@
 #include "error.hpp"
 #include "log.hpp"
 #include "profiler.hpp"
-#include "ptrace_wrapper.hpp"
+#include "sample_clock.hpp"
+#include "sampling_service.hpp"
+#include "seccomp.hpp"
 #include "target.hpp"
 
 #include <nonstd/expected.hpp>
@@ -15,6 +17,9 @@
 #include <cstring>
 #include <iostream>
 
+#include <fcntl.h>
+#include <unistd.h>
+
 static void handle_exception() {
   try {
     throw;
@@ -51,13 +56,73 @@ int main(int argc, char *argv[]) {
     if (args->debug_dump)
       args->debug_dump << dbg::debug_dump{oinfo};
 
-    auto callback = [](ptrace_wrapper::callback_args_t x) {
-      run_target(x.randomize, x.argv);
-    };
-    int errnum;
-    pid_t child_pid = ptrace_wrapper::instance.fork(
-        errnum, callback, {args->enable_randomization, args->argv});
-    if (child_pid > 0) {
+    if (!sample_clock::select(args->profiler_flags.clock)) {
+      std::cerr << "clock source "
+                << sample_clock::to_string(args->profiler_flags.clock)
+                << " is not available" << std::endl;
+      return 1;
+    }
+    sampling_service::instance.spin(args->profiler_flags.sampling_spin);
+    sampling_service::instance.pin(args->profiler_flags.sampling_cpu);
+    sampling_service::instance.priority(args->profiler_flags.sampling_fifo);
+
+    // the threads of the profiler, all created afterwards, are kept to the
+    // housekeeping CPUs, while the target runs on the CPUs it otherwise would
+    cpu_set_t target_cpus;
+    const cpu_set_t *restored = nullptr;
+    if (const auto &cpus = args->profiler_flags.housekeeping_cpus;
+        !cpus.empty()) {
+      if (restrict_to_cpus(cpus, target_cpus) == -1) {
+        std::cerr << "error restricting the profiler to its housekeeping CPUs"
+                  << std::endl;
+        return 1;
+      }
+      restored = &target_cpus;
+    }
+
+    // the filter can only be installed by the target itself before it starts
+    seccomp_filter filter(config);
+
+    // a running process is seized by the thread which later runs the tracers
+    if (args->pid) {
+      if (!filter.empty()) {
+        std::cerr << "sections bounded by system calls cannot be profiled in "
+                     "a running process"
+                  << std::endl;
+        return 1;
+      }
+      profiler prof(args->pid, args->profiler_flags, oinfo, config);
+      if (auto err = prof.attach()) {
+        std::cerr << err << std::endl;
+        return 1;
+      }
+      auto results = prof.run();
+      if (!results) {
+        std::cerr << results.error() << std::endl;
+        return 1;
+      }
+      (*args).output << *results;
+      return 0;
+    }
+
+    // the child only executes the target once it has been seized
+    int seized[2];
+    if (pipe2(seized, O_CLOEXEC) == -1) {
+      log::logline(log::error, "pipe2(): %s", strerror(errno));
+      return 1;
+    }
+    // the child is forked from the thread which later runs the root tracer,
+    // since that thread becomes the one attached to the tracee
+    pid_t child_pid = fork();
+    if (child_pid == 0) {
+      close(seized[1]);
+      run_target(args->enable_randomization, args->argv, seized[0], filter,
+                 restored);
+      _exit(1);
+    } else if (child_pid > 0) {
+      close(seized[0]);
+      if (seize_target(child_pid, seized[1]) == -1)
+        return 1;
       profiler prof(child_pid, args->profiler_flags, oinfo, config);
       if (!args->same_target()) {
         if (auto err = prof.await_executable(args->target)) {
@@ -74,8 +139,8 @@ int main(int argc, char *argv[]) {
 
       (*args).output << *results;
       return 0;
-    } else if (child_pid == -1)
-      log::logline(log::error, "fork(): %s", strerror(errnum));
+    } else
+      log::logline(log::error, "fork(): %s", strerror(errno));
     return 1;
   } catch (...) {
     handle_exception();
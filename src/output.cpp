@@ -8,8 +8,10 @@
 #include <nrg/reader_rapl.hpp>
 
 #include <cassert>
+#include <cmath>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 
 #include <nlohmann/json.hpp>
 
@@ -49,10 +51,59 @@ void gpu_format(nlohmann::json &j) {
   }
 }
 
+// relates the timestamps to the time of day, so that those of different
+// hosts can be aligned
+void clock_output(nlohmann::json &j) {
+  const tep::sample_clock::reference &ref = tep::sample_clock::start();
+  j["source"] = tep::sample_clock::to_string(tep::sample_clock::selected());
+  j["reference"]["timestamp"] = ref.timestamp.time_since_epoch().count();
+  j["reference"]["realtime"] =
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+          ref.realtime.time_since_epoch())
+          .count();
+}
+
 void format_output(nlohmann::json &j) {
   cpu_format(j["cpu"] = nlohmann::json::array());
   gpu_format(j["gpu"] = nlohmann::json::array());
 }
+
+constexpr double not_read = std::numeric_limits<double>::quiet_NaN();
+
+// the locations of each socket, in the order of their energy fields
+constexpr const char *rapl_locations[] = {"package", "cores", "uncore",
+                                          "dram",    "gpu",   "sys"};
+constexpr size_t num_rapl_locations = std::size(rapl_locations);
+
+#if defined NRG_X86_64
+double energy_between(const nrgprf::sensor_value &first,
+                      const nrgprf::sensor_value &last) {
+  using namespace nrgprf;
+  return unit_cast<joules<double>>(last).count() -
+         unit_cast<joules<double>>(first).count();
+}
+#elif defined NRG_PPC64
+// the sensors report power, which is assumed to change linearly in between
+double energy_between(const nrgprf::sensor_value &first,
+                      const nrgprf::sensor_value &last) {
+  using namespace nrgprf;
+  std::chrono::duration<double> elapsed = last.timestamp - first.timestamp;
+  return (unit_cast<watts<double>>(first.power).count() +
+          unit_cast<watts<double>>(last.power).count()) /
+         2 * elapsed.count();
+}
+#endif // defined NRG_X86_64
+
+template <typename Location>
+double rapl_energy(const nrgprf::reader_rapl &reader,
+                   const tep::timed_sample &first,
+                   const tep::timed_sample &last, uint8_t skt) {
+  auto vfirst = reader.value<Location>(first, skt);
+  auto vlast = reader.value<Location>(last, skt);
+  if (!vfirst || !vlast)
+    return not_read;
+  return energy_between(*vfirst, *vlast);
+}
 } // namespace
 
 namespace nlohmann {
@@ -64,6 +115,15 @@ template <> struct adl_serializer<tep::timed_sample> {
   }
 };
 
+// the samples are decoded one at a time
+template <> struct adl_serializer<tep::compact_execution> {
+  static void to_json(json &j, const tep::compact_execution &exec) {
+    j = json::array();
+    for (const auto &sample : exec)
+      j.push_back(sample);
+  }
+};
+
 template <> struct adl_serializer<std::optional<std::string>> {
   static void to_json(json &j, const std::optional<std::string> &x) {
     if (x)
@@ -113,6 +173,29 @@ static void to_json(nlohmann::json &j, const idle_output &io) {
   }
 }
 
+static void to_json(nlohmann::json &j, const running_stats &rs) {
+  j["count"] = rs.count();
+  j["total"] = rs.total();
+  j["min"] = rs.min();
+  j["max"] = rs.max();
+  j["mean"] = rs.mean();
+  j["p50"] = rs.quantile(0.5);
+  j["p90"] = rs.quantile(0.9);
+  j["p99"] = rs.quantile(0.99);
+}
+
+static void to_json(nlohmann::json &j, const skew_output &so) {
+  j["targets"] = so.targets;
+  for (const auto &rs : so.readers) {
+    nlohmann::json readers;
+    readers["count"] = rs.count;
+    readers["min"] = rs.min.count();
+    readers["max"] = rs.max.count();
+    readers["mean"] = rs.mean().count();
+    j["readers"].push_back(std::move(readers));
+  }
+}
+
 static void to_json(nlohmann::json &j, const section_output &so) {
   using json = nlohmann::json;
 
@@ -127,6 +210,15 @@ static void to_json(nlohmann::json &j, const section_output &so) {
     so.readings_out().output(exec, pe.exec);
     execs.push_back(std::move(exec.json));
   }
+  if (const auto &skipped = so.skipped())
+    j["skipped"] = *skipped;
+  if (const auto &agg = so.aggregate()) {
+    output_writer aggregate;
+    aggregate.json["executions"] = agg->executions();
+    aggregate.json["duration"] = agg->duration();
+    so.readings_out().aggregate_output(aggregate, agg->energy().data());
+    j["aggregate"] = std::move(aggregate.json);
+  }
 }
 
 static void to_json(nlohmann::json &j, const group_output &go) {
@@ -139,8 +231,15 @@ static void to_json(nlohmann::json &j, const group_output &go) {
 static void to_json(nlohmann::json &j, const profiling_results &pr) {
   units_output(j["units"]);
   format_output(j["format"]);
+  clock_output(j["clock"]);
   j["idle"] = pr.idle();
   j["groups"] = pr.groups();
+  if (const auto &sampling = pr.sampling()) {
+    j["sampling"]["lateness"] = sampling->lateness;
+    j["sampling"]["overruns"] = sampling->overruns;
+    for (const auto &so : sampling->skew)
+      j["sampling"]["skew"].push_back(so);
+  }
 }
 } // namespace tep
 
@@ -150,11 +249,35 @@ void readings_output_holder::push_back(
 }
 
 void readings_output_holder::output(output_writer &os,
-                                    const timed_execution &exec) const {
+                                    const compact_execution &exec) const {
   for (const auto &out : _outputs)
     out->output(os, exec);
 }
 
+size_t readings_output_holder::energy_fields() const noexcept {
+  size_t total = 0;
+  for (const auto &out : _outputs)
+    total += out->energy_fields();
+  return total;
+}
+
+void readings_output_holder::energy(const timed_sample &first,
+                                    const timed_sample &last,
+                                    double *into) const {
+  for (const auto &out : _outputs) {
+    out->energy(first, last, into);
+    into += out->energy_fields();
+  }
+}
+
+void readings_output_holder::aggregate_output(
+    output_writer &os, const running_stats *fields) const {
+  for (const auto &out : _outputs) {
+    out->aggregate_output(os, fields);
+    fields += out->energy_fields();
+  }
+}
+
 template class tep::readings_output_dev<nrgprf::reader_rapl>;
 
 template class tep::readings_output_dev<nrgprf::reader_gpu>;
@@ -165,7 +288,7 @@ readings_output_dev<Reader>::readings_output_dev(const Reader &r)
 
 template <>
 void readings_output_dev<nrgprf::reader_rapl>::output(
-    output_writer &os, const timed_execution &exec) const {
+    output_writer &os, const compact_execution &exec) const {
   assert(exec.size() > 1);
   using namespace nrgprf;
   using json = nlohmann::json;
@@ -210,7 +333,7 @@ void readings_output_dev<nrgprf::reader_rapl>::output(
 
 template <>
 void readings_output_dev<nrgprf::reader_gpu>::output(
-    output_writer &os, const timed_execution &exec) const {
+    output_writer &os, const compact_execution &exec) const {
   assert(exec.size() > 1);
   using namespace nrgprf;
   using json = nlohmann::json;
@@ -233,13 +356,100 @@ void readings_output_dev<nrgprf::reader_gpu>::output(
   }
 }
 
+template <>
+size_t
+readings_output_dev<nrgprf::reader_rapl>::energy_fields() const noexcept {
+  return nrgprf::max_sockets * num_rapl_locations;
+}
+
+template <>
+void readings_output_dev<nrgprf::reader_rapl>::energy(
+    const timed_sample &first, const timed_sample &last, double *into) const {
+  using namespace nrgprf;
+  for (uint32_t skt = 0; skt < nrgprf::max_sockets; skt++) {
+    double *fields = into + skt * num_rapl_locations;
+    fields[0] = rapl_energy<loc::pkg>(_reader, first, last, skt);
+    fields[1] = rapl_energy<loc::cores>(_reader, first, last, skt);
+    fields[2] = rapl_energy<loc::uncore>(_reader, first, last, skt);
+    fields[3] = rapl_energy<loc::mem>(_reader, first, last, skt);
+    fields[4] = rapl_energy<loc::gpu>(_reader, first, last, skt);
+    fields[5] = rapl_energy<loc::sys>(_reader, first, last, skt);
+  }
+}
+
+template <>
+void readings_output_dev<nrgprf::reader_rapl>::aggregate_output(
+    output_writer &os, const running_stats *fields) const {
+  using json = nlohmann::json;
+  os.json["cpu"] = json::array();
+  for (uint32_t skt = 0; skt < nrgprf::max_sockets; skt++) {
+    json readings;
+    for (size_t ix = 0; ix < num_rapl_locations; ix++)
+      if (const running_stats &rs = fields[skt * num_rapl_locations + ix];
+          rs.count())
+        readings[rapl_locations[ix]] = rs;
+    if (!readings.empty()) {
+      readings["socket"] = skt;
+      os.json["cpu"].push_back(std::move(readings));
+    }
+  }
+}
+
+template <>
+size_t
+readings_output_dev<nrgprf::reader_gpu>::energy_fields() const noexcept {
+  return nrgprf::max_devices;
+}
+
+template <>
+void readings_output_dev<nrgprf::reader_gpu>::energy(const timed_sample &first,
+                                                     const timed_sample &last,
+                                                     double *into) const {
+  using namespace nrgprf;
+  for (uint32_t dev = 0; dev < nrgprf::max_devices; dev++) {
+    result<units_energy> efirst = _reader.get_board_energy(first, dev);
+    result<units_energy> elast = _reader.get_board_energy(last, dev);
+    if (efirst && elast) {
+      into[dev] = unit_cast<joules<double>>(*elast).count() -
+                  unit_cast<joules<double>>(*efirst).count();
+      continue;
+    }
+    // the power is assumed to change linearly between the samples
+    result<units_power> pfirst = _reader.get_board_power(first, dev);
+    result<units_power> plast = _reader.get_board_power(last, dev);
+    if (pfirst && plast) {
+      std::chrono::duration<double> elapsed = last - first;
+      into[dev] = (unit_cast<watts<double>>(*pfirst).count() +
+                   unit_cast<watts<double>>(*plast).count()) /
+                  2 * elapsed.count();
+      continue;
+    }
+    into[dev] = not_read;
+  }
+}
+
+template <>
+void readings_output_dev<nrgprf::reader_gpu>::aggregate_output(
+    output_writer &os, const running_stats *fields) const {
+  using json = nlohmann::json;
+  os.json["gpu"] = json::array();
+  for (uint32_t dev = 0; dev < nrgprf::max_devices; dev++) {
+    if (!fields[dev].count())
+      continue;
+    json readings;
+    readings["device"] = dev;
+    readings["board"] = fields[dev];
+    os.json["gpu"].push_back(std::move(readings));
+  }
+}
+
 idle_output::idle_output(std::unique_ptr<readings_output> &&rout,
-                         timed_execution &&exec)
+                         compact_execution &&exec)
     : _rout(std::move(rout)), _exec(std::move(exec)) {}
 
-timed_execution &idle_output::exec() { return _exec; }
+compact_execution &idle_output::exec() { return _exec; }
 
-const timed_execution &idle_output::exec() const { return _exec; }
+const compact_execution &idle_output::exec() const { return _exec; }
 
 const readings_output &idle_output::readings_out() const {
   assert(_rout);
@@ -248,15 +458,24 @@ const readings_output &idle_output::readings_out() const {
 
 section_output::section_output(std::unique_ptr<readings_output> rout,
                                std::optional<std::string_view> label,
-                               std::optional<std::string_view> extra)
+                               std::optional<std::string_view> extra,
+                               bool aggregate, bool budgeted)
     : _rout(std::move(rout)),
       _label(label ? std::optional<std::string>(*label) : std::nullopt),
-      _extra(extra ? std::optional<std::string>(*extra) : std::nullopt) {}
+      _extra(extra ? std::optional<std::string>(*extra) : std::nullopt),
+      _skipped(budgeted ? std::optional<uint64_t>(0) : std::nullopt),
+      _aggregate(aggregate ? std::make_shared<section_aggregate>(*_rout)
+                           : nullptr) {}
 
 position_exec &section_output::push_back(position_exec &&pe) {
   return _executions.emplace_back(std::move(pe));
 }
 
+void section_output::add_skipped(uint64_t skipped) {
+  assert(_skipped);
+  *_skipped += skipped;
+}
+
 const readings_output &section_output::readings_out() const {
   assert(_rout);
   return *_rout;
@@ -274,6 +493,14 @@ const std::vector<position_exec> &section_output::executions() const {
   return _executions;
 }
 
+const std::optional<uint64_t> &section_output::skipped() const {
+  return _skipped;
+}
+
+const std::shared_ptr<section_aggregate> &section_output::aggregate() const {
+  return _aggregate;
+}
+
 group_output::group_output(std::optional<std::string_view> label,
                            std::optional<std::string_view> extra)
     : _label(label ? std::optional<std::string>(*label) : std::nullopt),
@@ -299,6 +526,14 @@ const std::vector<idle_output> &profiling_results::idle() const {
   return _idle;
 }
 
+std::optional<sampling_output> &profiling_results::sampling() {
+  return _sampling;
+}
+
+const std::optional<sampling_output> &profiling_results::sampling() const {
+  return _sampling;
+}
+
 profiling_results::container &profiling_results::groups() { return _results; }
 
 const profiling_results::container &profiling_results::groups() const {
@@ -2,22 +2,36 @@
 
 #pragma once
 
+#include "aggregate.hpp"
+#include "compact_execution.hpp"
 #include "output/fwd.hpp"
-#include "timed_sample.hpp"
 #include "trap_context.hpp"
 
+#include <nrg/parallel_hybrid_reader.hpp>
+
+#include <memory>
 #include <optional>
 
 namespace tep {
 struct position_exec {
   std::pair<trap_context, trap_context> interval;
-  timed_execution exec;
+  compact_execution exec;
 };
 
 class readings_output {
 public:
   virtual ~readings_output() = default;
-  virtual void output(output_writer &os, const timed_execution &exec) const = 0;
+  virtual void output(output_writer &os,
+                      const compact_execution &exec) const = 0;
+
+  // the readings whose energy is aggregated, e.g. each location of each socket
+  virtual size_t energy_fields() const noexcept = 0;
+  // the energy, in joules, consumed between two samples by each field, or NaN
+  // if the field is not read
+  virtual void energy(const timed_sample &first, const timed_sample &last,
+                      double *into) const = 0;
+  virtual void aggregate_output(output_writer &os,
+                                const running_stats *fields) const = 0;
 };
 
 class readings_output_holder final : public readings_output {
@@ -27,7 +41,13 @@ private:
 public:
   readings_output_holder() = default;
   void push_back(std::unique_ptr<readings_output> &&outputs);
-  void output(output_writer &os, const timed_execution &exec) const override;
+  void output(output_writer &os, const compact_execution &exec) const override;
+
+  size_t energy_fields() const noexcept override;
+  void energy(const timed_sample &first, const timed_sample &last,
+              double *into) const override;
+  void aggregate_output(output_writer &os,
+                        const running_stats *fields) const override;
 };
 
 template <typename Reader> class readings_output_dev : public readings_output {
@@ -37,19 +57,26 @@ private:
 public:
   readings_output_dev(const Reader &reader);
 
-  void output(output_writer &os, const timed_execution &exec) const override;
+  void output(output_writer &os, const compact_execution &exec) const override;
+
+  size_t energy_fields() const noexcept override;
+  void energy(const timed_sample &first, const timed_sample &last,
+              double *into) const override;
+  void aggregate_output(output_writer &os,
+                        const running_stats *fields) const override;
 };
 
 class idle_output {
 private:
   std::unique_ptr<readings_output> _rout;
-  timed_execution _exec;
+  compact_execution _exec;
 
 public:
-  idle_output(std::unique_ptr<readings_output> &&rout, timed_execution &&exec);
+  idle_output(std::unique_ptr<readings_output> &&rout,
+              compact_execution &&exec);
 
-  timed_execution &exec();
-  const timed_execution &exec() const;
+  compact_execution &exec();
+  const compact_execution &exec() const;
   const readings_output &readings_out() const;
 };
 
@@ -59,18 +86,27 @@ private:
   std::optional<std::string> _label;
   std::optional<std::string> _extra;
   std::vector<position_exec> _executions;
+  // executions which were not measured while the trap of the section was
+  // armed, if the section has a budget
+  std::optional<uint64_t> _skipped;
+  // the executions folded into the aggregate, instead of being kept, if any
+  std::shared_ptr<section_aggregate> _aggregate;
 
 public:
   section_output(std::unique_ptr<readings_output> rout,
                  std::optional<std::string_view> label,
-                 std::optional<std::string_view> extra);
+                 std::optional<std::string_view> extra,
+                 bool aggregate = false, bool budgeted = false);
 
   position_exec &push_back(position_exec &&pe);
+  void add_skipped(uint64_t skipped);
 
   const readings_output &readings_out() const;
   const std::optional<std::string> &label() const;
   const std::optional<std::string> &extra() const;
   const std::vector<position_exec> &executions() const;
+  const std::optional<uint64_t> &skipped() const;
+  const std::shared_ptr<section_aggregate> &aggregate() const;
 };
 
 class group_output {
@@ -95,6 +131,22 @@ public:
   const container &sections() const;
 };
 
+// how far apart the readers of a hybrid reader read in parallel were read
+struct skew_output {
+  std::string targets;
+  // by target, relative to the first
+  std::vector<nrgprf::reader_skew> readers;
+};
+
+// how late the periodic samples were taken after their deadlines
+struct sampling_output {
+  // in nanoseconds
+  running_stats lateness;
+  // samples which were not taken because the previous ones were too late
+  uint64_t overruns;
+  std::vector<skew_output> skew;
+};
+
 class profiling_results {
 public:
   using container = std::vector<group_output>;
@@ -102,6 +154,7 @@ public:
 private:
   std::vector<idle_output> _idle;
   container _results;
+  std::optional<sampling_output> _sampling;
 
 public:
   profiling_results() = default;
@@ -109,6 +162,9 @@ public:
   std::vector<idle_output> &idle();
   const std::vector<idle_output> &idle() const;
 
+  std::optional<sampling_output> &sampling();
+  const std::optional<sampling_output> &sampling() const;
+
   container &groups();
   const container &groups() const;
 };
@@ -1,7 +1,9 @@
 // profiler.cpp
 #include "profiler.hpp"
 #include "dbg/utility_funcs.hpp"
+#include "displaced_step.hpp"
 #include "error.hpp"
+#include "event_tracer.hpp"
 #include "log.hpp"
 #include "ptrace_misc.hpp"
 #include "ptrace_wrapper.hpp"
@@ -23,6 +25,8 @@
 #include <algorithm>
 #include <cassert>
 #include <sstream>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 
 using namespace tep;
@@ -54,6 +58,17 @@ template <typename T> std::string to_string(const T &obj) {
   return ss.str();
 }
 
+// the updates of the sensors of each reader are only detected once
+const std::optional<sensor_updates> &updates_of(const nrgprf::reader *reader) {
+  static std::unordered_map<const nrgprf::reader *,
+                            std::optional<sensor_updates>>
+      detected;
+  auto [it, inserted] = detected.try_emplace(reader);
+  if (inserted)
+    it->second = detect_sensor_updates(reader);
+  return it->second;
+}
+
 // instantiates a polymorphic sampler_creator from config section information
 sampler_creator creator_from_section(const reader_container &readers,
                                      const cfg::section_t &section) {
@@ -71,15 +86,21 @@ sampler_creator creator_from_section(const reader_container &readers,
   } else if (misc.holds<cfg::method_profile_t>()) {
     const auto &attr = misc.get<cfg::method_profile_t>();
     const auto &interval = attr.interval;
+    size_t max_samples = attr.max_samples.value_or(0);
+    std::optional<sensor_updates> updates;
+    if (attr.phase_lock)
+      updates = updates_of(reader);
     if (attr.samples) {
       auto samples = *attr.samples;
-      return [reader, samples, interval]() {
-        return std::make_unique<unbounded_ps>(reader, samples, interval);
+      return [reader, samples, interval, max_samples, updates]() {
+        return std::make_unique<unbounded_ps>(reader, samples, interval,
+                                              max_samples, updates);
       };
     } else {
-      return [reader, interval]() {
+      return [reader, interval, max_samples, updates]() {
         return std::make_unique<unbounded_ps>(
-            reader, unbounded_ps::default_initial_size, interval);
+            reader, unbounded_ps::default_initial_size, interval, max_samples,
+            updates);
       };
     }
   } else {
@@ -88,6 +109,39 @@ sampler_creator creator_from_section(const reader_container &readers,
   }
 }
 
+// the executions of a section which are measured
+execution_budget budget_from_section(const cfg::section_t &section) {
+  return execution_budget{section.every, section.max_executions.value_or(0)};
+}
+
+// whether only some of the executions of a section are measured
+bool budgeted_section(const cfg::section_t &section) {
+  return section.every > 1 || section.max_executions;
+}
+
+// whether the executions of a section are folded into its aggregate
+bool aggregate_section(const cfg::section_t &section) {
+  return section.misc.holds<cfg::method_total_t>() &&
+         section.misc.get<cfg::method_total_t>().aggregate;
+}
+
+// folds each execution of a section into its aggregate as it completes
+results_consumer consumer_from_output(const section_output &sec_out) {
+  std::shared_ptr<section_aggregate> aggregate = sec_out.aggregate();
+  if (!aggregate)
+    return nullptr;
+  return [aggregate](results_entry &&entry) {
+    if (!entry.values)
+      log::logline(log::error,
+                   "[%d] failed to gather results for section %s - %s: %s",
+                   gettid(), to_string(entry.start).c_str(),
+                   to_string(entry.end).c_str(),
+                   entry.values.error().message().c_str());
+    else
+      aggregate->add(*entry.values);
+  };
+}
+
 // instantiates a polymorphic results holder from config target information
 std::unique_ptr<readings_output>
 results_from_target(const reader_container &readers, cfg::target target) {
@@ -120,7 +174,7 @@ results_from_target(const reader_container &readers, cfg::target target) {
 }
 
 tracer_error sample_idle(const char *target, const nrgprf::reader *reader,
-                         timed_execution &into) {
+                         compact_execution &into) {
   assert(target);
   assert(reader);
   constexpr static const std::chrono::milliseconds default_sleep(5000);
@@ -146,8 +200,7 @@ tracer_error sample_idle(const char *target, const nrgprf::reader *reader,
     return {tracer_errcode::READER_ERROR, results.error().message()};
   }
   log::logline(log::success, "successfuly gathered %s idle readings", target);
-  into = std::move(*results);
-  into.shrink_to_fit();
+  into = compact_execution(*results);
   return tracer_error::success();
 }
 
@@ -176,6 +229,36 @@ bool profiler::output_mapping::insert(start_addr bounds,
                                       const reader_container &readers,
                                       const cfg::group_t &group,
                                       const cfg::section_t &sec) {
+  auto [it, inserted] =
+      map.insert({bounds, insert_section(readers, group, sec)});
+  return inserted;
+}
+
+void profiler::output_mapping::insert_syscall(const reader_container &readers,
+                                              const cfg::group_t &group,
+                                              const cfg::section_t &sec) {
+  syscalls.push_back(insert_section(readers, group, sec));
+}
+
+section_output *profiler::output_mapping::find(start_addr bounds) {
+  auto it = map.find(bounds);
+  assert(it != map.end());
+  if (it == map.end())
+    return nullptr;
+  return at(it->second);
+}
+
+section_output *profiler::output_mapping::find_syscall(size_t index) {
+  assert(index < syscalls.size());
+  if (index >= syscalls.size())
+    return nullptr;
+  return at(syscalls[index]);
+}
+
+profiler::output_mapping::distance_pair
+profiler::output_mapping::insert_section(const reader_container &readers,
+                                         const cfg::group_t &group,
+                                         const cfg::section_t &sec) {
   auto grp_it =
       find_or_insert_output(results.groups(), group.label, [&group]() {
         return group_output{group.label, group.extra};
@@ -184,26 +267,19 @@ bool profiler::output_mapping::insert(start_addr bounds,
   auto sec_it =
       find_or_insert_output(grp_it->sections(), sec.label, [&sec, &readers]() {
         return section_output{results_from_target(readers, sec.targets),
-                              sec.label, sec.extra};
+                              sec.label, sec.extra, aggregate_section(sec),
+                              budgeted_section(sec)};
       });
 
   auto grp_begin = results.groups().begin();
   auto sec_begin = grp_it->sections().begin();
-  distance_pair pair{std::distance(grp_begin, grp_it),
-                     std::distance(sec_begin, sec_it)};
-
-  auto [it, inserted] = map.insert({bounds, pair});
-  return inserted;
+  return distance_pair{std::distance(grp_begin, grp_it),
+                       std::distance(sec_begin, sec_it)};
 }
 
-section_output *profiler::output_mapping::find(start_addr bounds) {
-  auto it = map.find(bounds);
-  assert(it != map.end());
-  if (it == map.end())
-    return nullptr;
-
-  auto distance_group = it->second.first;
-  auto distance_sec = it->second.second;
+section_output *profiler::output_mapping::at(distance_pair pair) {
+  auto distance_group = pair.first;
+  auto distance_sec = pair.second;
 
   auto grp_it = results.groups().begin();
   assert(std::distance(grp_it, results.groups().end()) > distance_group);
@@ -218,7 +294,7 @@ section_output *profiler::output_mapping::find(start_addr bounds) {
 
 profiler::profiler(pid_t child, flags flags, dbg::object_info dli,
                    cfg::config_t cd)
-    : _tid(gettid()), _child(child), _flags(std::move(flags)),
+    : _tid(gettid()), _child(child), _seized(), _flags(std::move(flags)),
       _dli(std::move(dli)), _cd(std::move(cd)), _readers(_flags, _cd) {}
 
 const dbg::object_info &profiler::debug_line_info() const { return _dli; }
@@ -227,6 +303,15 @@ const cfg::config_t &profiler::config() const { return _cd; }
 
 const registered_traps &profiler::traps() const { return _traps; }
 
+tracer_error profiler::attach() {
+  // a process which was already running must outlive the profiler
+  auto seized = seize_process(_tid, _child, get_ptrace_opts(true, false));
+  if (!seized)
+    return std::move(seized).error();
+  _seized = std::move(*seized);
+  return tracer_error::success();
+}
+
 tracer_error profiler::await_executable(const std::string &name) const {
   auto system_error = [](pid_t tid, const char *comment, int errnum = errno) {
     return get_syserror(errnum, tracer_errcode::SYSTEM_ERROR, tid, comment);
@@ -246,23 +331,22 @@ tracer_error profiler::await_executable(const std::string &name) const {
   log::logline(log::info, "[%d] started the profiling procedure for child %d",
                _tid, _child);
   if (!WIFSTOPPED(wait_status)) {
-    log::logline(log::error,
-                 "[%d] ptrace(PTRACE_TRACEME, ...) "
-                 "called but target was not stopped",
-                 _tid);
+    log::logline(log::error, "[%d] target seized but was not stopped", _tid);
     return tracer_error(
         tracer_errcode::PTRACE_ERROR,
         "Tracee not stopped despite being attached with ptrace");
   }
 
+  // the execution of the target is reported to run() as a PTRACE_EVENT_EXEC
   if (int err; - 1 == ptrace_wrapper::instance.ptrace(
                           err, PTRACE_SETOPTIONS, _child, 0,
-                          PTRACE_O_TRACESYSGOOD | get_ptrace_exitkill())) {
+                          PTRACE_O_TRACEEXEC | PTRACE_O_TRACESYSGOOD |
+                              PTRACE_O_TRACESECCOMP | get_ptrace_exitkill())) {
     return get_syserror(err, tracer_errcode::PTRACE_ERROR, _tid,
                         "PTRACE_SETOPTIONS");
   }
 
-  for (bool entry = true, matched = false;;) {
+  for (bool entry = true;;) {
     if (int err; - 1 == ptrace_wrapper::instance.ptrace(err, PTRACE_SYSCALL,
                                                         _child, 0, 0)) {
       return get_syserror(err, tracer_errcode::PTRACE_ERROR, _tid,
@@ -274,8 +358,6 @@ tracer_error profiler::await_executable(const std::string &name) const {
 
     if (is_syscall_trap(wait_status)) {
       entry = !entry;
-      if (matched)
-        break;
       if (entry)
         continue;
       cpu_gp_regs regs(_child);
@@ -291,11 +373,13 @@ tracer_error profiler::await_executable(const std::string &name) const {
       if (!args)
         return std::move(args.error());
       if (*filename == name) {
-        matched = true;
         log::logline(log::success,
                      "[%d] found matching execve: "
                      "path=%s args=%s",
                      _tid, filename->c_str(), ::to_string(*args).c_str());
+        // continued from the system call entry, the next stop of the tracee
+        // is the PTRACE_EVENT_EXEC of the target, waited for by run()
+        break;
       } else
         log::logline(log::success,
                      "[%d] found execve: "
@@ -334,40 +418,46 @@ tracer_expected<profiling_results> profiler::run() {
     return rettype(nonstd::unexpect, std::move(err));
   };
 
-  int wait_status;
-  pid_t waited_pid = waitpid(_child, &wait_status, 0);
-  if (waited_pid == -1)
-    return system_error(_tid, "waitpid");
-  assert(waited_pid == _child);
-  if (WIFEXITED(wait_status)) {
-    log::logline(log::error, "[%d] failed to run target in child %d", _tid,
-                 waited_pid);
-    return rettype(nonstd::unexpect,
-                   tracer_errcode::SIGNAL_DURING_SECTION_ERROR,
-                   "Child failed to run target");
-  }
-  log::logline(log::info, "[%d] started the profiling procedure for child %d",
-               _tid, waited_pid);
-  if (!WIFSTOPPED(wait_status)) {
-    log::logline(log::error,
-                 "[%d] ptrace(PTRACE_TRACEME, ...) "
-                 "called but target was not stopped",
-                 _tid);
-    return rettype(nonstd::unexpect, tracer_errcode::PTRACE_ERROR,
-                   "Tracee not stopped despite being attached with ptrace");
+  // a seized process was already stopped by attach()
+  if (_seized.empty()) {
+    int wait_status;
+    pid_t waited_pid = waitpid(_child, &wait_status, 0);
+    if (waited_pid == -1)
+      return system_error(_tid, "waitpid");
+    assert(waited_pid == _child);
+    if (WIFEXITED(wait_status)) {
+      log::logline(log::error, "[%d] failed to run target in child %d", _tid,
+                   waited_pid);
+      return rettype(nonstd::unexpect,
+                     tracer_errcode::SIGNAL_DURING_SECTION_ERROR,
+                     "Child failed to run target");
+    }
+    log::logline(log::info, "[%d] started the profiling procedure for child %d",
+                 _tid, waited_pid);
+    if (!WIFSTOPPED(wait_status)) {
+      log::logline(log::error, "[%d] target seized but was not stopped", _tid);
+      return rettype(nonstd::unexpect, tracer_errcode::PTRACE_ERROR,
+                     "Tracee not stopped despite being attached with ptrace");
+    }
+    if (is_exec_event(wait_status))
+      if (tracer_error err = finish_exec(_tid, _child))
+        return move_error(err);
   }
 
   if (_flags.obtain_idle)
     if (tracer_error err = obtain_idle_results())
       return rettype(nonstd::unexpect, std::move(err));
-  cpu_gp_regs regs(waited_pid);
+  cpu_gp_regs regs(_child);
   if (tracer_error err = regs.getregs())
     return move_error(err);
   uintptr_t entrypoint;
   switch (_dli.header().type) {
   case dbg::executable_type::shared_object:
     log::logline(log::success, "[%d] target is a PIE", _tid);
-    if (get_entrypoint_addr(_child, entrypoint) == -1)
+    if (!_seized.empty()) {
+      if (get_load_address(_child, entrypoint) == -1)
+        return system_error(_tid, "get_load_address");
+    } else if (get_entrypoint_addr(_child, entrypoint) == -1)
       return system_error(_tid, "get_entrypoint_addr");
     break;
   case dbg::executable_type::executable:
@@ -380,18 +470,20 @@ tracer_expected<profiling_results> profiler::run() {
 
   log::logline(log::info,
                "[%d] tracee %d rip @ 0x%" PRIxPTR ", entrypoint @ 0x%" PRIxPTR,
-               _tid, waited_pid, regs.get_ip(), entrypoint);
-
-  int errnum;
-  if (ptrace_wrapper::instance.ptrace(errnum, PTRACE_SETOPTIONS, waited_pid, 0,
-                                      get_ptrace_opts(true)) == -1) {
-    return rettype(nonstd::unexpect,
-                   get_syserror(errnum, tracer_errcode::PTRACE_ERROR, _tid,
-                                "PTRACE_SETOPTIONS"));
+               _tid, _child, regs.get_ip(), entrypoint);
+
+  if (_seized.empty()) {
+    int errnum;
+    if (ptrace_wrapper::instance.ptrace(errnum, PTRACE_SETOPTIONS, _child, 0,
+                                        get_ptrace_opts(true)) == -1) {
+      return rettype(nonstd::unexpect,
+                     get_syserror(errnum, tracer_errcode::PTRACE_ERROR, _tid,
+                                  "PTRACE_SETOPTIONS"));
+    }
+    log::logline(log::debug, "[%d] ptrace options successfully set", _tid);
   }
-  log::logline(log::debug, "[%d] ptrace options successfully set", _tid);
 
-  // iterate the sections defined in the config and insert their respective
+  // iterate the sections defined in the config and register their respective
   // breakpoints
   for (const auto &group : _cd.groups()) {
     for (const auto &sec : group.sections) {
@@ -417,25 +509,70 @@ tracer_expected<profiling_results> profiler::run() {
                 entrypoint)) {
           return move_error(err);
         }
+      } else if (sec.bounds.holds<cfg::syscall_t>()) {
+        insert_syscall_section(group, sec, sec.bounds.get<cfg::syscall_t>());
       } else
         assert(false);
     }
   }
 
-  // first tracer has the same tracee tgid and tid, since there is only one
-  // tracee at this point
-  tracer trc(_traps, _child, _child, entrypoint, std::launch::deferred);
-  auto results = trc.results();
+  // the output of the sections no longer moves, so the consumers of their
+  // executions can refer to it
+  for (const auto &[start, distances] : _output.map)
+    _traps.find(start)->consume_results(
+        consumer_from_output(*_output.find(start)));
+  for (size_t ix = 0; ix < _output.syscalls.size(); ix++)
+    _traps.find_syscall(ix)->consume_results(
+        consumer_from_output(*_output.find_syscall(ix)));
+
+  // relocate the trapped instructions while the original code is intact
+  if (_flags.displaced_stepping)
+    if (tracer_error err = prepare_displaced_steps(_child, _traps))
+      return move_error(err);
+
+  // install all registered traps at once
+  {
+    std::vector<uintptr_t> addrs = _traps.addresses();
+    auto origwords = insert_traps(_child, addrs);
+    if (!origwords)
+      return move_error(origwords.error());
+    _traps.set_origwords(addrs, *origwords);
+    log::logline(log::success, "[%d] installed %zu traps", _tid, addrs.size());
+  }
+
+  auto trace = [&]() -> tracer_expected<tracer::gathered_results> {
+    // the threads of a seized process are all attached to this thread, so
+    // they can only be traced by a pool of workers
+    if (!_seized.empty()) {
+      event_tracer trc(_traps, _child, entrypoint,
+                       std::max(_flags.tracer_threads, 1u), _seized);
+      return trc.results();
+    }
+    if (_flags.tracer_threads) {
+      event_tracer trc(_traps, _child, entrypoint, _flags.tracer_threads);
+      return trc.results();
+    }
+    // first tracer has the same tracee tgid and tid, since there is only one
+    // tracee at this point
+    tracer trc(_traps, _child, _child, entrypoint, std::launch::deferred);
+    return trc.results();
+  };
+  auto results = trace();
   if (!results)
     return move_error(results.error());
 
-  for (auto &[start, end, values] : *results) {
-    start_trap *strap = _traps.find(entrypoint + start.addr());
-    assert(strap);
-    if (!strap)
-      return rettype(nonstd::unexpect, tracer_errcode::NO_TRAP,
-                     "Registered start traps are malformed");
-    section_output *sec_out = _output.find(entrypoint + start.addr());
+  for (auto &[start, end, values, syscall] : *results) {
+    section_output *sec_out = nullptr;
+    if (syscall) {
+      sec_out = _output.find_syscall(*syscall);
+    } else {
+      start_trap *strap = _traps.find(entrypoint + start.addr());
+      assert(strap);
+      if (!strap)
+        return rettype(nonstd::unexpect, tracer_errcode::NO_TRAP,
+                       "Registered start traps are malformed");
+      sec_out = _output.find(entrypoint + start.addr());
+    }
     assert(sec_out);
     if (!sec_out)
       return rettype(nonstd::unexpect, tracer_errcode::NO_TRAP,
@@ -453,6 +590,48 @@ tracer_expected<profiling_results> profiler::run() {
       sec_out->push_back(position_exec{{start, end}, std::move(*values)});
     }
   }
+  // the executions of each section which were not measured
+  for (const auto &[start, distances] : _output.map) {
+    const start_trap *strap = _traps.find(start);
+    assert(strap);
+    if (uint64_t skipped = strap->skipped()) {
+      log::logline(log::info, "[%d] skipped %" PRIu64 " executions of %s",
+                   _tid, skipped, to_string(strap->context()).c_str());
+      _output.find(start)->add_skipped(skipped);
+    }
+  }
+  for (size_t ix = 0; ix < _output.syscalls.size(); ix++) {
+    const start_trap *strap = _traps.find_syscall(ix);
+    assert(strap);
+    if (uint64_t skipped = strap->skipped()) {
+      log::logline(log::info, "[%d] skipped %" PRIu64 " executions of %s",
+                   _tid, skipped, to_string(strap->context()).c_str());
+      _output.find_syscall(ix)->add_skipped(skipped);
+    }
+  }
+  // how far apart the readers of sections of multiple targets were read
+  std::vector<skew_output> skew;
+  for (auto &[tgt, readers] : _readers.skew()) {
+    std::ostringstream targets;
+    targets << tgt;
+    for (size_t ix = 1; ix < readers.size(); ix++)
+      log::logline(log::info,
+                   "[%d] reader %zu of %s was read %" PRId64
+                   " ns after the first on average",
+                   _tid, ix, targets.str().c_str(), readers[ix].mean().count());
+    skew.push_back(skew_output{targets.str(), std::move(readers)});
+  }
+  // the jitter of the periodic samples of all sections
+  running_stats lateness = sampling_service::instance.lateness();
+  if (lateness.count())
+    log::logline(log::info,
+                 "[%d] periodic samples were taken %.0f ns late on average, "
+                 "%.0f ns at the 99th percentile",
+                 _tid, lateness.mean(), lateness.quantile(0.99));
+  if (lateness.count() || !skew.empty())
+    _output.results.sampling() =
+        sampling_output{std::move(lateness),
+                        sampling_service::instance.overruns(), std::move(skew)};
   return std::move(_output.results);
 }
 
@@ -472,14 +651,14 @@ tracer_error profiler::obtain_idle_results() {
   if (!cpu && !gpu)
     return tracer_error(tracer_errcode::UNKNOWN_ERROR,
                         "no CPU or GPU sections found");
-  if (timed_execution into; cpu) {
+  if (compact_execution into; cpu) {
     if (tracer_error err = sample_idle("CPU", &_readers.reader_rapl(), into))
       return err;
     _output.results.idle().emplace_back(
         std::make_unique<readings_output_cpu>(_readers.reader_rapl()),
         std::move(into));
   }
-  if (timed_execution into; gpu) {
+  if (compact_execution into; gpu) {
     if (tracer_error err = sample_idle("GPU", &_readers.reader_gpu(), into))
       return err;
     _output.results.idle().emplace_back(
@@ -524,17 +703,14 @@ tracer_error profiler::insert_traps_function(const cfg::group_t &group,
     log::logline(log::info, "[%d] [%s] symbol: %s", _tid, __func__,
                  func_res->second->name.c_str());
     start_addr start = entrypoint + func_res->second->local_entrypoint();
-    tracer_expected<long> origw = insert_trap(_child, start.val());
-    if (!origw)
-      return std::move(origw.error());
     auto cu = dbg::find_compilation_unit(_dli, *func_res->second);
     auto insert_res = _traps.insert(
         start,
-        start_trap(*origw,
-                   trap_context{function_call{
+        start_trap(trap_context{function_call{
                        func_res->second->local_entrypoint(), cu ? *cu : nullptr,
                        func_res->first, func_res->second}},
-                   sec.allow_concurrency, creator_from_section(_readers, sec)));
+                   sec.allow_concurrency, budget_from_section(sec),
+                   creator_from_section(_readers, sec)));
     if (!insert_res.second) {
       log::logline(log::error,
                    "[%d] trap @ 0x%" PRIxPTR " (offset 0x%" PRIxPTR
@@ -545,7 +721,7 @@ tracer_error profiler::insert_traps_function(const cfg::group_t &group,
           cmmn::concat("Trap ", ::to_string(start), " already exists"));
     }
     log::logline(log::info,
-                 "[%d] inserted trap at function call address 0x%" PRIxPTR
+                 "[%d] registered trap at function call address 0x%" PRIxPTR
                  " (offset 0x%" PRIxPTR ")",
                  _tid, start.val(), start.val() - entrypoint);
     if (!_output.insert(start, _readers, group, sec))
@@ -570,12 +746,7 @@ tracer_error profiler::insert_traps_function(const cfg::group_t &group,
     };
 
     auto insert = [&](auto addr, auto creator) {
-      auto offset = addr.val() - entrypoint;
-      tracer_expected<long> origw = insert_trap(_child, addr.val());
-      if (!origw)
-        return std::move(origw.error());
-      auto cu = dbg::find_compilation_unit(_dli, offset);
-      auto insert_res = _traps.insert(addr, creator(*origw));
+      auto insert_res = _traps.insert(addr, creator());
       if (!insert_res.second) {
         log::logline(log::error,
                      "[%d] trap @ 0x%" PRIxPTR " (offset 0x%" PRIxPTR
@@ -586,7 +757,7 @@ tracer_error profiler::insert_traps_function(const cfg::group_t &group,
             cmmn::concat("Trap ", ::to_string(addr), " already exists"));
       }
       log::logline(log::info,
-                   "[%d] inserted trap at inlined instance 0x%" PRIxPTR
+                   "[%d] registered trap at inlined instance 0x%" PRIxPTR
                    " (offset 0x%" PRIxPTR ")",
                    _tid, addr.val(), addr.val() - entrypoint);
       return tracer_error::success();
@@ -616,13 +787,14 @@ tracer_error profiler::insert_traps_function(const cfg::group_t &group,
                    to_string(start_ctx).c_str(),
                    inst.call_loc ? ::to_string(*inst.call_loc).c_str() : "n/a");
 
-      auto start_creator = [&](long origw) {
-        return start_trap{origw, trap_context{start_ctx}, sec.allow_concurrency,
+      auto start_creator = [&]() {
+        return start_trap{trap_context{start_ctx}, sec.allow_concurrency,
+                          budget_from_section(sec),
                           creator_from_section(_readers, sec)};
       };
 
-      auto end_creator = [&](long origw) {
-        return end_trap{origw, trap_context{end_ctx}, start};
+      auto end_creator = [&]() {
+        return end_trap{trap_context{end_ctx}, start};
       };
 
       if (auto err = insert(start, start_creator))
@@ -653,16 +825,13 @@ tracer_error profiler::insert_traps_address_range(
     const cfg::address_range_t &addr_range, uintptr_t entrypoint) {
   start_addr start = entrypoint + addr_range.start;
   end_addr end = entrypoint + addr_range.end;
-  tracer_expected<long> origw = insert_trap(_child, start.val());
-  if (!origw)
-    return std::move(origw.error());
   {
     auto cu = dbg::find_compilation_unit(_dli, addr_range.start);
     auto insert_res = _traps.insert(
         start,
-        start_trap(*origw,
-                   trap_context{address{addr_range.start, cu ? *cu : nullptr}},
-                   sec.allow_concurrency, creator_from_section(_readers, sec)));
+        start_trap(trap_context{address{addr_range.start, cu ? *cu : nullptr}},
+                   sec.allow_concurrency, budget_from_section(sec),
+                   creator_from_section(_readers, sec)));
     if (!insert_res.second) {
       log::logline(log::error,
                    "[%d] trap @ 0x%" PRIxPTR " (offset 0x%" PRIxPTR
@@ -673,19 +842,16 @@ tracer_error profiler::insert_traps_address_range(
           cmmn::concat("Trap ", ::to_string(start), " already exists"));
     }
     log::logline(log::info,
-                 "[%d] inserted trap at start address 0x%" PRIxPTR
+                 "[%d] registered trap at start address 0x%" PRIxPTR
                  " (offset 0x%" PRIxPTR ")",
                  _tid, start.val(), start.val() - entrypoint);
   }
-  origw = insert_trap(_child, end.val());
-  if (!origw)
-    return std::move(origw.error());
   {
     auto cu = dbg::find_compilation_unit(_dli, addr_range.end);
     auto insert_res = _traps.insert(
-        end, end_trap(*origw,
-                      trap_context{address{addr_range.end, cu ? *cu : nullptr}},
-                      start));
+        end,
+        end_trap(trap_context{address{addr_range.end, cu ? *cu : nullptr}},
+                 start));
     if (!insert_res.second) {
       log::logline(log::error,
                    "[%d] trap @ 0x%" PRIxPTR " (offset 0x%" PRIxPTR
@@ -696,7 +862,7 @@ tracer_error profiler::insert_traps_address_range(
           cmmn::concat("Trap ", ::to_string(end), " already exists"));
     }
     log::logline(log::info,
-                 "[%d] inserted trap at end address 0x%" PRIxPTR
+                 "[%d] registered trap at end address 0x%" PRIxPTR
                  " (offset 0x%" PRIxPTR ")",
                  _tid, end.val(), end.val() - entrypoint);
   }
@@ -726,18 +892,15 @@ profiler::insert_traps_position_start(const cfg::section_t &sec,
     return unexpected{generic_error(_tid, __func__, line.error())};
 
   start_addr eaddr = entrypoint + (*line)->address;
-  tracer_expected<long> origw = insert_trap(_child, eaddr.val());
-  if (!origw)
-    return unexpected{std::move(origw).error()};
   log::logline(log::info,
-               "[%d] inserted trap @ 0x%" PRIxPTR " (offset 0x%" PRIxPTR ")",
+               "[%d] registered trap @ 0x%" PRIxPTR " (offset 0x%" PRIxPTR ")",
                _tid, eaddr.val(), eaddr.val() - entrypoint);
 
   auto insert_res = _traps.insert(
       eaddr,
-      start_trap(*origw,
-                 trap_context{source_line{(*line)->address, *cu, (*line)}},
-                 sec.allow_concurrency, creator_from_section(_readers, sec)));
+      start_trap(trap_context{source_line{(*line)->address, *cu, (*line)}},
+                 sec.allow_concurrency, budget_from_section(sec),
+                 creator_from_section(_readers, sec)));
   if (!insert_res.second) {
     log::logline(log::error,
                  "[%d] trap @ 0x%" PRIxPTR " (offset 0x%" PRIxPTR
@@ -750,7 +913,7 @@ profiler::insert_traps_position_start(const cfg::section_t &sec,
 
   log::logline(log::debug, "[%d] line %s @ offset 0x%" PRIxPTR, _tid,
                ::to_string(**line).c_str(), (*line)->number);
-  log::logline(log::success, "[%d] inserted trap on line: %s", _tid,
+  log::logline(log::success, "[%d] registered trap on line: %s", _tid,
                ::to_string(**line).c_str());
   return eaddr;
 }
@@ -785,17 +948,13 @@ tracer_error profiler::insert_traps_position_end(const cfg::group_t &group,
         tracer_errcode::NO_TRAP,
         cmmn::concat("Trap ", ::to_string(eaddr), " equals the start trap"));
   }
-  tracer_expected<long> origw = insert_trap(_child, eaddr.val());
-  if (!origw)
-    return std::move(origw.error());
   log::logline(log::info,
-               "[%d] inserted trap @ 0x%" PRIxPTR " (offset 0x%" PRIxPTR ")",
+               "[%d] registered trap @ 0x%" PRIxPTR " (offset 0x%" PRIxPTR ")",
                _tid, eaddr.val(), eaddr.val() - entrypoint);
 
   auto insert_res = _traps.insert(
-      eaddr,
-      end_trap(*origw, trap_context{source_line{(*line)->address, *cu, *line}},
-               start));
+      eaddr, end_trap(trap_context{source_line{(*line)->address, *cu, *line}},
+                      start));
   if (!insert_res.second) {
     log::logline(log::error,
                  "[%d] trap @ 0x%" PRIxPTR " (offset 0x%" PRIxPTR
@@ -810,7 +969,21 @@ tracer_error profiler::insert_traps_position_end(const cfg::group_t &group,
 
   log::logline(log::debug, "[%d] line %s @ offset 0x%" PRIxPTR, _tid,
                ::to_string(**line).c_str(), (*line)->number);
-  log::logline(log::success, "[%d] inserted trap on line: %s", _tid,
+  log::logline(log::success, "[%d] registered trap on line: %s", _tid,
                ::to_string(**line).c_str());
   return tracer_error::success();
 }
+
+void profiler::insert_syscall_section(const cfg::group_t &group,
+                                      const cfg::section_t &sec,
+                                      const cfg::syscall_t &sc) {
+  // registered in the same order as the seccomp filter of the target reports
+  // them in
+  size_t index = _traps.insert(
+      start_trap(trap_context{system_call{{0, nullptr}, sc.number}},
+                 sec.allow_concurrency, budget_from_section(sec),
+                 creator_from_section(_readers, sec)));
+  _output.insert_syscall(_readers, group, sec);
+  log::logline(log::info, "[%d] registered section bounded by %s (index %zu)",
+               _tid, ::to_string(sc).c_str(), index);
+}
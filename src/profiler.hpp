@@ -27,18 +27,30 @@ private:
         std::unordered_map<start_addr, distance_pair, start_addr::hash>;
 
     map_type map;
+    // the sections bounded by system calls, by index
+    std::vector<distance_pair> syscalls;
     profiling_results results;
 
     output_mapping() = default;
 
     bool insert(start_addr, const reader_container &, const cfg::group_t &,
                 const cfg::section_t &);
+    void insert_syscall(const reader_container &, const cfg::group_t &,
+                        const cfg::section_t &);
 
     section_output *find(start_addr);
+    section_output *find_syscall(size_t index);
+
+  private:
+    distance_pair insert_section(const reader_container &, const cfg::group_t &,
+                                 const cfg::section_t &);
+    section_output *at(distance_pair);
   };
 
   pid_t _tid;
   pid_t _child;
+  // the threads of <_child> if it was seized while running
+  std::vector<pid_t> _seized;
   flags _flags;
   dbg::object_info _dli;
   cfg::config_t _cd;
@@ -53,6 +65,9 @@ public:
   const cfg::config_t &config() const;
   const registered_traps &traps() const;
 
+  // seizes all threads of <child>, a process which is already running, so
+  // that it is profiled and then detached from instead of being launched
+  tracer_error attach();
   tracer_error await_executable(const std::string &name) const;
   nonstd::expected<profiling_results, tracer_error> run();
 
@@ -76,5 +91,8 @@ private:
                                          const cfg::section_t &,
                                          const cfg::position_t &, uintptr_t,
                                          start_addr);
+
+  void insert_syscall_section(const cfg::group_t &, const cfg::section_t &,
+                              const cfg::syscall_t &);
 };
 } // namespace tep
@@ -1,15 +1,125 @@
 #include "ptrace_misc.hpp"
 #include "error.hpp"
+#include "log.hpp"
 #include "ptrace_wrapper.hpp"
+#include "registers.hpp"
 #include "util.hpp"
 
 #include "nonstd/expected.hpp"
 
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
 #include <cstring>
 #include <string>
 #include <vector>
 
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+struct page_run {
+  uintptr_t first;
+  size_t count;
+};
+
+nonstd::expected<long, tep::tracer_error>
+remote_syscall(pid_t pid, const tep::syscall_entry &entry) {
+  using namespace tep;
+  using unexpected = nonstd::expected<long, tracer_error>::unexpected_type;
+  ptrace_wrapper &pw = ptrace_wrapper::instance;
+  int error;
+  cpu_gp_regs saved(pid);
+  if (auto err = saved.getregs())
+    return unexpected{std::move(err)};
+  uintptr_t ip = saved.get_ip();
+  long word = pw.ptrace(error, PTRACE_PEEKDATA, pid, ip, 0);
+  if (error)
+    return unexpected{get_syserror(error, tracer_errcode::PTRACE_ERROR, pid,
+                                   "remote_syscall: PTRACE_PEEKDATA")};
+  if (pw.ptrace(error, PTRACE_POKEDATA, pid, ip, set_syscall(word)) == -1)
+    return unexpected{get_syserror(error, tracer_errcode::PTRACE_ERROR, pid,
+                                   "remote_syscall: PTRACE_POKEDATA")};
+
+  cpu_gp_regs regs(saved);
+  regs.set_syscall_entry(entry);
+  tracer_error err = regs.setregs();
+  int wait_status;
+  if (!err && pw.ptrace(error, PTRACE_SINGLESTEP, pid, 0, 0) == -1)
+    err = get_syserror(error, tracer_errcode::PTRACE_ERROR, pid,
+                       "remote_syscall: PTRACE_SINGLESTEP");
+  if (!err && waitpid(pid, &wait_status, __WALL) == -1)
+    err = get_syserror(errno, tracer_errcode::SYSTEM_ERROR, pid,
+                       "remote_syscall: waitpid");
+  if (!err && !is_breakpoint_trap(wait_status))
+    err = tracer_error(tracer_errcode::UNKNOWN_ERROR,
+                       "remote_syscall: tracee did not stop after the system "
+                       "call");
+  if (!err)
+    err = regs.getregs();
+
+  // restore the tracee regardless of the outcome
+  if (pw.ptrace(error, PTRACE_POKEDATA, pid, ip, word) == -1)
+    return unexpected{get_syserror(error, tracer_errcode::PTRACE_ERROR, pid,
+                                   "remote_syscall: PTRACE_POKEDATA")};
+  if (auto restore_err = saved.setregs())
+    return unexpected{std::move(restore_err)};
+  if (err)
+    return unexpected{std::move(err)};
+  return regs.get_syscall_return();
+}
+
+// the tids of the threads of process <pid>; false if the process does not
+// exist or its tasks cannot be listed
+bool list_tasks(pid_t pid, std::vector<pid_t> &tids) {
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/%d/task", pid);
+  DIR *dir = opendir(path);
+  if (!dir)
+    return false;
+  tids.clear();
+  while (const dirent *entry = readdir(dir))
+    if (pid_t tid = atoi(entry->d_name); tid > 0)
+      tids.push_back(tid);
+  closedir(dir);
+  return true;
+}
+
+bool transfer_run(int fd, const page_run &run, std::vector<char> &pages,
+                  size_t first_page, size_t page_size, bool write) {
+  std::vector<iovec> iov(run.count);
+  for (size_t ix = 0; ix < run.count; ix++)
+    iov[ix] = {&pages[(first_page + ix) * page_size], page_size};
+  size_t expected = run.count * page_size;
+  ssize_t done = write ? pwritev(fd, iov.data(), iov.size(), run.first)
+                       : preadv(fd, iov.data(), iov.size(), run.first);
+  if (done >= 0 && done != static_cast<ssize_t>(expected))
+    errno = EIO;
+  return done == static_cast<ssize_t>(expected);
+}
+} // namespace
+
 namespace tep {
+mem_file::mem_file(pid_t pid) : _pid(pid), _fd(-1) {
+  char path[32];
+  snprintf(path, sizeof(path), "/proc/%d/mem", pid);
+  _fd = open(path, O_RDWR);
+}
+
+mem_file::~mem_file() {
+  if (_fd != -1)
+    close(_fd);
+}
+
+pid_t mem_file::pid() const noexcept { return _pid; }
+
+int mem_file::get() const noexcept { return _fd; }
+
 nonstd::expected<std::string, tracer_error> get_string(pid_t pid,
                                                        uintptr_t address) {
   using rettype = decltype(ptrace(PTRACE_PEEKTEXT, 0, 0, 0));
@@ -73,4 +183,307 @@ nonstd::expected<long, tracer_error> insert_trap(pid_t pid, uintptr_t addr) {
                                    "insert_trap: PTRACE_POKEDATA")};
   return word;
 }
+
+nonstd::expected<long, tracer_error> read_word(const mem_file &mem,
+                                               uintptr_t addr) {
+  using unexpected = nonstd::expected<long, tracer_error>::unexpected_type;
+  long word;
+  ssize_t done = pread(mem.get(), &word, sizeof(word), addr);
+  if (done != sizeof(word))
+    return unexpected{get_syserror(done == -1 ? errno : EIO,
+                                   tracer_errcode::SYSTEM_ERROR, mem.pid(),
+                                   "read_word: pread")};
+  return word;
+}
+
+tracer_error write_trap_bytes(const mem_file &mem, uintptr_t addr, long word) {
+  // the trap instruction occupies the first bytes of the word in memory,
+  // regardless of byte order
+  unsigned char bytes[sizeof(word)];
+  std::memcpy(bytes, &word, sizeof(word));
+  ssize_t done = pwrite(mem.get(), bytes, trap_length, addr);
+  if (done != static_cast<ssize_t>(trap_length))
+    return get_syserror(done == -1 ? errno : EIO, tracer_errcode::SYSTEM_ERROR,
+                        mem.pid(), "write_trap_bytes: pwrite");
+  return tracer_error::success();
+}
+
+nonstd::expected<uintptr_t, tracer_error>
+remote_mmap(pid_t pid, uintptr_t hint, size_t length, int prot, int flags) {
+  using unexpected = nonstd::expected<uintptr_t, tracer_error>::unexpected_type;
+#if !defined(MAP_FIXED_NOREPLACE)
+#define MAP_FIXED_NOREPLACE 0x100000
+#endif
+  auto mmap_entry = [&](int extra_flags) {
+    return syscall_entry{
+        SYS_mmap,
+        {hint, length, static_cast<uint64_t>(prot),
+         static_cast<uint64_t>(flags | extra_flags),
+         static_cast<uint64_t>(-1), 0}};
+  };
+  auto result =
+      remote_syscall(pid, mmap_entry(hint ? MAP_FIXED_NOREPLACE : 0));
+  // the range is occupied, use the address as a hint only
+  if (result && *result == -EEXIST)
+    result = remote_syscall(pid, mmap_entry(0));
+  if (!result)
+    return unexpected{std::move(result).error()};
+  if (*result < 0 && *result > -4096)
+    return unexpected{get_syserror(-*result, tracer_errcode::SYSTEM_ERROR, pid,
+                                   "remote_mmap: mmap")};
+  return static_cast<uintptr_t>(*result);
+}
+
+nonstd::expected<cpu_gp_regs, tracer_error>
+release_tracee(pid_t tid, pid_t tracee, bool stopped) {
+  using unexpected =
+      nonstd::expected<cpu_gp_regs, tracer_error>::unexpected_type;
+  ptrace_wrapper &pw = ptrace_wrapper::instance;
+  int wait_status;
+  // the initial stop is either a SIGSTOP or, if the creator of the tracee was
+  // seized, a PTRACE_EVENT_STOP
+  if (!stopped) {
+    if (waitpid(tracee, &wait_status, __WALL) == -1)
+      return unexpected{get_syserror(errno, tracer_errcode::SYSTEM_ERROR, tid,
+                                     "release_tracee: waitpid")};
+    if (!WIFSTOPPED(wait_status))
+      return unexpected{tracer_error(tracer_errcode::PTRACE_ERROR,
+                                     "New tracee exited before initial stop")};
+  }
+
+  cpu_gp_regs regs(tracee);
+  if (auto error = regs.getregs())
+    return unexpected{std::move(error)};
+  cpu_gp_regs parked(regs);
+  parked.reenter_syscall(SYS_pause);
+  if (auto error = parked.setregs())
+    return unexpected{std::move(error)};
+
+  int error;
+  if (pw.ptrace(error, PTRACE_DETACH, tracee, 0, 0) == -1)
+    return unexpected{get_syserror(error, tracer_errcode::PTRACE_ERROR, tid,
+                                   "release_tracee: PTRACE_DETACH")};
+  log::logline(log::debug, "[%d] released tracee %d parked @ 0x%" PRIxPTR, tid,
+               tracee, parked.get_ip());
+  return regs;
+}
+
+tracer_error adopt_tracee(pid_t tid, const cpu_gp_regs &regs, int options) {
+  ptrace_wrapper &pw = ptrace_wrapper::instance;
+  pid_t tracee = regs.pid();
+  int error;
+  if (pw.ptrace(error, PTRACE_SEIZE, tracee, 0, options) == -1)
+    return get_syserror(error, tracer_errcode::PTRACE_ERROR, tid,
+                        "adopt_tracee: PTRACE_SEIZE");
+  if (pw.ptrace(error, PTRACE_INTERRUPT, tracee, 0, 0) == -1)
+    return get_syserror(error, tracer_errcode::PTRACE_ERROR, tid,
+                        "adopt_tracee: PTRACE_INTERRUPT");
+
+  int wait_status;
+  if (waitpid(tracee, &wait_status, __WALL) == -1)
+    return get_syserror(errno, tracer_errcode::SYSTEM_ERROR, tid,
+                        "adopt_tracee: waitpid");
+  if (!WIFSTOPPED(wait_status))
+    return tracer_error(tracer_errcode::PTRACE_ERROR,
+                        "Released tracee exited before being adopted");
+
+  // whether the tracee was stopped in pause() or right before entering it,
+  // restoring the original registers makes it return from the system call
+  // which created it, as if it was never released
+  cpu_gp_regs restored(regs);
+  if (auto error = restored.setregs())
+    return error;
+  log::logline(log::debug, "[%d] adopted tracee %d @ 0x%" PRIxPTR, tid, tracee,
+               restored.get_ip());
+  return tracer_error::success();
+}
+
+tracer_error finish_exec(pid_t tid, pid_t tracee) {
+  int error;
+  if (ptrace_wrapper::instance.ptrace(error, PTRACE_SINGLESTEP, tracee, 0, 0) ==
+      -1)
+    return get_syserror(error, tracer_errcode::PTRACE_ERROR, tid,
+                        "finish_exec: PTRACE_SINGLESTEP");
+  int wait_status;
+  if (waitpid(tracee, &wait_status, __WALL) == -1)
+    return get_syserror(errno, tracer_errcode::SYSTEM_ERROR, tid,
+                        "finish_exec: waitpid");
+  if (!is_breakpoint_trap(wait_status))
+    return tracer_error(tracer_errcode::PTRACE_ERROR,
+                        "Tracee did not stop after returning from execve");
+  return tracer_error::success();
+}
+
+tracer_error interrupt_tracee(pid_t tid, pid_t tracee) {
+  int error;
+  if (ptrace_wrapper::instance.ptrace(error, PTRACE_INTERRUPT, tracee, 0, 0) ==
+      -1) {
+    // the tracee exited and its exit is yet to be waited for
+    if (error == ESRCH) {
+      log::logline(log::warning,
+                   "[%d] PTRACE_INTERRUPT failed with ESRCH for tracee %d", tid,
+                   tracee);
+      return tracer_error::success();
+    }
+    return get_syserror(error, tracer_errcode::PTRACE_ERROR, tid,
+                        "PTRACE_INTERRUPT");
+  }
+  return tracer_error::success();
+}
+
+nonstd::expected<std::vector<pid_t>, tracer_error>
+seize_process(pid_t tid, pid_t pid, int options) {
+  using unexpected =
+      nonstd::expected<std::vector<pid_t>, tracer_error>::unexpected_type;
+  ptrace_wrapper &pw = ptrace_wrapper::instance;
+  std::vector<pid_t> seized;
+  std::vector<pid_t> tasks;
+  // threads may be created by those not yet stopped, so the tasks are listed
+  // again until every thread found is already stopped, at which point none can
+  // be created anymore
+  for (bool found = true; found;) {
+    if (!list_tasks(pid, tasks))
+      return unexpected{get_syserror(errno, tracer_errcode::SYSTEM_ERROR, tid,
+                                     "seize_process: opendir")};
+    found = false;
+    for (pid_t task : tasks) {
+      if (std::find(seized.begin(), seized.end(), task) != seized.end())
+        continue;
+      found = true;
+      // no options yet, so that no new thread is attached to automatically
+      // before it is found in the list of tasks
+      int error;
+      if (pw.ptrace(error, PTRACE_SEIZE, task, 0, 0) == -1) {
+        if (error == ESRCH)
+          continue;
+        return unexpected{get_syserror(error, tracer_errcode::PTRACE_ERROR,
+                                       tid, "seize_process: PTRACE_SEIZE")};
+      }
+      if (pw.ptrace(error, PTRACE_INTERRUPT, task, 0, 0) == -1)
+        return unexpected{get_syserror(error, tracer_errcode::PTRACE_ERROR,
+                                       tid, "seize_process: PTRACE_INTERRUPT")};
+
+      // a signal about to be delivered is reported first, in which case it is
+      // delivered and the pending interrupt is reported right after
+      int wait_status;
+      bool exited = false;
+      while (true) {
+        if (waitpid(task, &wait_status, __WALL) == -1)
+          return unexpected{get_syserror(errno, tracer_errcode::SYSTEM_ERROR,
+                                         tid, "seize_process: waitpid")};
+        if (!WIFSTOPPED(wait_status)) {
+          exited = true;
+          break;
+        }
+        if (wait_status >> 16 == PTRACE_EVENT_STOP)
+          break;
+        if (pw.ptrace(error, PTRACE_CONT, task, 0, WSTOPSIG(wait_status)) ==
+            -1)
+          return unexpected{get_syserror(error, tracer_errcode::PTRACE_ERROR,
+                                         tid, "seize_process: PTRACE_CONT")};
+      }
+      if (exited) {
+        log::logline(log::info, "[%d] thread %d exited while being seized", tid,
+                     task);
+        continue;
+      }
+      seized.push_back(task);
+      log::logline(log::debug, "[%d] seized thread %d of process %d", tid,
+                   task, pid);
+    }
+  }
+  if (seized.empty())
+    return unexpected{tracer_error(tracer_errcode::PTRACE_ERROR,
+                                   "Process has no threads to seize")};
+
+  for (pid_t task : seized) {
+    int error;
+    if (pw.ptrace(error, PTRACE_SETOPTIONS, task, 0, options) == -1)
+      return unexpected{get_syserror(error, tracer_errcode::PTRACE_ERROR, tid,
+                                     "seize_process: PTRACE_SETOPTIONS")};
+  }
+  log::logline(log::success, "[%d] seized %zu threads of process %d", tid,
+               seized.size(), pid);
+  return seized;
+}
+
+nonstd::expected<std::vector<long>, tracer_error>
+insert_traps(pid_t pid, const std::vector<uintptr_t> &addrs) {
+  using unexpected =
+      nonstd::expected<std::vector<long>, tracer_error>::unexpected_type;
+  assert(std::is_sorted(addrs.begin(), addrs.end()));
+  constexpr size_t wordsz = sizeof(long);
+  const size_t page_size = sysconf(_SC_PAGESIZE);
+  auto page_of = [page_size](uintptr_t addr) {
+    return addr & ~(page_size - 1);
+  };
+
+  // gather the pages spanned by each trap word and group them in runs of
+  // contiguous pages, which are transferred with a single system call each
+  std::vector<uintptr_t> pages;
+  for (uintptr_t addr : addrs)
+    for (uintptr_t p = page_of(addr); p <= page_of(addr + wordsz - 1);
+         p += page_size)
+      if (pages.empty() || pages.back() < p)
+        pages.push_back(p);
+  std::vector<page_run> runs;
+  for (uintptr_t p : pages) {
+    if (!runs.empty() &&
+        runs.back().first + runs.back().count * page_size == p)
+      runs.back().count++;
+    else
+      runs.push_back({p, 1});
+  }
+
+  mem_file mem(pid);
+  if (mem.get() == -1)
+    return unexpected{get_syserror(errno, tracer_errcode::SYSTEM_ERROR, pid,
+                                   "insert_traps: open")};
+  std::vector<char> original(pages.size() * page_size);
+  for (size_t ix = 0, first = 0; ix < runs.size();
+       first += runs[ix++].count) {
+    if (!transfer_run(mem.get(), runs[ix], original, first, page_size, false))
+      return unexpected{get_syserror(errno, tracer_errcode::SYSTEM_ERROR, pid,
+                                     "insert_traps: preadv")};
+  }
+
+  auto offset_of = [&](uintptr_t addr) {
+    size_t page_ix =
+        std::lower_bound(pages.begin(), pages.end(), page_of(addr)) -
+        pages.begin();
+    return page_ix * page_size + (addr - page_of(addr));
+  };
+  // pages are stored in ascending order, so a word which crosses a page
+  // boundary can be read and written as if the pages were contiguous
+  auto word_at = [&](const std::vector<char> &buf, uintptr_t addr) {
+    long word;
+    std::memcpy(&word, &buf[offset_of(addr)], wordsz);
+    return word;
+  };
+
+  std::vector<char> patched(original);
+  for (uintptr_t addr : addrs) {
+    long word = set_trap(word_at(patched, addr));
+    std::memcpy(&patched[offset_of(addr)], &word, wordsz);
+  }
+
+  // the bits of the word which set_trap() leaves untouched
+  const long kept_bits = set_trap(0) ^ set_trap(~0L);
+  std::vector<long> origwords;
+  origwords.reserve(addrs.size());
+  for (uintptr_t addr : addrs)
+    origwords.push_back((word_at(patched, addr) & kept_bits) |
+                        (word_at(original, addr) & ~kept_bits));
+
+  for (size_t ix = 0, first = 0; ix < runs.size();
+       first += runs[ix++].count) {
+    if (!transfer_run(mem.get(), runs[ix], patched, first, page_size, true))
+      return unexpected{get_syserror(errno, tracer_errcode::SYSTEM_ERROR, pid,
+                                     "insert_traps: pwritev")};
+  }
+  log::logline(log::debug,
+               "[%d] inserted %zu traps in %zu pages with %zu page runs", pid,
+               addrs.size(), pages.size(), runs.size());
+  return origwords;
+}
 } // namespace tep
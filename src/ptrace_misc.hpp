@@ -8,7 +8,28 @@
 #include <string>
 #include <vector>
 
+#include <sys/types.h>
+
 namespace tep {
+class cpu_gp_regs;
+
+// the /proc/<pid>/mem file of a tracee, opened for reading and writing
+class mem_file {
+  pid_t _pid;
+  int _fd;
+
+public:
+  explicit mem_file(pid_t pid);
+  ~mem_file();
+
+  mem_file(const mem_file &) = delete;
+  mem_file &operator=(const mem_file &) = delete;
+
+  pid_t pid() const noexcept;
+  // -1 if the file could not be opened
+  int get() const noexcept;
+};
+
 // Retrieve a null-terminated string starting at address <address>
 // of a tracee with pid <pid>
 nonstd::expected<std::string, tracer_error> get_string(pid_t pid,
@@ -29,4 +50,141 @@ get_strings(pid_t pid, uintptr_t address);
  * @return nonstd::expected<long, tracer_error>
  */
 nonstd::expected<long, tracer_error> insert_trap(pid_t pid, uintptr_t addr);
+
+/**
+ * @brief Insert traps at multiple addresses and return the old word values
+ *
+ * The pages containing the addresses are read and patched through
+ * /proc/<pid>/mem, with one preadv and one pwritev per run of contiguous
+ * pages, instead of a PTRACE_PEEKDATA and PTRACE_POKEDATA pair per trap.
+ * Since all traps are written at once, the old word of each trap keeps any
+ * other traps which share the same word, so restoring it does not remove them.
+ *
+ * @param pid the pid of the tracee process, which must be stopped
+ * @param addrs the addresses, in ascending order and without duplicates
+ * @return nonstd::expected<std::vector<long>, tracer_error> the old word at
+ * each address
+ */
+nonstd::expected<std::vector<long>, tracer_error>
+insert_traps(pid_t pid, const std::vector<uintptr_t> &addrs);
+
+/**
+ * @brief Seize and stop all threads of a running process
+ *
+ * Every thread listed in /proc/<pid>/task is seized and interrupted, and its
+ * stop is waited for; the list is read again until it holds no thread which
+ * was not yet seized. Signals reported in the meantime are delivered. The
+ * threads are left in a PTRACE_EVENT_STOP, with <options> set once all of
+ * them are stopped.
+ *
+ * @param tid the tid of the calling thread, which becomes attached to the
+ * threads
+ * @param pid the pid of the process
+ * @param options ptrace options to set on each thread
+ * @return nonstd::expected<std::vector<pid_t>, tracer_error> the tids of the
+ * seized threads
+ */
+nonstd::expected<std::vector<pid_t>, tracer_error>
+seize_process(pid_t tid, pid_t pid, int options);
+
+/**
+ * @brief Read the word at an address of a tracee
+ *
+ * @param mem the memory file of the tracee
+ * @param addr the address
+ * @return nonstd::expected<long, tracer_error>
+ */
+nonstd::expected<long, tracer_error> read_word(const mem_file &mem,
+                                               uintptr_t addr);
+
+/**
+ * @brief Write the bytes of the trap instruction of a word to an address
+ *
+ * Unlike PTRACE_POKEDATA, which writes the whole word, only the bytes a trap
+ * instruction occupies are written, so concurrently arming or disarming traps
+ * at nearby addresses, whose words overlap, cannot undo one another.
+ *
+ * @param mem the memory file of the tracee
+ * @param addr the address of the trap
+ * @param word the original word at <addr> to disarm the trap, or set_trap()
+ * of it to arm it
+ * @return tracer_error
+ */
+tracer_error write_trap_bytes(const mem_file &mem, uintptr_t addr, long word);
+
+/**
+ * @brief Map anonymous memory into a tracee
+ *
+ * The tracee executes mmap() itself: the word at its IP is temporarily
+ * replaced with a system call instruction which is then single-stepped;
+ * its registers and the original word are restored afterwards.
+ *
+ * @param pid the pid of the tracee, which must be stopped outside a system call
+ * @param hint the address hint
+ * @param length the length of the mapping
+ * @param prot the memory protection of the mapping
+ * @param flags the flags of the mapping; if MAP_FIXED_NOREPLACE is supported
+ * it is added to the flags and the hint is retried as a plain hint should the
+ * range be occupied
+ * @return nonstd::expected<uintptr_t, tracer_error> the start of the mapping
+ */
+nonstd::expected<uintptr_t, tracer_error>
+remote_mmap(pid_t pid, uintptr_t hint, size_t length, int prot, int flags);
+
+/**
+ * @brief Detach a newly created tracee so that another thread can attach to it
+ *
+ * Waits for the initial stop of the new tracee, which must have just returned
+ * from the system call that created it, and detaches it while making it
+ * re-enter the kernel in pause(), so that it cannot run any code while no
+ * thread is attached to it.
+ *
+ * @param tid the tid of the calling (currently attached) thread
+ * @param tracee the tid of the new tracee
+ * @param stopped whether the initial stop of the tracee was already waited for
+ * @return nonstd::expected<cpu_gp_regs, tracer_error> the registers of the
+ * tracee at the time of its initial stop, to be handed to adopt_tracee()
+ */
+nonstd::expected<cpu_gp_regs, tracer_error>
+release_tracee(pid_t tid, pid_t tracee, bool stopped = false);
+
+/**
+ * @brief Attach the calling thread to a tracee released with release_tracee()
+ *
+ * Seizes and interrupts the tracee and restores the registers it had at the
+ * time of release; the tracee is left in a ptrace-stop.
+ *
+ * @param tid the tid of the calling thread
+ * @param regs the registers returned by release_tracee()
+ * @param options ptrace options to seize the tracee with
+ * @return tracer_error
+ */
+tracer_error adopt_tracee(pid_t tid, const cpu_gp_regs &regs, int options);
+
+/**
+ * @brief Make a tracee in a PTRACE_EVENT_EXEC stop return from execve()
+ *
+ * At that stop the tracee is still inside execve(), whose return value would
+ * overwrite the registers set to make it execute code on the behalf of the
+ * tracer, e.g. by remote_mmap(). Single-stepping it stops it once it returns
+ * to user space, at the entry point and before it executes any instruction.
+ *
+ * @param tid the tid of the calling (currently attached) thread
+ * @param tracee the tid of the tracee
+ * @return tracer_error
+ */
+tracer_error finish_exec(pid_t tid, pid_t tracee);
+
+/**
+ * @brief Interrupt a seized tracee with PTRACE_INTERRUPT
+ *
+ * The tracee reports a PTRACE_EVENT_STOP as soon as it stops or, if it is
+ * already in a ptrace-stop, as soon as it is resumed. No signal is queued, so
+ * an interrupt never changes what the tracee itself observes.
+ *
+ * @param tid the tid of the calling (currently attached) thread
+ * @param tracee the tid of the tracee
+ * @return tracer_error, success if the tracee no longer exists
+ */
+tracer_error interrupt_tracee(pid_t tid, pid_t tracee);
 } // namespace tep
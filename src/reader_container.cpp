@@ -39,7 +39,7 @@ create_cpu_reader(const flags &flags,
 
   try {
     nrgprf::reader_rapl reader(get_domain_mask(), get_socket_mask(),
-                               log::stream());
+                               flags.cpu_backend, "", log::stream());
     log::logline(log::success, "created CPU reader");
     return reader;
   } catch (const nrgprf::exception &e) {
@@ -80,7 +80,8 @@ create_gpu_reader(const flags &flags,
 
 reader_container::reader_container(const flags &flags, const cfg::config_t &cd)
     : _rdr_cpu(create_cpu_reader(flags, cd.parameters())),
-      _rdr_gpu(create_gpu_reader(flags, cd.parameters())) {
+      _rdr_gpu(create_gpu_reader(flags, cd.parameters())), _hybrids(),
+      _parallel(flags.parallel_hybrid), _parallel_hybrids() {
   for (const auto &g : cd.groups()) {
     for (const auto &s : g.sections) {
       assert(cfg::target_valid(s.targets));
@@ -93,37 +94,54 @@ reader_container::reader_container(const flags &flags, const cfg::config_t &cd)
 reader_container::~reader_container() = default;
 
 reader_container::reader_container(const reader_container &other)
-    : _rdr_cpu(other._rdr_cpu), _rdr_gpu(other._rdr_gpu), _hybrids() {
+    : _rdr_cpu(other._rdr_cpu), _rdr_gpu(other._rdr_gpu), _hybrids(),
+      _parallel(other._parallel), _parallel_hybrids() {
   _hybrids.reserve(other._hybrids.size());
   for (const auto &[tgts, hr] : other._hybrids)
     emplace_hybrid_reader(tgts);
+  _parallel_hybrids.reserve(other._parallel_hybrids.size());
+  for (const auto &[tgts, hr] : other._parallel_hybrids)
+    emplace_hybrid_reader(tgts);
 }
 
 reader_container &reader_container::operator=(const reader_container &other) {
   _rdr_cpu = other._rdr_cpu;
   _rdr_gpu = other._rdr_gpu;
+  _parallel = other._parallel;
   _hybrids.clear();
   _hybrids.reserve(other._hybrids.size());
   for (const auto &[tgts, hr] : other._hybrids)
     emplace_hybrid_reader(tgts);
+  _parallel_hybrids.clear();
+  _parallel_hybrids.reserve(other._parallel_hybrids.size());
+  for (const auto &[tgts, hr] : other._parallel_hybrids)
+    emplace_hybrid_reader(tgts);
   return *this;
 }
 
 reader_container::reader_container(reader_container &&other)
     : _rdr_cpu(std::move(other._rdr_cpu)), _rdr_gpu(std::move(other._rdr_gpu)),
-      _hybrids() {
+      _hybrids(), _parallel(other._parallel), _parallel_hybrids() {
   _hybrids.reserve(other._hybrids.size());
   for (auto &[tgts, hr] : other._hybrids)
     emplace_hybrid_reader(std::move(tgts));
+  _parallel_hybrids.reserve(other._parallel_hybrids.size());
+  for (auto &[tgts, hr] : other._parallel_hybrids)
+    emplace_hybrid_reader(std::move(tgts));
 }
 
 reader_container &reader_container::operator=(reader_container &&other) {
   _rdr_cpu = std::move(other._rdr_cpu);
   _rdr_gpu = std::move(other._rdr_gpu);
+  _parallel = other._parallel;
   _hybrids.clear();
   _hybrids.reserve(other._hybrids.size());
   for (auto &[tgts, hr] : other._hybrids)
     emplace_hybrid_reader(std::move(tgts));
+  _parallel_hybrids.clear();
+  _parallel_hybrids.reserve(other._parallel_hybrids.size());
+  for (auto &[tgts, hr] : other._parallel_hybrids)
+    emplace_hybrid_reader(std::move(tgts));
   return *this;
 }
 
@@ -156,28 +174,55 @@ const nrgprf::reader *reader_container::find(cfg::target target) const {
                    ss.str().c_str());
       return &hr;
     }
+  for (const auto &[tgt, hr] : _parallel_hybrids)
+    if (tgt == target) {
+      std::stringstream ss;
+      ss << target;
+      log::logline(log::debug,
+                   "retrieved parallel hybrid reader for targets: %s",
+                   ss.str().c_str());
+      return &hr;
+    }
   assert(false);
   return nullptr;
 }
 
+std::vector<std::pair<cfg::target, std::vector<nrgprf::reader_skew>>>
+reader_container::skew() const {
+  std::vector<std::pair<cfg::target, std::vector<nrgprf::reader_skew>>> retval;
+  for (const auto &[tgt, hr] : _parallel_hybrids)
+    retval.emplace_back(tgt, hr.skew());
+  return retval;
+}
+
 template <bool Log>
 void reader_container::emplace_hybrid_reader(cfg::target targets) {
-  auto &[tgts, hr] = _hybrids.emplace_back(targets, nrgprf::hybrid_reader{});
-  for (cfg::target t = tgts, curr = cfg::target::cpu; cfg::target_valid(t);
+  std::vector<const nrgprf::reader *> readers;
+  for (cfg::target t = targets, curr = cfg::target::cpu; cfg::target_valid(t);
        t &= ~curr, curr = cfg::target_next(curr)) {
     switch (t & curr) {
     case cfg::target::cpu:
       if constexpr (Log)
         log::logline(log::debug, "insert RAPL reader to hybrid");
-      hr.push_back(_rdr_cpu);
+      readers.push_back(&_rdr_cpu);
       break;
     case cfg::target::gpu:
       if constexpr (Log)
         log::logline(log::debug, "insert GPU reader to hybrid");
-      hr.push_back(_rdr_gpu);
+      readers.push_back(&_rdr_gpu);
       break;
     default:
       assert(false);
     }
   }
+  if (_parallel) {
+    if constexpr (Log)
+      log::logline(log::debug, "read hybrid readers in parallel");
+    _parallel_hybrids.emplace_back(
+        targets, nrgprf::parallel_hybrid_reader(std::move(readers)));
+    return;
+  }
+  auto &[tgts, hr] = _hybrids.emplace_back(targets, nrgprf::hybrid_reader{});
+  for (const nrgprf::reader *r : readers)
+    hr.push_back(*r);
 }
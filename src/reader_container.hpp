@@ -5,6 +5,7 @@
 #include "configfwd.hpp"
 
 #include <nrg/hybrid_reader.hpp>
+#include <nrg/parallel_hybrid_reader.hpp>
 #include <nrg/reader_gpu.hpp>
 #include <nrg/reader_rapl.hpp>
 
@@ -16,6 +17,10 @@ private:
   nrgprf::reader_rapl _rdr_cpu;
   nrgprf::reader_gpu _rdr_gpu;
   std::vector<std::pair<cfg::target, nrgprf::hybrid_reader>> _hybrids;
+  // the readers of multiple targets are read concurrently if set
+  bool _parallel;
+  std::vector<std::pair<cfg::target, nrgprf::parallel_hybrid_reader>>
+      _parallel_hybrids;
 
 public:
   reader_container(const flags &, const cfg::config_t &);
@@ -34,6 +39,11 @@ public:
 
   const nrgprf::reader *find(cfg::target) const;
 
+  // how far apart the readers of each target were read, by hybrid reader read
+  // in parallel
+  std::vector<std::pair<cfg::target, std::vector<nrgprf::reader_skew>>>
+  skew() const;
+
 private:
   template <bool Log = false> void emplace_hybrid_reader(cfg::target);
 };
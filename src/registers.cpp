@@ -13,6 +13,17 @@ using namespace tep;
 cpu_gp_regs::cpu_gp_regs(pid_t pid)
     : _pid(pid), _iov{&_regs, sizeof(_regs)}, _regs{} {}
 
+cpu_gp_regs::cpu_gp_regs(const cpu_gp_regs &other) noexcept
+    : _pid(other._pid), _iov{&_regs, sizeof(_regs)}, _regs(other._regs) {}
+
+cpu_gp_regs &cpu_gp_regs::operator=(const cpu_gp_regs &other) noexcept {
+  _pid = other._pid;
+  _regs = other._regs;
+  return *this;
+}
+
+pid_t cpu_gp_regs::pid() const noexcept { return _pid; }
+
 tracer_error cpu_gp_regs::getregs() {
   int errnum;
   ptrace_wrapper &pw = ptrace_wrapper::instance;
@@ -75,6 +86,39 @@ void cpu_gp_regs::rewind_trap() noexcept {}
 
 #endif // __x86_64__ || __i386__
 
+// rewind the IP to the system call instruction the tracee has just returned
+// from and make it execute system call <number> instead once resumed
+
+#if defined(__x86_64__)
+
+void cpu_gp_regs::reenter_syscall(long number) noexcept {
+  // syscall is 2 bytes long
+  set_ip(get_ip() - 2);
+  _regs.rax = number;
+}
+
+#elif defined(__i386__)
+
+void cpu_gp_regs::reenter_syscall(long number) noexcept {
+  // int 0x80 is 2 bytes long
+  set_ip(get_ip() - 2);
+  _regs.eax = number;
+}
+
+#elif defined(__powerpc64__)
+
+void cpu_gp_regs::reenter_syscall(long number) noexcept {
+  // both sc and scv are 4 bytes long
+  set_ip(get_ip() - 4);
+  _regs.gpr[PT_R0] = number;
+}
+
+#else
+
+void cpu_gp_regs::reenter_syscall(long) noexcept {}
+
+#endif // defined(__x86_64__)
+
 #if defined(__x86_64__)
 
 syscall_entry cpu_gp_regs::get_syscall_entry() const noexcept {
@@ -101,20 +145,82 @@ syscall_entry cpu_gp_regs::get_syscall_entry() const noexcept {
 
 #endif // defined(__x86_64__)
 
+// load the registers with a system call to be executed by a system call
+// instruction, and retrieve its result (-errno on error) afterwards
+
+#if defined(__x86_64__)
+
+void cpu_gp_regs::set_syscall_entry(const syscall_entry &entry) noexcept {
+  _regs.rax = entry.number;
+  _regs.rdi = entry.args[0];
+  _regs.rsi = entry.args[1];
+  _regs.rdx = entry.args[2];
+  _regs.r10 = entry.args[3];
+  _regs.r8 = entry.args[4];
+  _regs.r9 = entry.args[5];
+}
+
+long cpu_gp_regs::get_syscall_return() const noexcept { return _regs.rax; }
+
+#elif defined(__i386__)
+
+void cpu_gp_regs::set_syscall_entry(const syscall_entry &entry) noexcept {
+  _regs.eax = entry.number;
+  _regs.ebx = entry.args[0];
+  _regs.ecx = entry.args[1];
+  _regs.edx = entry.args[2];
+  _regs.esi = entry.args[3];
+  _regs.edi = entry.args[4];
+  _regs.ebp = entry.args[5];
+}
+
+long cpu_gp_regs::get_syscall_return() const noexcept { return _regs.eax; }
+
+#elif defined(__powerpc64__)
+
+void cpu_gp_regs::set_syscall_entry(const syscall_entry &entry) noexcept {
+  _regs.gpr[PT_R0] = entry.number;
+  for (size_t ix = 0; ix < entry.args.size(); ix++)
+    _regs.gpr[PT_R3 + ix] = entry.args[ix];
+}
+
+long cpu_gp_regs::get_syscall_return() const noexcept {
+  // sc reports errors by setting the summary overflow bit of CR0
+  long ret = _regs.gpr[PT_R3];
+  return (_regs.ccr & 0x10000000) ? -ret : ret;
+}
+
+#endif // defined(__x86_64__)
+
 #if defined(__x86_64__)
 
 uintptr_t cpu_gp_regs::get_stack_pointer() const noexcept { return _regs.rsp; }
 
+// the return address is popped off the stack
+uintptr_t cpu_gp_regs::get_return_stack_pointer() const noexcept {
+  return _regs.rsp + sizeof(uint64_t);
+}
+
 #elif defined(__i386__)
 
 uintptr_t cpu_gp_regs::get_stack_pointer() const noexcept { return _regs.esp; }
 
+uintptr_t cpu_gp_regs::get_return_stack_pointer() const noexcept {
+  return _regs.esp + sizeof(uint32_t);
+}
+
 #elif defined(__powerpc64__)
 
 uintptr_t cpu_gp_regs::get_stack_pointer() const noexcept {
   return _regs.gpr[PT_R1];
 }
 
+// the return address is in the link register and the stack frame is only
+// allocated by the prologue of the function
+uintptr_t cpu_gp_regs::get_return_stack_pointer() const noexcept {
+  return _regs.gpr[PT_R1];
+}
+
 #else
 #error Unsupported architecture
 #endif // defined(__x86_64__)
@@ -135,6 +241,15 @@ cpu_gp_regs::get_return_address() const noexcept {
   return ret_addr;
 }
 
+tracer_error cpu_gp_regs::set_return_address(uintptr_t addr) noexcept {
+  ptrace_wrapper &pw = ptrace_wrapper::instance;
+  int error;
+  if (pw.ptrace(error, PTRACE_POKEDATA, _pid, get_stack_pointer(), addr) == -1)
+    return get_syserror(error, tracer_errcode::PTRACE_ERROR, _pid,
+                        "set_return_address: PTRACE_POKEDATA");
+  return tracer_error::success();
+}
+
 #elif defined(__powerpc64__)
 
 nonstd::expected<uintptr_t, tracer_error>
@@ -142,6 +257,12 @@ cpu_gp_regs::get_return_address() const noexcept {
   return _regs.link;
 }
 
+// the link register is only written to the tracee by setregs()
+tracer_error cpu_gp_regs::set_return_address(uintptr_t addr) noexcept {
+  _regs.link = addr;
+  return tracer_error::success();
+}
+
 #else
 #error Unsupported architecture detected
 #endif
@@ -35,17 +35,28 @@ private:
 public:
   cpu_gp_regs(pid_t pid);
 
+  cpu_gp_regs(const cpu_gp_regs &other) noexcept;
+  cpu_gp_regs &operator=(const cpu_gp_regs &other) noexcept;
+
+  pid_t pid() const noexcept;
+
   tracer_error getregs();
   tracer_error setregs();
 
   uintptr_t get_ip() const noexcept;
   void set_ip(uintptr_t addr) noexcept;
   void rewind_trap() noexcept;
+  void reenter_syscall(long number) noexcept;
   syscall_entry get_syscall_entry() const noexcept;
+  void set_syscall_entry(const syscall_entry &entry) noexcept;
+  long get_syscall_return() const noexcept;
 
   uintptr_t get_stack_pointer() const noexcept;
+  // the stack pointer of the caller once the function just entered returns
+  uintptr_t get_return_stack_pointer() const noexcept;
 
   nonstd::expected<uintptr_t, tracer_error> get_return_address() const noexcept;
+  tracer_error set_return_address(uintptr_t addr) noexcept;
 };
 
 } // namespace tep
@@ -0,0 +1,175 @@
+// sample_clock.cpp
+
+#include "sample_clock.hpp"
+#include "log.hpp"
+
+#include <cinttypes>
+#include <ctime>
+#include <thread>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif // defined(__x86_64__) || defined(__i386__)
+
+using namespace tep;
+
+namespace {
+__extension__ using int128 = __int128;
+
+// the counter is calibrated over this long, which bounds its error to a few
+// parts per million
+constexpr std::chrono::milliseconds calibration_time(50);
+// the attempts at reading two clocks together, of which the closest is kept
+constexpr int pairing_attempts = 8;
+
+int64_t clock_ns(clockid_t id) noexcept {
+  timespec ts;
+  clock_gettime(id, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+uint64_t read_counter() noexcept { return __rdtsc(); }
+
+// the counter ticks at a constant rate regardless of frequency changes and
+// sleep states, as reported by CPUID.80000007H:EDX[8]
+bool counter_invariant() noexcept {
+  unsigned int eax, ebx, ecx, edx;
+  return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u << 8));
+}
+#elif defined(__powerpc64__)
+uint64_t read_counter() noexcept { return __builtin_ppc_get_timebase(); }
+
+// the time base always ticks at a constant rate
+bool counter_invariant() noexcept { return true; }
+#else
+uint64_t read_counter() noexcept { return 0; }
+
+bool counter_invariant() noexcept { return false; }
+#endif // defined(__x86_64__) || defined(__i386__)
+
+// nanoseconds = base_ns + (ticks - base_ticks) * mult / 2^32
+struct counter_conversion {
+  uint64_t base_ticks;
+  int64_t base_ns;
+  uint64_t mult;
+};
+
+sample_clock::source current_source = sample_clock::default_source;
+counter_conversion conversion{0, 0, 0};
+sample_clock::reference start_reference{};
+
+int64_t counter_ns() noexcept {
+  auto ticks = static_cast<int64_t>(read_counter() - conversion.base_ticks);
+  return conversion.base_ns +
+         static_cast<int64_t>(static_cast<int128>(ticks) * conversion.mult >>
+                              32);
+}
+
+// reads <first> in between two readings of <second> until they are closest
+// together, and pairs it with their midpoint
+template <typename First, typename Second>
+auto read_together(First first, Second second) {
+  std::pair<decltype(first()), decltype(second())> best{};
+  decltype(second() - second()) gap{};
+  for (int i = 0; i < pairing_attempts; i++) {
+    auto before = second();
+    auto value = first();
+    auto after = second();
+    if (!i || after - before < gap) {
+      gap = after - before;
+      best = {value, before + (after - before) / 2};
+    }
+  }
+  return best;
+}
+
+bool calibrate_counter() {
+  auto raw = []() { return clock_ns(CLOCK_MONOTONIC_RAW); };
+  auto [ticks0, ns0] = read_together(read_counter, raw);
+  std::this_thread::sleep_for(calibration_time);
+  auto [ticks1, ns1] = read_together(read_counter, raw);
+  if (ticks1 <= ticks0 || ns1 <= ns0)
+    return false;
+  conversion = counter_conversion{
+      ticks1, ns1, (static_cast<uint64_t>(ns1 - ns0) << 32) / (ticks1 - ticks0)};
+  log::logline(log::info,
+               "calibrated time-stamp counter: %" PRIu64 " ticks in %" PRId64
+               " ns",
+               ticks1 - ticks0, ns1 - ns0);
+  return true;
+}
+} // namespace
+
+#ifdef TEP_USE_SYSTEM_CLOCK
+const sample_clock::source sample_clock::default_source = source::system;
+#else
+const sample_clock::source sample_clock::default_source = source::steady;
+#endif // TEP_USE_SYSTEM_CLOCK
+
+sample_clock::time_point sample_clock::now() noexcept {
+  switch (current_source) {
+  case source::steady:
+    return time_point(duration(clock_ns(CLOCK_MONOTONIC)));
+  case source::system:
+    return time_point(duration(clock_ns(CLOCK_REALTIME)));
+  case source::monotonic_raw:
+    return time_point(duration(clock_ns(CLOCK_MONOTONIC_RAW)));
+  case source::tsc:
+    return time_point(duration(counter_ns()));
+  }
+  return time_point();
+}
+
+bool sample_clock::select(source src) {
+  if (src == source::tsc) {
+    if (!counter_invariant()) {
+      log::logline(log::error, "time-stamp counter is not invariant");
+      return false;
+    }
+    if (!calibrate_counter()) {
+      log::logline(log::error, "error calibrating time-stamp counter");
+      return false;
+    }
+  }
+  current_source = src;
+  auto [timestamp, realtime] =
+      read_together(now, std::chrono::system_clock::now);
+  start_reference = reference{timestamp, realtime};
+  log::logline(log::info, "sample timestamps taken from %s clock",
+               to_string(src));
+  return true;
+}
+
+sample_clock::source sample_clock::selected() noexcept {
+  return current_source;
+}
+
+const sample_clock::reference &sample_clock::start() noexcept {
+  return start_reference;
+}
+
+const char *sample_clock::to_string(source src) noexcept {
+  switch (src) {
+  case source::steady:
+    return "steady";
+  case source::system:
+    return "system";
+  case source::monotonic_raw:
+    return "monotonic-raw";
+  case source::tsc:
+    return "tsc";
+  }
+  return "unknown";
+}
+
+std::optional<sample_clock::source>
+sample_clock::from_string(std::string_view str) noexcept {
+  for (source src : {source::steady, source::system, source::monotonic_raw,
+                     source::tsc})
+    if (str == to_string(src))
+      return src;
+  return std::nullopt;
+}
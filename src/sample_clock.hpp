@@ -0,0 +1,58 @@
+// sample_clock.hpp
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+
+namespace tep {
+
+// the clock of the timestamps of the samples, whose source is selected at
+// runtime; every source counts nanoseconds since its own epoch, which is
+// related to the time of day by the reference taken when it is selected
+class sample_clock {
+public:
+  using rep = int64_t;
+  using period = std::nano;
+  using duration = std::chrono::nanoseconds;
+  using time_point = std::chrono::time_point<sample_clock>;
+  // all sources but the system clock are
+  static constexpr bool is_steady = false;
+
+  enum class source {
+    // CLOCK_MONOTONIC
+    steady,
+    // CLOCK_REALTIME
+    system,
+    // CLOCK_MONOTONIC_RAW, which is not slewed by NTP
+    monotonic_raw,
+    // the invariant time-stamp counter (or the time base on POWER), converted
+    // to the nanoseconds of CLOCK_MONOTONIC_RAW as calibrated against it
+    tsc,
+  };
+
+  // a timestamp and the time of day at which it was taken
+  struct reference {
+    time_point timestamp;
+    std::chrono::system_clock::time_point realtime;
+  };
+
+  // the source used unless another is selected
+  static const source default_source;
+
+  static time_point now() noexcept;
+
+  // selects the source of all timestamps taken afterwards, which must be
+  // before any other thread takes one; returns false if it is unavailable
+  static bool select(source);
+  static source selected() noexcept;
+  // the reference taken when the source was selected
+  static const reference &start() noexcept;
+
+  static const char *to_string(source) noexcept;
+  static std::optional<source> from_string(std::string_view) noexcept;
+};
+
+} // namespace tep
@@ -3,10 +3,93 @@
 #include "sampler.hpp"
 #include "log.hpp"
 
+#include <algorithm>
 #include <cassert>
+#include <cinttypes>
+#include <vector>
 
 using namespace tep;
 
+namespace {
+// the changes of the readings from which the period of the updates is told,
+// and the longest they are polled for
+constexpr size_t update_changes = 16;
+constexpr std::chrono::milliseconds update_timeout(250);
+// how long after the expected update of the sensors they are sampled, and by
+// how much later they are sampled whenever they did not update yet
+constexpr std::chrono::microseconds update_margin(20);
+constexpr int update_lag_steps = 16;
+
+// the shortest multiple of the period of the updates which is no shorter than
+// the period of sampling, to the microsecond
+std::chrono::microseconds
+locked_period(const std::chrono::microseconds &period,
+              const std::optional<sensor_updates> &updates) {
+  if (!updates)
+    return period;
+  auto update_period = std::max(
+      std::chrono::microseconds(1),
+      std::chrono::round<std::chrono::microseconds>(updates->period));
+  auto periods = std::max<std::chrono::microseconds::rep>(
+      1, (period.count() + update_period.count() - 1) / update_period.count());
+  return periods * update_period;
+}
+} // namespace
+
+std::optional<sensor_updates>
+tep::detect_sensor_updates(const nrgprf::reader *reader) {
+  using clock = sampling_task::clock;
+  assert(reader != nullptr);
+  nrgprf::sample previous;
+  nrgprf::sample current;
+  if (std::error_code ec; !reader->read(previous, ec)) {
+    log::logline(log::error, "%s: error when reading counters: %s", __func__,
+                 ec.message().c_str());
+    return std::nullopt;
+  }
+  // the readings changed at the latest when they were read
+  std::vector<clock::time_point> changes;
+  changes.reserve(update_changes);
+  clock::time_point timeout = clock::now() + update_timeout;
+  while (changes.size() < update_changes) {
+    if (std::error_code ec; !reader->read(current, ec)) {
+      log::logline(log::error, "%s: error when reading counters: %s", __func__,
+                   ec.message().c_str());
+      return std::nullopt;
+    }
+    clock::time_point now = clock::now();
+    if (current != previous) {
+      changes.push_back(now);
+      previous = current;
+    }
+    if (now >= timeout)
+      break;
+  }
+  // at least two periods between changes
+  if (changes.size() < 3) {
+    log::logline(log::warning,
+                 "%s: readings changed %zu times in %" PRId64
+                 " ms, their updates are not periodic",
+                 __func__, changes.size(),
+                 static_cast<int64_t>(update_timeout.count()));
+    return std::nullopt;
+  }
+  // the median is unaffected by the changes seen late due to preemption
+  std::vector<clock::duration> periods;
+  periods.reserve(changes.size() - 1);
+  for (size_t i = 1; i < changes.size(); i++)
+    periods.push_back(changes[i] - changes[i - 1]);
+  auto median = periods.begin() + periods.size() / 2;
+  std::nth_element(periods.begin(), median, periods.end());
+  log::logline(log::info, "%s: readings are updated every %" PRId64 " us",
+               __func__,
+               static_cast<int64_t>(
+                   std::chrono::duration_cast<std::chrono::microseconds>(
+                       *median)
+                       .count()));
+  return sensor_updates{changes.back(), *median};
+}
+
 sampler_promise sampler_interface::run() & {
   return [this]() { return results(); };
 }
@@ -92,105 +175,194 @@ sampler_expected async_sampler_fn::results() {
 }
 
 periodic_sampler::periodic_sampler(const nrgprf::reader *r,
-                                   const std::chrono::milliseconds &period)
-    : async_sampler(r), _finished(false), _period(period), _sig(false) {
-  _future = std::async(std::launch::async, [this]() {
-    log::logline(log::debug, "periodic_sampler: waiting to start");
-    _sig.wait();
-    return async_work();
-  });
-}
+                                   const std::chrono::microseconds &period)
+    : sampler(r), _period(period), _samples(0), _error(), _subscribed(false) {}
 
 periodic_sampler::~periodic_sampler() {
-  if (_future.valid()) {
-    _finished = true;
-    _sig.post();
-    _future.wait();
-  }
+  if (_subscribed)
+    sampling_service::instance.unsubscribe(*this);
 }
 
 sampler_promise periodic_sampler::run() & {
-  _sig.post();
-  return async_sampler::run();
+  // the first sample is taken by the sampling service
+  sampling_service::instance.subscribe(*this);
+  _subscribed = true;
+  return sampler::run();
 }
 
 sampler_expected periodic_sampler::run() && {
-  return std::move(*this).async_sampler::run();
+  return std::move(*this).sampler::run();
 }
 
-sampler_expected periodic_sampler::results() {
-  assert(!_finished && _future.valid());
-  _finished = true;
-  _sig.post();
-  return _future.get();
+const std::chrono::microseconds &periodic_sampler::period() const {
+  return _period;
 }
 
-bool periodic_sampler::finished() const { return _finished; }
+bool periodic_sampler::sample() noexcept {
+  if (!read_sample(_samples == 0, _error)) {
+    log::logline(log::error, "%s: error when reading counters: %s", __func__,
+                 _error.message().c_str());
+    return false;
+  }
+  _samples++;
+  return true;
+}
 
-const std::chrono::milliseconds &periodic_sampler::period() const {
+sampling_task::clock::duration periodic_sampler::interval() const noexcept {
   return _period;
 }
 
-const std::chrono::milliseconds bounded_ps::default_period(30000);
-const std::chrono::milliseconds unbounded_ps::default_period(10);
+sampler_expected periodic_sampler::results() {
+  assert(_subscribed);
+  sampling_service::instance.unsubscribe(*this);
+  _subscribed = false;
+  // no longer drained by the sampling service, so that there is room for
+  // the last sample
+  drain();
+  // the last sample, and the first if the section ended before it was taken
+  do {
+    if (_error || !sample())
+      return sampler_expected(nonstd::unexpect, _error);
+  } while (_samples < 2);
+  if (overruns())
+    log::logline(log::warning, "%s: %" PRIu64 " samples not taken in time",
+                 __func__, overruns());
+  log::logline(log::success, "%s: finished evaluation with %zu samples",
+               __func__, _samples);
+  return take_samples();
+}
+
+const std::chrono::microseconds
+    bounded_ps::default_period(std::chrono::milliseconds(30000));
+const std::chrono::microseconds
+    unbounded_ps::default_period(std::chrono::milliseconds(10));
 const size_t unbounded_ps::default_initial_size(384);
+const size_t unbounded_ps::max_ring_capacity(512);
 
 bounded_ps::bounded_ps(const nrgprf::reader *reader,
-                       const std::chrono::milliseconds &period)
+                       const std::chrono::microseconds &period)
     : periodic_sampler(reader, period) {}
 
-sampler_expected bounded_ps::async_work() {
-  _first.timestamp = timed_sample::clock::now();
-  if (std::error_code ec; !reader()->read(_first, ec)) {
-    log::logline(log::error, "%s: error when reading counters: %s", __func__,
-                 ec.message().c_str());
-    return sampler_expected(nonstd::unexpect, ec);
-  }
-  while (!finished()) {
-    _sig.wait_for(period());
-    _last.timestamp = timed_sample::clock::now();
-    if (std::error_code ec; !reader()->read(_last, ec)) {
-      log::logline(log::error, "%s: error when reading counters: %s", __func__,
-                   ec.message().c_str());
-      return sampler_expected(nonstd::unexpect, ec);
-      ;
-    }
-  };
-  log::logline(log::success, "%s: finished evaluation with %zu samples",
-               __func__, 2);
+bool bounded_ps::read_sample(bool first, std::error_code &ec) {
+  timed_sample &smp = first ? _first : _last;
+  smp.timestamp = timed_sample::clock::now();
+  return reader()->read(smp, ec);
+}
+
+sampler_expected bounded_ps::take_samples() {
   return timed_execution{std::move(_first), std::move(_last)};
 }
 
 unbounded_ps::unbounded_ps(const nrgprf::reader *r, size_t initial_size,
-                           const std::chrono::milliseconds &period)
-    : periodic_sampler(r, period) {
+                           const std::chrono::microseconds &period,
+                           size_t max_samples,
+                           const std::optional<sensor_updates> &updates)
+    : periodic_sampler(r, locked_period(period, updates)),
+      // a section expected to take fewer samples needs a smaller ring
+      _ring(std::clamp(initial_size, size_t(2), max_ring_capacity)), _exec(),
+      _dropped(0), _updates(updates), _lag(0), _previous(), _unchanged(0),
+      _pending(false), _max_samples(max_samples), _stride(1), _drained(0),
+      _provisional(false) {
+  assert(!_max_samples || _max_samples > 1);
+  if (_max_samples)
+    initial_size = std::min(initial_size, _max_samples + 1);
   if (initial_size > 0)
     _exec.reserve(initial_size);
 }
 
-sampler_expected unbounded_ps::async_work() {
-  do {
-    auto &smp = _exec.emplace_back();
-    smp.timestamp = timed_sample::clock::now();
-    if (std::error_code ec; !reader()->read(smp, ec)) {
-      log::logline(log::error, "%s: error when reading counters: %s", __func__,
-                   ec.message().c_str());
-      return sampler_expected(nonstd::unexpect, ec);
-      ;
+bool unbounded_ps::read_sample(bool first, std::error_code &ec) {
+  timed_sample *smp = _ring.reserve();
+  // the drain thread fell behind by a whole ring
+  if (!smp) {
+    _dropped++;
+    return true;
+  }
+  smp->timestamp = timed_sample::clock::now();
+  if (!reader()->read(*smp, ec))
+    return false;
+  if (_updates) {
+    // the sensors did not update yet, so they are sampled later from now on;
+    // the sample is overwritten by the next one unless it is the last
+    if (!first && smp->sample == _previous) {
+      _unchanged++;
+      _pending = true;
+      _lag = (_lag + _updates->period / update_lag_steps) % _updates->period;
+      return true;
     }
-    _sig.wait_for(period());
-  } while (!finished());
-
-  auto &smp = _exec.emplace_back();
-  smp.timestamp = timed_sample::clock::now();
-  if (std::error_code ec; !reader()->read(smp, ec)) {
-    log::logline(log::error, "%s: error when reading counters: %s", __func__,
-                 ec.message().c_str());
-    return sampler_expected(nonstd::unexpect, ec);
-    ;
+    _previous = smp->sample;
+    _pending = false;
   }
+  _ring.commit();
+  return true;
+}
 
-  log::logline(log::success, "%s: finished evaluation with %zu samples",
-               __func__, _exec.size());
+sampler_expected unbounded_ps::take_samples() {
+  // the last sample ends the execution, whether it changed or not
+  if (_pending) {
+    _ring.commit();
+    _pending = false;
+  }
+  drain();
+  if (_dropped)
+    log::logline(log::warning, "%s: %" PRIu64 " samples dropped", __func__,
+                 _dropped);
+  if (_unchanged)
+    log::logline(log::info, "%s: %" PRIu64 " samples unchanged", __func__,
+                 _unchanged);
+  if (_stride > 1)
+    log::logline(log::info, "%s: kept %zu of %zu samples, one every %zu",
+                 __func__, _exec.size(), _drained, _stride);
   return std::move(_exec);
 }
+
+bool unbounded_ps::backlogged() const noexcept {
+  return _ring.size() >= _ring.capacity() / 2;
+}
+
+void unbounded_ps::drain() noexcept {
+  while (timed_sample *smp = _ring.front()) {
+    keep(std::move(*smp));
+    _ring.pop();
+  }
+}
+
+sampling_service::clock::time_point unbounded_ps::align(
+    sampling_service::clock::time_point deadline) const noexcept {
+  if (!_updates)
+    return deadline;
+  // just after the update of the sensors expected nearest to <deadline>,
+  // which is a whole number of updates after the previous deadline
+  auto period = _updates->period;
+  auto offset = (deadline - (_updates->last + _lag + update_margin)) % period;
+  if (offset > period / 2)
+    offset -= period;
+  else if (offset < -period / 2)
+    offset += period;
+  return deadline - offset;
+}
+
+void unbounded_ps::keep(timed_sample &&smp) {
+  // the last sample kept provisionally is superseded by any later one
+  if (_provisional)
+    _exec.back() = std::move(smp);
+  else
+    _exec.push_back(std::move(smp));
+  _provisional = _drained++ % _stride != 0;
+  if (_max_samples && _exec.size() > _max_samples)
+    decimate();
+}
+
+void unbounded_ps::decimate() {
+  // the samples kept are those at even positions, which are now a multiple
+  // of twice the stride apart, and the last one
+  size_t regular = _exec.size() - _provisional;
+  size_t kept = 1;
+  for (size_t i = 2; i < regular; i += 2)
+    _exec[kept++] = std::move(_exec[i]);
+  bool last_dropped = regular % 2 == 0;
+  if (_provisional || last_dropped)
+    _exec[kept++] = std::move(_exec.back());
+  _exec.resize(kept);
+  _provisional = _provisional || last_dropped;
+  _stride *= 2;
+}
@@ -2,7 +2,8 @@
 
 #pragma once
 
-#include "signaler.hpp"
+#include "sampling_service.hpp"
+#include "spsc_ring.hpp"
 #include "timed_sample.hpp"
 
 #include <nonstd/expected.hpp>
@@ -11,12 +12,23 @@
 
 #include <atomic>
 #include <future>
+#include <optional>
 
 namespace tep {
 
 using sampler_expected = nonstd::expected<timed_execution, std::error_code>;
 using sampler_promise = std::function<sampler_expected()>;
 
+// when the sensors of a reader update their readings, which is periodically
+struct sensor_updates {
+  sampling_task::clock::time_point last;
+  sampling_task::clock::duration period;
+};
+
+// polls <reader> for long enough to see its readings change several times;
+// nothing if they do not change often enough to tell their period
+std::optional<sensor_updates> detect_sensor_updates(const nrgprf::reader *);
+
 // sampler_interface
 
 class sampler_interface {
@@ -127,41 +139,47 @@ private:
 
 class async_sampler_fn final : public sampler_interface {
 private:
-  std::unique_ptr<async_sampler> _sampler;
+  std::unique_ptr<sampler_interface> _sampler;
   std::function<void()> _work;
 
 public:
   template <typename Callable>
-  async_sampler_fn(std::unique_ptr<async_sampler> &&as, Callable &&work)
+  async_sampler_fn(std::unique_ptr<sampler_interface> &&as, Callable &&work)
       : _sampler(std::move(as)), _work(std::forward<Callable>(work)) {}
 
 private:
   sampler_expected results() override;
 };
 
-class periodic_sampler : public async_sampler {
+// samples periodically through the sampling service once run, and once more
+// when its results are retrieved
+class periodic_sampler : public sampler, private sampling_task {
 private:
-  std::atomic_bool _finished;
-  std::chrono::milliseconds _period;
-
-protected:
-  signaler _sig;
+  std::chrono::microseconds _period;
+  size_t _samples;
+  std::error_code _error;
+  bool _subscribed;
 
 public:
   periodic_sampler(const nrgprf::reader *,
-                   const std::chrono::milliseconds &period);
+                   const std::chrono::microseconds &period);
 
   ~periodic_sampler();
 
   sampler_promise run() & override;
   sampler_expected run() && override;
 
-  const std::chrono::milliseconds &period() const;
+  const std::chrono::microseconds &period() const;
 
 protected:
-  bool finished() const;
+  // reads a sample, into the first one if none was read yet
+  virtual bool read_sample(bool first, std::error_code &ec) = 0;
+  virtual sampler_expected take_samples() = 0;
 
 private:
+  bool sample() noexcept override;
+  clock::duration interval() const noexcept override;
+
   sampler_expected results() override;
 };
 
@@ -171,29 +189,67 @@ private:
   timed_sample _last;
 
 public:
-  static const std::chrono::milliseconds default_period;
+  static const std::chrono::microseconds default_period;
 
   bounded_ps(const nrgprf::reader *,
-             const std::chrono::milliseconds &period = default_period);
+             const std::chrono::microseconds &period = default_period);
 
 protected:
-  sampler_expected async_work() override;
+  bool read_sample(bool first, std::error_code &ec) override;
+  sampler_expected take_samples() override;
 };
 
+// hands its samples over to the drain thread of the sampling service through
+// a ring, instead of appending them to a growing execution while sampling;
+// if the samples kept are bounded, every other sample is discarded whenever
+// the bound is reached and only every other one is kept thereafter, always
+// keeping the first and last samples, so that the energy consumed between any
+// two samples kept, and in total, remains exact; if the updates of the
+// sensors are known, samples are taken just after them, at most once per
+// update, and those whose readings did not change are not kept
 class unbounded_ps final : public periodic_sampler {
 private:
+  spsc_ring<timed_sample> _ring;
   timed_execution _exec;
+  uint64_t _dropped;
+  std::optional<sensor_updates> _updates;
+  // how much later than expected the sensors have been found to update
+  sampling_service::clock::duration _lag;
+  // the readings of the last sample kept
+  nrgprf::sample _previous;
+  uint64_t _unchanged;
+  // whether the last sample was read but not kept, since it was unchanged
+  bool _pending;
+  // the most samples kept, or 0 if unbounded
+  size_t _max_samples;
+  // only samples a multiple of <_stride> apart from the first are kept, and
+  // the last one, which is kept provisionally otherwise
+  size_t _stride;
+  size_t _drained;
+  bool _provisional;
 
 public:
-  static const std::chrono::milliseconds default_period;
+  static const std::chrono::microseconds default_period;
   static const size_t default_initial_size;
+  static const size_t max_ring_capacity;
 
   unbounded_ps(const nrgprf::reader *,
                size_t initial_size = default_initial_size,
-               const std::chrono::milliseconds &period = default_period);
+               const std::chrono::microseconds &period = default_period,
+               size_t max_samples = 0,
+               const std::optional<sensor_updates> &updates = std::nullopt);
 
 protected:
-  sampler_expected async_work() override;
+  bool read_sample(bool first, std::error_code &ec) override;
+  sampler_expected take_samples() override;
+
+private:
+  bool backlogged() const noexcept override;
+  void drain() noexcept override;
+  sampling_service::clock::time_point
+  align(sampling_service::clock::time_point deadline) const noexcept override;
+  void keep(timed_sample &&);
+  void decimate();
 };
 
 } // namespace tep
@@ -0,0 +1,295 @@
+// sampling_service.cpp
+
+#include "sampling_service.hpp"
+#include "log.hpp"
+#include "util.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/prctl.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+using namespace tep;
+
+namespace {
+// steady_clock is CLOCK_MONOTONIC on Linux
+timespec to_timespec(sampling_service::clock::time_point tp) {
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                tp.time_since_epoch())
+                .count();
+  return timespec{static_cast<time_t>(ns / 1000000000),
+                  static_cast<long>(ns % 1000000000)};
+}
+
+// hints the core that it is busy-waiting, which frees its resources for the
+// other hardware thread of the core and avoids a pipeline flush on exit
+void spin_pause() noexcept {
+#if defined(__x86_64__)
+  __builtin_ia32_pause();
+#elif defined(__powerpc64__)
+  // low, then medium priority of the hardware thread
+  asm volatile("or 1,1,1\n\tor 2,2,2" ::: "memory");
+#endif // defined(__x86_64__)
+}
+} // namespace
+
+sampling_service sampling_service::instance;
+
+sampling_service::sampling_service()
+    : _mx(), _cv(), _tasks(), _current(nullptr), _drain_cv(),
+      _backlog(), _draining(nullptr), _stop(false), _spin(0), _cpu(),
+      _priority(), _lateness(), _overruns(0),
+      _timerfd(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC)),
+      _eventfd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)), _woken(false),
+      _thread(), _drainer() {}
+
+sampling_service::~sampling_service() {
+  {
+    std::scoped_lock lock(_mx);
+    _stop = true;
+  }
+  wake();
+  _drain_cv.notify_one();
+  if (_thread.joinable())
+    _thread.join();
+  if (_drainer.joinable())
+    _drainer.join();
+  if (_timerfd != -1)
+    close(_timerfd);
+  if (_eventfd != -1)
+    close(_eventfd);
+}
+
+void sampling_service::spin(clock::duration spin) {
+  std::scoped_lock lock(_mx);
+  _spin = spin;
+}
+
+void sampling_service::pin(std::optional<unsigned int> cpu) {
+  std::scoped_lock lock(_mx);
+  _cpu = cpu;
+}
+
+void sampling_service::priority(std::optional<int> priority) {
+  std::scoped_lock lock(_mx);
+  _priority = priority;
+}
+
+running_stats sampling_service::lateness() const {
+  std::scoped_lock lock(_mx);
+  return _lateness;
+}
+
+uint64_t sampling_service::overruns() const {
+  std::scoped_lock lock(_mx);
+  return _overruns;
+}
+
+void sampling_service::subscribe(sampling_task &task) {
+  {
+    std::scoped_lock lock(_mx);
+    // created once the first sampler starts, not when the program does
+    if (!_thread.joinable()) {
+      _thread = std::thread(&sampling_service::run, this);
+      _drainer = std::thread(&sampling_service::run_drainer, this);
+    }
+    _tasks.push_back(entry{clock::now(), &task});
+    std::push_heap(_tasks.begin(), _tasks.end(), later);
+  }
+  wake();
+}
+
+void sampling_service::unsubscribe(const sampling_task &task) {
+  std::unique_lock lock(_mx);
+  // a task being sampled is subscribed again afterwards
+  _cv.wait(lock, [this, &task] {
+    return _current != &task && _draining != &task;
+  });
+  _backlog.erase(std::remove(_backlog.begin(), _backlog.end(), &task),
+                 _backlog.end());
+  auto it = std::find_if(_tasks.begin(), _tasks.end(),
+                         [&task](const entry &e) { return e.task == &task; });
+  if (it != _tasks.end()) {
+    _tasks.erase(it);
+    std::make_heap(_tasks.begin(), _tasks.end(), later);
+  }
+}
+
+// the heap functions build a max-heap
+bool sampling_service::later(const entry &lhs, const entry &rhs) noexcept {
+  return lhs.deadline > rhs.deadline;
+}
+
+void sampling_service::wake() const noexcept {
+  uint64_t one = 1;
+  _woken.store(true, std::memory_order_release);
+  // the counter only saturates if the thread is not waiting anyway
+  if (write(_eventfd, &one, sizeof(one)) == -1 && errno != EAGAIN)
+    log::logline(log::error, "[%d] error waking sampling service: %s",
+                 gettid(), strerror(errno));
+}
+
+bool sampling_service::wait_until(clock::time_point deadline,
+                                  clock::duration spin) const {
+  clock::time_point wakeup = deadline - spin;
+  if (_woken.exchange(false, std::memory_order_acquire)) {
+    uint64_t count;
+    [[maybe_unused]] auto ret = read(_eventfd, &count, sizeof(count));
+    return false;
+  }
+  if (clock::now() < wakeup) {
+    // a disarmed timer never expires
+    itimerspec its{};
+    if (deadline != clock::time_point::max())
+      its.it_value = to_timespec(wakeup);
+    if (timerfd_settime(_timerfd, TFD_TIMER_ABSTIME, &its, nullptr) == -1) {
+      log::logline(log::error, "[%d] timerfd_settime: %s", gettid(),
+                   strerror(errno));
+      return false;
+    }
+    pollfd fds[] = {{_timerfd, POLLIN, 0}, {_eventfd, POLLIN, 0}};
+    if (poll(fds, 2, -1) == -1) {
+      if (errno != EINTR)
+        log::logline(log::error, "[%d] poll: %s", gettid(), strerror(errno));
+      return false;
+    }
+    uint64_t count;
+    if (fds[1].revents & POLLIN) {
+      _woken.store(false, std::memory_order_relaxed);
+      [[maybe_unused]] auto ret = read(_eventfd, &count, sizeof(count));
+      return false;
+    }
+    [[maybe_unused]] auto ret = read(_timerfd, &count, sizeof(count));
+  }
+  // the last stretch, if any, is busy-waited for, unless a task with an
+  // earlier deadline is subscribed in the meantime
+  while (clock::now() < deadline) {
+    if (_woken.load(std::memory_order_relaxed) ||
+        _stop.load(std::memory_order_relaxed))
+      return false;
+    spin_pause();
+  }
+  return true;
+}
+
+void sampling_service::setup_thread() const {
+  // the timers expire as close to the deadlines as possible instead of being
+  // coalesced with others; the default slack is 50 microseconds
+  if (prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL) == -1)
+    log::logline(log::warning, "[%d] error setting timer slack: %s", gettid(),
+                 strerror(errno));
+  if (_priority) {
+    sched_param param{};
+    param.sched_priority = *_priority;
+    if (int err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param))
+      log::logline(log::warning,
+                   "[%d] error setting SCHED_FIFO priority %d of sampling "
+                   "service: %s",
+                   gettid(), *_priority, strerror(err));
+    else
+      log::logline(log::info,
+                   "[%d] set SCHED_FIFO priority %d of sampling service",
+                   gettid(), *_priority);
+  }
+  if (!_cpu)
+    return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(*_cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) == -1)
+    log::logline(log::warning,
+                 "[%d] error pinning sampling service to CPU %u: %s", gettid(),
+                 *_cpu, strerror(errno));
+  else
+    log::logline(log::info, "[%d] pinned sampling service to CPU %u", gettid(),
+                 *_cpu);
+}
+
+void sampling_service::run() {
+  log::logline(log::debug, "[%d] started sampling service", gettid());
+  if (_timerfd == -1 || _eventfd == -1) {
+    log::logline(log::error, "[%d] error creating sampling service timers",
+                 gettid());
+    return;
+  }
+  std::unique_lock lock(_mx);
+  setup_thread();
+  while (!_stop) {
+    clock::time_point deadline =
+        _tasks.empty() ? clock::time_point::max() : _tasks.front().deadline;
+    if (clock::now() < deadline) {
+      // woken up early if a task with an earlier deadline is subscribed
+      clock::duration spin = _spin;
+      if (!_tasks.empty() && _tasks.front().task->interval() < spin_threshold)
+        spin = std::max(spin, _spin > clock::duration::zero() || _cpu
+                                  ? _tasks.front().task->interval()
+                                  : spin_tail);
+      lock.unlock();
+      bool reached = wait_until(deadline, spin);
+      lock.lock();
+      // the task may also have been unsubscribed from in the meantime
+      if (!reached || _tasks.empty() || _tasks.front().deadline != deadline)
+        continue;
+    }
+    std::pop_heap(_tasks.begin(), _tasks.end(), later);
+    sampling_task *task = _tasks.back().task;
+    _tasks.pop_back();
+    _current = task;
+    lock.unlock();
+    clock::duration late = clock::now() - deadline;
+    bool resubscribe = task->sample();
+    // the deadlines which passed while sampling are skipped
+    clock::time_point now = clock::now();
+    clock::duration interval = task->interval();
+    clock::time_point next = deadline + interval;
+    uint64_t missed = 0;
+    if (next <= now && interval > clock::duration::zero()) {
+      missed = (now - next) / interval + 1;
+      task->_overruns += missed;
+      next += missed * interval;
+    }
+    next = task->align(next);
+    lock.lock();
+    _current = nullptr;
+    _lateness.add(static_cast<double>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(late).count()));
+    _overruns += missed;
+    if (resubscribe) {
+      _tasks.push_back(entry{next, task});
+      std::push_heap(_tasks.begin(), _tasks.end(), later);
+      if (task->backlogged() && task != _draining &&
+          std::find(_backlog.begin(), _backlog.end(), task) == _backlog.end()) {
+        _backlog.push_back(task);
+        _drain_cv.notify_one();
+      }
+    }
+    _cv.notify_all();
+  }
+  log::logline(log::debug, "[%d] stopped sampling service", gettid());
+}
+
+void sampling_service::run_drainer() {
+  log::logline(log::debug, "[%d] started sampling drain thread", gettid());
+  std::unique_lock lock(_mx);
+  while (true) {
+    _drain_cv.wait(lock, [this] { return _stop || !_backlog.empty(); });
+    if (_stop)
+      break;
+    sampling_task *task = _backlog.front();
+    _backlog.erase(_backlog.begin());
+    _draining = task;
+    lock.unlock();
+    task->drain();
+    lock.lock();
+    _draining = nullptr;
+    _cv.notify_all();
+  }
+  log::logline(log::debug, "[%d] stopped sampling drain thread", gettid());
+}
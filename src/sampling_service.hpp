@@ -0,0 +1,149 @@
+// sampling_service.hpp
+
+#pragma once
+
+#include "aggregate.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+namespace tep {
+
+// a periodic sampling of the sampling service
+class sampling_task {
+public:
+  using clock = std::chrono::steady_clock;
+
+  virtual ~sampling_task() = default;
+
+  // takes a sample; returns false if no further samples are to be taken
+  virtual bool sample() noexcept = 0;
+  virtual clock::duration interval() const noexcept = 0;
+
+  // whether the samples taken so far should be handed over to the drain
+  // thread, which then calls drain() away from the sampling thread
+  virtual bool backlogged() const noexcept { return false; }
+  virtual void drain() noexcept {}
+
+  // the deadline at which the sample due at <deadline> is taken instead,
+  // e.g. to take samples in phase with the updates of a sensor
+  virtual clock::time_point align(clock::time_point deadline) const noexcept {
+    return deadline;
+  }
+
+  // the number of samples which were not taken because the previous one
+  // was taken too late, e.g. because the reader took longer than an interval
+  uint64_t overruns() const noexcept { return _overruns; }
+
+private:
+  friend class sampling_service;
+  uint64_t _overruns = 0;
+};
+
+// takes the samples of all periodic samplers from a single long-lived thread,
+// ordered by their deadlines, so that starting the sampling of a section only
+// enqueues it instead of creating a thread for each execution of the section;
+// the deadlines of a task are absolute, an interval apart from its first
+// sample, so that the time taken to sample does not accumulate; the samples
+// of backlogged tasks are consumed by a second thread, so that the sampling
+// thread never allocates to store them
+class sampling_service {
+public:
+  using clock = sampling_task::clock;
+
+  // tasks sampled more often than this are busy-waited for throughout their
+  // interval if a core was dedicated to the thread, i.e. if it spins or is
+  // pinned, since waking up from a sleep alone takes tens of microseconds;
+  // otherwise, only the last spin_tail before their deadlines is;
+  // waking up from a timerfd took 6 us at the median and 14 us at the 99th
+  // percentile with a timer slack of 1 ns, and the default slack alone is
+  // 50 us, i.e. up to 5% of an interval of 1 ms, which is also about how
+  // often the RAPL energy counters are updated, so that sampling them more
+  // often only pays off if the samples are on time
+  static constexpr clock::duration spin_threshold =
+      std::chrono::milliseconds(1);
+  static constexpr clock::duration spin_tail = std::chrono::microseconds(50);
+
+  static sampling_service instance;
+
+private:
+  struct entry {
+    clock::time_point deadline;
+    sampling_task *task;
+  };
+
+  mutable std::mutex _mx;
+  std::condition_variable _cv;
+  // a heap of the subscribed tasks, earliest deadline first
+  std::vector<entry> _tasks;
+  // the task being sampled, which can only be unsubscribed from afterwards
+  const sampling_task *_current;
+  // the tasks to drain, and the one being drained, likewise
+  std::condition_variable _drain_cv;
+  std::vector<sampling_task *> _backlog;
+  const sampling_task *_draining;
+  // also read without the lock while busy-waiting
+  std::atomic<bool> _stop;
+  // how long before a deadline the thread stops sleeping and busy-waits
+  clock::duration _spin;
+  // the CPU the thread is pinned to, if any
+  std::optional<unsigned int> _cpu;
+  // the SCHED_FIFO priority of the thread, if real-time
+  std::optional<int> _priority;
+  // how late each sample was taken after its deadline, in nanoseconds
+  running_stats _lateness;
+  uint64_t _overruns;
+  // the timer expiring at the earliest deadline and the event notifying the
+  // thread of new subscriptions
+  int _timerfd;
+  int _eventfd;
+  // set along with the event, so that busy-waiting need not poll it
+  mutable std::atomic<bool> _woken;
+  std::thread _thread;
+  std::thread _drainer;
+
+  sampling_service();
+
+public:
+  ~sampling_service();
+
+  sampling_service(const sampling_service &) = delete;
+  sampling_service &operator=(const sampling_service &) = delete;
+
+  // busy-waits for the last <spin> before each deadline instead of sleeping,
+  // which trades a core for the accuracy of the deadlines
+  void spin(clock::duration spin);
+  // pins the thread to <cpu>, keeping it from competing with the tracee and
+  // from being migrated while busy-waiting; must be called before the first
+  // subscription
+  void pin(std::optional<unsigned int> cpu);
+  // runs the thread under SCHED_FIFO with <priority>, so that it is not
+  // preempted by the target; must be called before the first subscription
+  void priority(std::optional<int> priority);
+
+  // the lateness of all samples taken so far and the samples not taken
+  running_stats lateness() const;
+  uint64_t overruns() const;
+
+  // the first sample is taken as soon as possible
+  void subscribe(sampling_task &);
+  // once returned, the task is no longer sampled
+  void unsubscribe(const sampling_task &);
+
+private:
+  static bool later(const entry &, const entry &) noexcept;
+  void run();
+  void run_drainer();
+  void setup_thread() const;
+  void wake() const noexcept;
+  // waits until <deadline> or until woken up; returns whether it was reached
+  bool wait_until(clock::time_point deadline, clock::duration spin) const;
+};
+
+} // namespace tep
@@ -0,0 +1,116 @@
+// seccomp.cpp
+
+#include "seccomp.hpp"
+#include "config.hpp"
+
+#include <cassert>
+#include <cstddef>
+
+#include <linux/audit.h>
+#include <linux/capability.h>
+#include <linux/seccomp.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace tep;
+
+namespace {
+#if defined(__x86_64__)
+constexpr uint32_t audit_arch = AUDIT_ARCH_X86_64;
+#elif defined(__i386__)
+constexpr uint32_t audit_arch = AUDIT_ARCH_I386;
+#elif defined(__powerpc64__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+constexpr uint32_t audit_arch = AUDIT_ARCH_PPC64LE;
+#elif defined(__powerpc64__)
+constexpr uint32_t audit_arch = AUDIT_ARCH_PPC64;
+#else
+#error "unsupported architecture"
+#endif // defined(__x86_64__)
+
+// offsets of the halves of a 64-bit argument in struct seccomp_data
+constexpr uint32_t arg_offset(uint32_t index, bool high) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  constexpr uint32_t low_half = 0;
+#else
+  constexpr uint32_t low_half = sizeof(uint32_t);
+#endif
+  return offsetof(seccomp_data, args) + index * sizeof(uint64_t) +
+         (high ? sizeof(uint32_t) - low_half : low_half);
+}
+
+sock_filter load(uint32_t offset) {
+  return BPF_STMT(BPF_LD | BPF_W | BPF_ABS, offset);
+}
+
+sock_filter ret(uint32_t value) { return BPF_STMT(BPF_RET | BPF_K, value); }
+
+// the false branch is patched once the length of the block is known
+sock_filter jump_unless(uint32_t value) {
+  return BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, value, 0, 0);
+}
+
+// a block which returns SECCOMP_RET_TRACE with <index> as data if the system
+// call matches <sc>, falling through to the next block otherwise
+void append_block(std::vector<sock_filter> &program, const cfg::syscall_t &sc,
+                  uint16_t index) {
+  size_t start = program.size();
+  program.push_back(load(offsetof(seccomp_data, nr)));
+  program.push_back(jump_unless(sc.number));
+  for (const auto &arg : sc.args) {
+    for (bool high : {false, true}) {
+      uint32_t mask = high ? arg.mask >> 32 : arg.mask;
+      uint32_t value = high ? arg.value >> 32 : arg.value;
+      program.push_back(load(arg_offset(arg.index, high)));
+      program.push_back(BPF_STMT(BPF_ALU | BPF_AND | BPF_K, mask));
+      program.push_back(jump_unless(value & mask));
+    }
+  }
+  program.push_back(ret(SECCOMP_RET_TRACE | (index & SECCOMP_RET_DATA)));
+  size_t end = program.size();
+  for (size_t ix = start; ix < end; ix++)
+    if (program[ix].code == (BPF_JMP | BPF_JEQ | BPF_K))
+      program[ix].jf = end - ix - 1;
+}
+} // namespace
+
+seccomp_filter::seccomp_filter(const cfg::config_t &config) {
+  uint16_t index = 0;
+  for (const auto &group : config.groups())
+    for (const auto &sec : group.sections)
+      if (sec.bounds.holds<cfg::syscall_t>())
+        append_block(_program, sec.bounds.get<cfg::syscall_t>(), index++);
+  if (_program.empty())
+    return;
+  // system calls of other architectures have different numbers
+  std::vector<sock_filter> prologue{
+      load(offsetof(seccomp_data, arch)),
+      BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, audit_arch, 1, 0),
+      ret(SECCOMP_RET_ALLOW),
+  };
+  _program.insert(_program.begin(), prologue.begin(), prologue.end());
+  _program.push_back(ret(SECCOMP_RET_ALLOW));
+}
+
+bool seccomp_filter::empty() const noexcept { return _program.empty(); }
+
+// whether the calling process has CAP_SYS_ADMIN in its effective set
+static bool has_sys_admin() noexcept {
+  __user_cap_header_struct header{_LINUX_CAPABILITY_VERSION_3, 0};
+  __user_cap_data_struct data[_LINUX_CAPABILITY_U32S_3] = {};
+  if (syscall(SYS_capget, &header, data) == -1)
+    return false;
+  return data[CAP_TO_INDEX(CAP_SYS_ADMIN)].effective &
+         CAP_TO_MASK(CAP_SYS_ADMIN);
+}
+
+int seccomp_filter::install(bool &no_new_privs) const noexcept {
+  assert(!empty());
+  sock_fprog prog{static_cast<unsigned short>(_program.size()),
+                  const_cast<sock_filter *>(_program.data())};
+  // required to install a filter without CAP_SYS_ADMIN
+  no_new_privs = !has_sys_admin();
+  if (no_new_privs && prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) == -1)
+    return -1;
+  return prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog);
+}
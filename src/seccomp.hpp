@@ -0,0 +1,35 @@
+// seccomp.hpp
+
+#pragma once
+
+#include "configfwd.hpp"
+
+#include <vector>
+
+#include <linux/filter.h>
+
+namespace tep {
+
+// a seccomp filter which stops the tracee at the entry of the system calls
+// which bound sections, with the index of the section as the data of the
+// stop, and allows every other system call without waking the tracer;
+// the sections are indexed in the order in which they appear in the config,
+// and a system call is attributed to the first section whose conditions it
+// satisfies; the filter is inherited by the children of the tracee, which fail
+// the selected system calls with ENOSYS unless they are traced too
+class seccomp_filter {
+  std::vector<sock_filter> _program;
+
+public:
+  explicit seccomp_filter(const cfg::config_t &config);
+
+  // whether no section is bounded by a system call
+  bool empty() const noexcept;
+
+  // installs the filter in the calling process; without CAP_SYS_ADMIN, the
+  // process can no longer gain privileges afterwards, which <no_new_privs> is
+  // set to; returns -1 on error
+  int install(bool &no_new_privs) const noexcept;
+};
+
+} // namespace tep
@@ -0,0 +1,82 @@
+// shared_traps.cpp
+
+#include "shared_traps.hpp"
+#include "displaced_step.hpp"
+#include "error.hpp"
+#include "log.hpp"
+#include "ptrace_misc.hpp"
+#include "util.hpp"
+
+#include <nonstd/expected.hpp>
+
+#include <cassert>
+
+#include <unistd.h>
+
+using namespace tep;
+
+std::mutex &trap_word_locks::operator[](uintptr_t addr) noexcept {
+  // traps are at least 1 byte apart, but mostly further apart than that
+  return _shards[(addr ^ (addr >> 6)) % shard_count];
+}
+
+tracer_error return_traps::insert(const mem_file &mem, uintptr_t addr,
+                                  scratch_area *scratch) {
+  {
+    std::scoped_lock lock(_mx);
+    if (auto it = _traps.find(addr); it != _traps.end()) {
+      it->second.refs++;
+      log::logline(log::debug,
+                   "[%d] return trap @ 0x%" PRIxPTR " already inserted (%u)",
+                   gettid(), addr, it->second.refs);
+      return tracer_error::success();
+    }
+  }
+  const displaced_insn *displaced = nullptr;
+  if (scratch) {
+    auto relocated = scratch->relocate(mem, addr);
+    if (!relocated)
+      return std::move(relocated).error();
+    displaced = *relocated;
+  }
+  auto origword = read_word(mem, addr);
+  if (!origword)
+    return std::move(origword).error();
+  if (auto error = write_trap_bytes(mem, addr, set_trap(*origword)))
+    return error;
+  std::scoped_lock lock(_mx);
+  _traps.insert({addr, entry{*origword, displaced, 1}});
+  return tracer_error::success();
+}
+
+tracer_error return_traps::remove(const mem_file &mem, uintptr_t addr) {
+  long origword;
+  {
+    std::scoped_lock lock(_mx);
+    auto it = _traps.find(addr);
+    assert(it != _traps.end());
+    if (--it->second.refs) {
+      log::logline(log::debug,
+                   "[%d] return trap @ 0x%" PRIxPTR " still inserted (%u)",
+                   gettid(), addr, it->second.refs);
+      return tracer_error::success();
+    }
+    origword = it->second.origword;
+    _traps.erase(it);
+  }
+  if (auto error = write_trap_bytes(mem, addr, origword))
+    return error;
+  log::logline(log::debug,
+               "[%d] reset original word at function return @ 0x%" PRIxPTR
+               " (0x%lx -> 0x%lx)",
+               gettid(), addr, set_trap(origword), origword);
+  return tracer_error::success();
+}
+
+std::optional<return_traps::entry>
+return_traps::find(uintptr_t addr) const {
+  std::scoped_lock lock(_mx);
+  if (auto it = _traps.find(addr); it != _traps.end())
+    return it->second;
+  return std::nullopt;
+}
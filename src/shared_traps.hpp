@@ -0,0 +1,56 @@
+// shared_traps.hpp
+
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+namespace tep {
+
+class mem_file;
+class scratch_area;
+class tracer_error;
+struct displaced_insn;
+
+// locks serializing the modification of the word of a trap by different
+// tracers, sharded by trap address
+class trap_word_locks {
+public:
+  static constexpr size_t shard_count = 64;
+
+  std::mutex &operator[](uintptr_t addr) noexcept;
+
+private:
+  std::array<std::mutex, shard_count> _shards;
+};
+
+// traps inserted at the return address of functions, which the sections of
+// multiple tracers can share; a trap is only removed once the last section
+// which inserted it has ended, and, if its instruction could be relocated to
+// the scratch area, it is never removed before that
+// the lock of the trap word must be held when inserting and removing traps
+class return_traps {
+public:
+  struct entry {
+    long origword;
+    const displaced_insn *displaced;
+    unsigned int refs;
+  };
+
+  tracer_error insert(const mem_file &mem, uintptr_t addr,
+                      scratch_area *scratch);
+  tracer_error remove(const mem_file &mem, uintptr_t addr);
+
+  // the trap currently inserted at <addr>, if any
+  std::optional<entry> find(uintptr_t addr) const;
+
+private:
+  mutable std::mutex _mx;
+  std::unordered_map<uintptr_t, entry> _traps;
+};
+
+} // namespace tep
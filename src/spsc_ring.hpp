@@ -0,0 +1,91 @@
+// spsc_ring.hpp
+
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+
+namespace tep {
+
+// a bounded lock-free queue between a single producer and a single consumer;
+// its elements are allocated up front and written and read in place, so that
+// neither side allocates nor copies an element to hand it over
+template <typename T> class spsc_ring {
+public:
+  // the capacity is rounded up to a power of two
+  explicit spsc_ring(size_t capacity)
+      : _mask(round_up(capacity) - 1),
+        _slots(std::make_unique<T[]>(_mask + 1)), _head(0), _tail_cache(0),
+        _tail(0), _head_cache(0) {}
+
+  spsc_ring(const spsc_ring &) = delete;
+  spsc_ring &operator=(const spsc_ring &) = delete;
+
+  size_t capacity() const noexcept { return _mask + 1; }
+
+  // may be off by the operations in flight on the other side
+  size_t size() const noexcept {
+    return _tail.load(std::memory_order_acquire) -
+           _head.load(std::memory_order_acquire);
+  }
+
+  // producer: the slot to write the next element into, or null if full;
+  // the element is only visible to the consumer once committed
+  T *reserve() noexcept {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _head_cache > _mask) {
+      _head_cache = _head.load(std::memory_order_acquire);
+      if (tail - _head_cache > _mask)
+        return nullptr;
+    }
+    return &_slots[tail & _mask];
+  }
+
+  void commit() noexcept {
+    size_t tail = _tail.load(std::memory_order_relaxed);
+    assert(tail - _head.load(std::memory_order_relaxed) <= _mask);
+    _tail.store(tail + 1, std::memory_order_release);
+  }
+
+  // consumer: the oldest element, or null if empty; it remains valid until
+  // popped, after which its slot can be reused by the producer
+  T *front() noexcept {
+    size_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tail_cache) {
+      _tail_cache = _tail.load(std::memory_order_acquire);
+      if (head == _tail_cache)
+        return nullptr;
+    }
+    return &_slots[head & _mask];
+  }
+
+  void pop() noexcept {
+    size_t head = _head.load(std::memory_order_relaxed);
+    _head.store(head + 1, std::memory_order_release);
+  }
+
+private:
+  static size_t round_up(size_t capacity) noexcept {
+    size_t pow2 = 1;
+    while (pow2 < capacity)
+      pow2 <<= 1;
+    return pow2;
+  }
+
+  // keeps the indices of each side, and the copy each keeps of the other's,
+  // in different cache lines
+  static constexpr size_t line_size = 64;
+
+  const size_t _mask;
+  const std::unique_ptr<T[]> _slots;
+  // written by the consumer
+  alignas(line_size) std::atomic<size_t> _head;
+  size_t _tail_cache;
+  // written by the producer
+  alignas(line_size) std::atomic<size_t> _tail;
+  size_t _head_cache;
+};
+
+} // namespace tep
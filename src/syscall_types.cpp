@@ -0,0 +1,310 @@
+// syscall_types.cpp
+
+#include "syscall_types.hpp"
+
+#include <algorithm>
+#include <iterator>
+
+#include <sys/syscall.h>
+
+using namespace tep;
+
+namespace {
+struct syscall_name_entry {
+  std::string_view name;
+  long number;
+};
+
+// the system calls which can be referred to by name, as long as they exist on
+// the architecture the profiler was built for
+constexpr syscall_name_entry syscall_names[] = {
+#ifdef SYS_read
+    {"read", SYS_read},
+#endif
+#ifdef SYS_write
+    {"write", SYS_write},
+#endif
+#ifdef SYS_open
+    {"open", SYS_open},
+#endif
+#ifdef SYS_close
+    {"close", SYS_close},
+#endif
+#ifdef SYS_openat
+    {"openat", SYS_openat},
+#endif
+#ifdef SYS_creat
+    {"creat", SYS_creat},
+#endif
+#ifdef SYS_lseek
+    {"lseek", SYS_lseek},
+#endif
+#ifdef SYS_pread64
+    {"pread64", SYS_pread64},
+#endif
+#ifdef SYS_pwrite64
+    {"pwrite64", SYS_pwrite64},
+#endif
+#ifdef SYS_readv
+    {"readv", SYS_readv},
+#endif
+#ifdef SYS_writev
+    {"writev", SYS_writev},
+#endif
+#ifdef SYS_preadv
+    {"preadv", SYS_preadv},
+#endif
+#ifdef SYS_pwritev
+    {"pwritev", SYS_pwritev},
+#endif
+#ifdef SYS_preadv2
+    {"preadv2", SYS_preadv2},
+#endif
+#ifdef SYS_pwritev2
+    {"pwritev2", SYS_pwritev2},
+#endif
+#ifdef SYS_sendfile
+    {"sendfile", SYS_sendfile},
+#endif
+#ifdef SYS_splice
+    {"splice", SYS_splice},
+#endif
+#ifdef SYS_tee
+    {"tee", SYS_tee},
+#endif
+#ifdef SYS_vmsplice
+    {"vmsplice", SYS_vmsplice},
+#endif
+#ifdef SYS_copy_file_range
+    {"copy_file_range", SYS_copy_file_range},
+#endif
+#ifdef SYS_fsync
+    {"fsync", SYS_fsync},
+#endif
+#ifdef SYS_fdatasync
+    {"fdatasync", SYS_fdatasync},
+#endif
+#ifdef SYS_sync
+    {"sync", SYS_sync},
+#endif
+#ifdef SYS_syncfs
+    {"syncfs", SYS_syncfs},
+#endif
+#ifdef SYS_sync_file_range
+    {"sync_file_range", SYS_sync_file_range},
+#endif
+#ifdef SYS_fallocate
+    {"fallocate", SYS_fallocate},
+#endif
+#ifdef SYS_ftruncate
+    {"ftruncate", SYS_ftruncate},
+#endif
+#ifdef SYS_truncate
+    {"truncate", SYS_truncate},
+#endif
+#ifdef SYS_ioctl
+    {"ioctl", SYS_ioctl},
+#endif
+#ifdef SYS_fcntl
+    {"fcntl", SYS_fcntl},
+#endif
+#ifdef SYS_dup
+    {"dup", SYS_dup},
+#endif
+#ifdef SYS_dup2
+    {"dup2", SYS_dup2},
+#endif
+#ifdef SYS_dup3
+    {"dup3", SYS_dup3},
+#endif
+#ifdef SYS_pipe
+    {"pipe", SYS_pipe},
+#endif
+#ifdef SYS_pipe2
+    {"pipe2", SYS_pipe2},
+#endif
+#ifdef SYS_poll
+    {"poll", SYS_poll},
+#endif
+#ifdef SYS_ppoll
+    {"ppoll", SYS_ppoll},
+#endif
+#ifdef SYS_select
+    {"select", SYS_select},
+#endif
+#ifdef SYS_pselect6
+    {"pselect6", SYS_pselect6},
+#endif
+#ifdef SYS_epoll_wait
+    {"epoll_wait", SYS_epoll_wait},
+#endif
+#ifdef SYS_epoll_pwait
+    {"epoll_pwait", SYS_epoll_pwait},
+#endif
+#ifdef SYS_epoll_ctl
+    {"epoll_ctl", SYS_epoll_ctl},
+#endif
+#ifdef SYS_socket
+    {"socket", SYS_socket},
+#endif
+#ifdef SYS_connect
+    {"connect", SYS_connect},
+#endif
+#ifdef SYS_accept
+    {"accept", SYS_accept},
+#endif
+#ifdef SYS_accept4
+    {"accept4", SYS_accept4},
+#endif
+#ifdef SYS_bind
+    {"bind", SYS_bind},
+#endif
+#ifdef SYS_listen
+    {"listen", SYS_listen},
+#endif
+#ifdef SYS_sendto
+    {"sendto", SYS_sendto},
+#endif
+#ifdef SYS_recvfrom
+    {"recvfrom", SYS_recvfrom},
+#endif
+#ifdef SYS_sendmsg
+    {"sendmsg", SYS_sendmsg},
+#endif
+#ifdef SYS_recvmsg
+    {"recvmsg", SYS_recvmsg},
+#endif
+#ifdef SYS_sendmmsg
+    {"sendmmsg", SYS_sendmmsg},
+#endif
+#ifdef SYS_recvmmsg
+    {"recvmmsg", SYS_recvmmsg},
+#endif
+#ifdef SYS_shutdown
+    {"shutdown", SYS_shutdown},
+#endif
+#ifdef SYS_mmap
+    {"mmap", SYS_mmap},
+#endif
+#ifdef SYS_munmap
+    {"munmap", SYS_munmap},
+#endif
+#ifdef SYS_mremap
+    {"mremap", SYS_mremap},
+#endif
+#ifdef SYS_msync
+    {"msync", SYS_msync},
+#endif
+#ifdef SYS_madvise
+    {"madvise", SYS_madvise},
+#endif
+#ifdef SYS_mprotect
+    {"mprotect", SYS_mprotect},
+#endif
+#ifdef SYS_brk
+    {"brk", SYS_brk},
+#endif
+#ifdef SYS_futex
+    {"futex", SYS_futex},
+#endif
+#ifdef SYS_nanosleep
+    {"nanosleep", SYS_nanosleep},
+#endif
+#ifdef SYS_clock_nanosleep
+    {"clock_nanosleep", SYS_clock_nanosleep},
+#endif
+#ifdef SYS_sched_yield
+    {"sched_yield", SYS_sched_yield},
+#endif
+#ifdef SYS_stat
+    {"stat", SYS_stat},
+#endif
+#ifdef SYS_fstat
+    {"fstat", SYS_fstat},
+#endif
+#ifdef SYS_lstat
+    {"lstat", SYS_lstat},
+#endif
+#ifdef SYS_newfstatat
+    {"newfstatat", SYS_newfstatat},
+#endif
+#ifdef SYS_statx
+    {"statx", SYS_statx},
+#endif
+#ifdef SYS_getdents64
+    {"getdents64", SYS_getdents64},
+#endif
+#ifdef SYS_mkdir
+    {"mkdir", SYS_mkdir},
+#endif
+#ifdef SYS_rmdir
+    {"rmdir", SYS_rmdir},
+#endif
+#ifdef SYS_unlink
+    {"unlink", SYS_unlink},
+#endif
+#ifdef SYS_unlinkat
+    {"unlinkat", SYS_unlinkat},
+#endif
+#ifdef SYS_rename
+    {"rename", SYS_rename},
+#endif
+#ifdef SYS_renameat
+    {"renameat", SYS_renameat},
+#endif
+#ifdef SYS_io_setup
+    {"io_setup", SYS_io_setup},
+#endif
+#ifdef SYS_io_submit
+    {"io_submit", SYS_io_submit},
+#endif
+#ifdef SYS_io_getevents
+    {"io_getevents", SYS_io_getevents},
+#endif
+#ifdef SYS_io_uring_enter
+    {"io_uring_enter", SYS_io_uring_enter},
+#endif
+#ifdef SYS_io_uring_setup
+    {"io_uring_setup", SYS_io_uring_setup},
+#endif
+#ifdef SYS_clone
+    {"clone", SYS_clone},
+#endif
+#ifdef SYS_fork
+    {"fork", SYS_fork},
+#endif
+#ifdef SYS_vfork
+    {"vfork", SYS_vfork},
+#endif
+#ifdef SYS_execve
+    {"execve", SYS_execve},
+#endif
+#ifdef SYS_wait4
+    {"wait4", SYS_wait4},
+#endif
+#ifdef SYS_kill
+    {"kill", SYS_kill},
+#endif
+#ifdef SYS_tgkill
+    {"tgkill", SYS_tgkill},
+#endif
+};
+} // namespace
+
+std::optional<long> tep::syscall_number(std::string_view name) noexcept {
+  auto it = std::find_if(
+      std::begin(syscall_names), std::end(syscall_names),
+      [name](const syscall_name_entry &e) { return e.name == name; });
+  if (it == std::end(syscall_names))
+    return std::nullopt;
+  return it->number;
+}
+
+std::string_view tep::syscall_name(long number) noexcept {
+  auto it = std::find_if(
+      std::begin(syscall_names), std::end(syscall_names),
+      [number](const syscall_name_entry &e) { return e.number == number; });
+  if (it == std::end(syscall_names))
+    return {};
+  return it->name;
+}
@@ -2,6 +2,8 @@
 
 #include <array>
 #include <cstdint>
+#include <optional>
+#include <string_view>
 
 namespace tep {
 struct syscall_entry {
@@ -10,4 +12,9 @@ struct syscall_entry {
   uint64_t number;
   std::array<uint64_t, max_args> args;
 };
+
+// the number of the system call <name> on this architecture, if it is known
+std::optional<long> syscall_number(std::string_view name) noexcept;
+// the name of system call <number>, or an empty string if it is not known
+std::string_view syscall_name(long number) noexcept;
 } // namespace tep
@@ -2,8 +2,11 @@
 
 #include "target.hpp"
 #include "log.hpp"
+#include "seccomp.hpp"
+#include "util.hpp"
 
 #include <cerrno>
+#include <csignal>
 #include <cstring>
 #include <sys/personality.h>
 #include <sys/ptrace.h>
@@ -27,21 +30,91 @@ static int disable_aslr(pid_t pid) {
   return result;
 }
 
-void tep::run_target(bool aslr_randomization, char *const argv[]) {
+void tep::run_target(bool aslr_randomization, char *const argv[],
+                     int seized_fd, const seccomp_filter &filter,
+                     const cpu_set_t *cpus) {
   using namespace tep;
   pid_t pid = getpid();
   log::logline(log::info, "[%d] running target: %s", pid, argv[0]);
   for (size_t ix = 1; argv[ix] != NULL; ix++)
     log::logline(log::info, "[%d] argument %zu: %s", pid, ix, argv[ix]);
-  // set target process to be traced
-  if (ptrace(PTRACE_TRACEME, 0, 0, 0) == -1) {
-    log::logline(log::error, "[%d] PTRACE_TRACEME: %s", pid, strerror(errno));
+  // wait for the profiler to seize the target process, which it signals by
+  // closing the other end of the pipe
+  char c;
+  ssize_t res;
+  while ((res = read(seized_fd, &c, 1)) == -1 && errno == EINTR)
+    ;
+  if (res == -1) {
+    log::logline(log::error, "[%d] read: %s", pid, strerror(errno));
     return;
   }
+  close(seized_fd);
   if (!aslr_randomization && disable_aslr(pid))
     return;
+  // installed once seized, so that the tracer is there to be notified
+  if (!filter.empty()) {
+    bool no_new_privs;
+    if (filter.install(no_new_privs) == -1) {
+      log::logline(log::error, "[%d] error installing seccomp filter: %s", pid,
+                   strerror(errno));
+      return;
+    }
+    if (no_new_privs)
+      log::logline(log::warning,
+                   "[%d] target can no longer gain privileges, since it lacks "
+                   "CAP_SYS_ADMIN to install the seccomp filter otherwise",
+                   pid);
+    log::logline(log::success, "[%d] installed seccomp filter", pid);
+  }
+  if (cpus && sched_setaffinity(0, sizeof(*cpus), cpus) == -1) {
+    log::logline(log::error, "[%d] error restoring CPU affinity: %s", pid,
+                 strerror(errno));
+    return;
+  }
   log::flush();
   // execute target executable
   if (execvp(argv[0], argv) == -1)
     log::logline(log::error, "[%d] execv error: %s", pid, strerror(errno));
 }
+
+int tep::restrict_to_cpus(const std::vector<unsigned int> &cpus,
+                          cpu_set_t &previous) {
+  using namespace tep;
+  pid_t tid = gettid();
+  if (sched_getaffinity(0, sizeof(previous), &previous) == -1) {
+    log::logline(log::error, "[%d] error retrieving CPU affinity: %s", tid,
+                 strerror(errno));
+    return -1;
+  }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (unsigned int cpu : cpus)
+    CPU_SET(cpu, &set);
+  if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+    log::logline(log::error, "[%d] error restricting to %d CPUs: %s", tid,
+                 CPU_COUNT(&set), strerror(errno));
+    return -1;
+  }
+  log::logline(log::info, "[%d] restricted to %d CPUs", tid, CPU_COUNT(&set));
+  return 0;
+}
+
+int tep::seize_target(pid_t pid, int seized_fd) {
+  using namespace tep;
+  // unlike PTRACE_TRACEME, seizing allows interrupting the tracee with
+  // PTRACE_INTERRUPT; the execution of the target is reported as a
+  // PTRACE_EVENT_EXEC stop instead of a SIGTRAP; the system calls selected by
+  // the seccomp filter of the target are reported from the start
+  int result = ptrace(PTRACE_SEIZE, pid, 0,
+                      PTRACE_O_TRACEEXEC | PTRACE_O_TRACESYSGOOD |
+                          PTRACE_O_TRACESECCOMP | get_ptrace_exitkill());
+  if (result == -1) {
+    log::logline(log::error, "[%d] PTRACE_SEIZE: %s", getpid(),
+                 strerror(errno));
+    // the target must not run untraced
+    kill(pid, SIGKILL);
+  } else
+    log::logline(log::success, "[%d] seized target %d", getpid(), pid);
+  close(seized_fd);
+  return result;
+}
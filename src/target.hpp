@@ -2,8 +2,31 @@
 
 #pragma once
 
+#include <sched.h>
+#include <sys/types.h>
+
+#include <vector>
+
 namespace tep {
 
-void run_target(bool aslr_randomization, char *const argv[]);
+class seccomp_filter;
+
+// executes the target once the parent has seized the calling process, which
+// is signaled by closing the write end of the pipe whose read end is
+// <seized_fd>; <filter>, if not empty, is installed right before, as is the
+// CPU affinity <cpus>, if not null
+void run_target(bool aslr_randomization, char *const argv[], int seized_fd,
+                const seccomp_filter &filter, const cpu_set_t *cpus = nullptr);
+
+// restricts the calling thread, and the threads and processes it creates
+// afterwards, to <cpus>, storing its previous affinity in <previous>;
+// returns -1 on error
+int restrict_to_cpus(const std::vector<unsigned int> &cpus,
+                     cpu_set_t &previous);
+
+// seizes the target process and lets it execute the target by closing
+// <seized_fd>, the write end of the pipe; returns -1 on error, in which case
+// the target process is killed
+int seize_target(pid_t pid, int seized_fd);
 
 }
@@ -1,5 +1,7 @@
 #pragma once
 
+#include "sample_clock.hpp"
+
 #include <nrg/sample.hpp>
 
 #include <chrono>
@@ -7,11 +9,7 @@
 
 namespace tep {
 struct timed_sample {
-#ifdef TEP_USE_SYSTEM_CLOCK
-  using clock = std::chrono::system_clock;
-#else
-  using clock = std::chrono::steady_clock;
-#endif
+  using clock = sample_clock;
   using time_point = std::chrono::time_point<clock>;
   using duration = std::chrono::nanoseconds;
 
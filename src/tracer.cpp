@@ -1,6 +1,7 @@
 // tracer.cpp
 
 #include "tracer.hpp"
+#include "displaced_step.hpp"
 #include "log.hpp"
 #include "ptrace_child_toggler.hpp"
 #include "ptrace_misc.hpp"
@@ -8,12 +9,14 @@
 #include "ptrace_wrapper.hpp"
 #include "registers.hpp"
 #include "trap.hpp"
+#include "trap_stepper.hpp"
 #include "trap_types.hpp"
 #include "util.hpp"
 
 #include <nonstd/expected.hpp>
 
 #include <cassert>
+#include <csignal>
 #include <cstring>
 #include <future>
 #include <iostream>
@@ -35,36 +38,48 @@ inline int tgkill(pid_t tgid, pid_t tid, int signal) {
 
 // begin helper functions
 
+// the tracee attached to the calling tracer thread, if any
+static thread_local pid_t attached_tracee = 0;
+
 template <typename T> static std::string to_string(const T &obj) {
   std::stringstream ss;
   ss << obj;
   return ss.str();
 }
 
-static constexpr auto stop_tracee_signal = SIGUSR1;
-
-static constexpr bool is_isolated_mode_stop(int wait_status) {
-  return WIFSTOPPED(wait_status) && WSTOPSIG(wait_status) == stop_tracee_signal;
+static nonstd::expected<compact_execution, std::error_code>
+compact(const sampler_expected &values) {
+  if (!values)
+    return nonstd::make_unexpected(values.error());
+  return compact_execution(*values);
 }
 
 // end helper functions
 
 // definition of static variables
 
-std::mutex tracer::TRAP_BARRIER;
+std::shared_mutex tracer::TRAP_BARRIER;
+group_stop tracer::GROUP_STOP;
 
 // methods
 
 tracer::tracer(const registered_traps &traps, pid_t tracee_pid,
                pid_t tracee_tid, uintptr_t ep, std::launch policy)
-    : tracer(traps, tracee_pid, tracee_tid, ep, policy, nullptr) {}
+    : _tracer_ftr(), _children_mx(), _children(), _parent(nullptr), _tid_mx(),
+      _tid(0),
+      _tracee_tgid(tracee_pid), _tracee(tracee_tid), _ep(ep), _results() {
+  _tracer_ftr = std::async(policy, &tracer::trace, this, &traps);
+}
 
 tracer::tracer(const registered_traps &traps, pid_t tracee_pid,
                pid_t tracee_tid, uintptr_t ep, std::launch policy,
-               const tracer *tracer)
-    : _tracer_ftr(), _children_mx(), _children(), _parent(tracer),
+               const tracer *tracer, const cpu_gp_regs &released,
+               std::promise<void> &adopted)
+    : _tracer_ftr(), _children_mx(), _children(), _parent(tracer), _tid_mx(),
+      _tid(0),
       _tracee_tgid(tracee_pid), _tracee(tracee_tid), _ep(ep), _results() {
-  _tracer_ftr = std::async(policy, &tracer::trace, this, &traps);
+  _tracer_ftr = std::async(policy, &tracer::adopt_and_trace, this, &traps,
+                           released, &adopted);
 }
 
 tracer::~tracer() {
@@ -91,17 +106,58 @@ tracer_expected<tracer::gathered_results> tracer::results() {
   return std::move(_results);
 }
 
-void tracer::add_child(const registered_traps &traps, pid_t new_child) {
+tracer_error tracer::add_child(const registered_traps &traps,
+                               pid_t new_child) {
+  // the new child is auto-attached to this thread; hand its attachment over
+  // to the thread of the child tracer, which issues all further requests
+  auto released = release_tracee(gettid(), new_child);
+  if (!released)
+    return std::move(released).error();
+  std::promise<void> adopted;
+  auto child =
+      std::make_unique<tracer>(traps, _tracee_tgid, new_child, _ep,
+                               std::launch::async, this, *released, adopted);
+  // only make the child visible to stop_tracees() once it has been adopted
+  adopted.get_future().wait();
   std::scoped_lock lock(_children_mx);
-  _children.push_back(std::make_unique<tracer>(traps, _tracee_tgid, new_child,
-                                               _ep, std::launch::async, this));
+  _children.push_back(std::move(child));
   log::logline(log::info, "[%d] new child created with tid=%d", gettid(),
                new_child);
+  return tracer_error::success();
+}
+
+tracer_error tracer::handle_child_event(const registered_traps &traps) {
+  int errnum;
+  unsigned long new_child;
+  if (ptrace_wrapper::instance.ptrace(errnum, PTRACE_GETEVENTMSG, _tracee, 0,
+                                      &new_child) == -1)
+    return get_syserror(errnum, tracer_errcode::PTRACE_ERROR, gettid(),
+                        "PTRACE_GETEVENTMSG");
+  return add_child(traps, static_cast<pid_t>(new_child));
+}
+
+tracer_expected<std::optional<ptrace_child_toggler>>
+tracer::disable_child_tracing(const registered_traps &traps) const {
+  using rettype = tracer_expected<std::optional<ptrace_child_toggler>>;
+  // untraced children would fail the system calls selected by the seccomp
+  // filter of the target, so they remain traced
+  if (traps.has_syscalls())
+    return std::nullopt;
+  auto toggler = ptrace_child_toggler::create(ptrace_wrapper::instance,
+                                              gettid(), _tracee, false);
+  if (!toggler)
+    return rettype(nonstd::unexpect, std::move(toggler).error());
+  log::logline(log::info, "[%d] child tracing disabled", gettid());
+  return std::optional<ptrace_child_toggler>(*std::move(toggler));
 }
 
 tracer_error tracer::stop_tracees(const tracer &excl) const {
   std::scoped_lock lock(_children_mx);
   pid_t tid = gettid();
+  // the outermost call is made by the tracer starting the section
+  bool outermost = excl == *this;
+  if (outermost)
+    GROUP_STOP.start();
   if (_parent != nullptr && *_parent != excl) {
     tracer_error error = _parent->stop_tracees(*this);
     if (error)
@@ -122,22 +178,80 @@ tracer_error tracer::stop_tracees(const tracer &excl) const {
       return err;
     log::logline(log::info, "[%d] stopped child %d", tid, child->tracee());
   }
+  // the section must not start before all other tracees were interrupted,
+  // since they could otherwise run past its trap while it is stepped over
+  if (outermost) {
+    if (!GROUP_STOP.await_requests(group_stop::timeout))
+      return tracer_error(tracer_errcode::UNKNOWN_ERROR,
+                          "Timed out interrupting the other tracees");
+    GROUP_STOP.complete(tid);
+  }
   return tracer_error::success();
 }
 
 tracer_error tracer::stop_self() const {
-  if (tgkill(_tracee_tgid, _tracee, stop_tracee_signal) != 0) {
-    if (errno == ESRCH)
-      log::logline(log::warning,
-                   "[%d] tgkill: no process %d found but continuing anyway",
-                   gettid(), _tracee);
-    else
-      return get_syserror(errno, tracer_errcode::SYSTEM_ERROR, gettid(),
-                          "tgkill");
+  std::scoped_lock lock(_tid_mx);
+  // the tracer is no longer tracing its tracee
+  if (!_tid)
+    return tracer_error::success();
+  GROUP_STOP.requesting();
+  GROUP_STOP.interrupting(1);
+  if (tgkill(getpid(), _tid, interrupt_signal) != 0) {
+    GROUP_STOP.requested();
+    return get_syserror(errno, tracer_errcode::SYSTEM_ERROR, gettid(),
+                        "tgkill");
   }
   return tracer_error::success();
 }
 
+void tracer::interrupt_attached_tracee(int) {
+  int saved_errno = errno;
+  if (attached_tracee)
+    ptrace(PTRACE_INTERRUPT, attached_tracee, 0, 0);
+  GROUP_STOP.requested();
+  errno = saved_errno;
+}
+
+tracer_error tracer::attach_thread() {
+  static std::once_flag installed;
+  static int errnum = 0;
+  std::call_once(installed, [] {
+    struct sigaction sa = {};
+    sa.sa_handler = interrupt_attached_tracee;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(interrupt_signal, &sa, nullptr) == -1)
+      errnum = errno;
+  });
+  pid_t tid = gettid();
+  if (errnum)
+    return get_syserror(errnum, tracer_errcode::SYSTEM_ERROR, tid,
+                        "sigaction");
+  attached_tracee = _tracee;
+  std::scoped_lock lock(_tid_mx);
+  _tid = tid;
+  return tracer_error::success();
+}
+
+void tracer::detach_thread() {
+  {
+    std::scoped_lock lock(_tid_mx);
+    _tid = 0;
+  }
+  // the thread can no longer be signaled, but a signal sent before may still
+  // be pending and must be accounted for before the thread exits
+  sigset_t set;
+  sigset_t old;
+  sigemptyset(&set);
+  sigaddset(&set, interrupt_signal);
+  pthread_sigmask(SIG_BLOCK, &set, &old);
+  timespec zero{};
+  while (sigtimedwait(&set, nullptr, &zero) == interrupt_signal)
+    GROUP_STOP.requested();
+  attached_tracee = 0;
+  pthread_sigmask(SIG_SETMASK, &old, nullptr);
+}
+
 tracer_error tracer::wait_for_tracee(int &wait_status) const {
   pid_t waited_pid = waitpid(_tracee, &wait_status, 0);
   if (waited_pid == -1)
@@ -147,103 +261,19 @@ tracer_error tracer::wait_for_tracee(int &wait_status) const {
   return tracer_error::success();
 }
 
-tracer_error tracer::handle_breakpoint(cpu_gp_regs &regs, const trap &t) const {
-  ptrace_wrapper &pw = ptrace_wrapper::instance;
-  int errnum;
-  int wait_status;
-  pid_t tid = gettid();
-  uintptr_t bp_addr = regs.get_ip();
-
-  // save the word with the trap byte
-  long trap_word = pw.ptrace(errnum, PTRACE_PEEKDATA, _tracee, bp_addr, 0);
-  if (errnum)
-    return get_syserror(errnum, tracer_errcode::PTRACE_ERROR, tid,
-                        "PTRACE_PEEKDATA");
-  log::logline(log::debug,
-               "[%d] peeked word @ 0x%" PRIxPTR " (0x%" PRIxPTR
-               ") with value 0x%lx",
-               tid, bp_addr, bp_addr - _ep, trap_word);
-
-  // set the registers and write the original word
-  if (auto error = regs.setregs())
+tracer_error tracer::adopt_and_trace(const registered_traps *traps,
+                                     cpu_gp_regs released,
+                                     std::promise<void> *adopted) {
+  // the tracee can be interrupted as soon as the child tracer is visible
+  tracer_error error = attach_thread();
+  if (!error)
+    error = adopt_tracee(gettid(), released, get_ptrace_opts(true));
+  adopted->set_value();
+  if (error) {
+    detach_thread();
     return error;
-  if (pw.ptrace(errnum, PTRACE_POKEDATA, _tracee, bp_addr, t.origword()) == -1)
-    return get_syserror(errnum, tracer_errcode::PTRACE_ERROR, tid,
-                        "PTRACE_POKEDATA");
-  log::logline(log::debug,
-               "[%d] reset original word @ 0x%" PRIxPTR " (0x%" PRIxPTR
-               "), 0x%lx -> 0x%lx",
-               tid, bp_addr, bp_addr - _ep, trap_word, t.origword());
-
-  // single-step and reset the trap instruction
-  if (pw.ptrace(errnum, PTRACE_SINGLESTEP, _tracee, 0, 0) == -1)
-    return get_syserror(errnum, tracer_errcode::PTRACE_ERROR, tid,
-                        "PTRACE_SINGLESTEP");
-  if (auto error = wait_for_tracee(wait_status))
-    return error;
-
-  // if a stop_tracee_signal was queued up when multiple threads concurrently
-  // entered a section singlestep again to suppress it
-  if (is_isolated_mode_stop(wait_status)) {
-    log::logline(log::warning,
-                 "[%d] tracee %d stopped during single-step because of "
-                 "stop_tracee_signal",
-                 tid, _tracee);
-    if (pw.ptrace(errnum, PTRACE_SINGLESTEP, _tracee, 0, 0) == -1)
-      return get_syserror(errnum, tracer_errcode::PTRACE_ERROR, tid,
-                          "PTRACE_SINGLESTEP");
-    if (auto error = wait_for_tracee(wait_status))
-      return error;
-    cpu_gp_regs regs(_tracee);
-    if (auto error = regs.getregs())
-      return error;
-    log::logline(log::warning,
-                 "[%d] stop_tracee_signal signal suppressed @ 0x%" PRIxPTR
-                 " (0x%" PRIxPTR ")",
-                 tid, regs.get_ip(), regs.get_ip() - _ep);
-  }
-
-  if (!is_breakpoint_trap(wait_status)) {
-    log::logline(log::error,
-                 "[%d] tried to single-step but process ended"
-                 " unexpectedly and, as such, tracing cannot continue",
-                 tid);
-    return tracer_error(tracer_errcode::UNKNOWN_ERROR);
   }
-
-  if (auto error = regs.getregs())
-    return error;
-  log::logline(log::info,
-               "[%d] single-stepped @ 0x%" PRIxPTR " (0x%" PRIxPTR ")", tid,
-               regs.get_ip(), regs.get_ip() - _ep);
-
-  return tracer_error::success();
-}
-
-tracer_expected<std::pair<trap_context, long>>
-tracer::handle_function_entry(const cpu_gp_regs &regs) const {
-  auto get_func_return_ctx =
-      [](const cpu_gp_regs &regs) -> tracer_expected<trap_context> {
-    using unexpected = tracer_expected<trap_context>::unexpected_type;
-    auto ret_addr = regs.get_return_address();
-    if (!ret_addr)
-      return unexpected{std::move(ret_addr).error()};
-    return trap_context{function_return{*ret_addr, nullptr}};
-  };
-
-  using unexpected =
-      tracer_expected<std::pair<trap_context, long>>::unexpected_type;
-  long origword = 0;
-  auto func_end_ctx = get_func_return_ctx(regs);
-  if (!func_end_ctx)
-    return unexpected{std::move(func_end_ctx).error()};
-  log::logline(log::debug, "function return address @ 0x%" PRIxPTR,
-               func_end_ctx->addr());
-  auto res = insert_trap(_tracee, func_end_ctx->addr());
-  if (!res)
-    return unexpected{std::move(res).error()};
-  origword = *res;
-  return std::pair{*std::move(func_end_ctx), origword};
+  return trace(traps);
 }
 
 tracer_error tracer::trace(const registered_traps *traps) {
@@ -260,6 +290,18 @@ tracer_error tracer::trace(const registered_traps *traps) {
       log::debug,
       "[%d] started tracer for tracee with tid %d, entrypoint @ 0x%" PRIxPTR,
       tid, _tracee, entrypoint);
+  if (auto error = attach_thread())
+    return error;
+  struct thread_detacher {
+    tracer *trc;
+    ~thread_detacher() { trc->detach_thread(); }
+  } detacher{this};
+  // traps are written through the memory file instead of PTRACE_POKEDATA
+  _mem = std::make_unique<mem_file>(_tracee);
+  if (_mem->get() == -1)
+    return get_syserror(errno, tracer_errcode::SYSTEM_ERROR, tid,
+                        "open tracee memory");
+  trap_stepper stepper(_tracee, *_mem, entrypoint);
   while (true) {
     if (auto err = pr.resume(resume_signal))
       return err;
@@ -272,21 +314,27 @@ tracer_error tracer::trace(const registered_traps *traps) {
                  _tracee, sigstr ? sigstr : "<no stop signal>", wait_status);
     int errnum;
     if (is_child_event(wait_status)) {
-      std::scoped_lock lock(TRAP_BARRIER);
-      unsigned long new_child;
-      if (pw.ptrace(errnum, PTRACE_GETEVENTMSG, _tracee, 0, &new_child) == -1)
-        return get_syserror(errnum, tracer_errcode::PTRACE_ERROR, tid,
-                            "PTRACE_GETEVENTMSG");
-
-      add_child(*traps, static_cast<pid_t>(new_child));
+      std::shared_lock lock(TRAP_BARRIER);
+      if (auto error = handle_child_event(*traps))
+        return error;
     } else if (is_exit_event(wait_status)) {
-      std::scoped_lock lock(TRAP_BARRIER);
+      std::shared_lock lock(TRAP_BARRIER);
       unsigned long exit_status;
       if (pw.ptrace(errnum, PTRACE_GETEVENTMSG, _tracee, 0, &exit_status) == -1)
         return get_syserror(errnum, tracer_errcode::PTRACE_ERROR, tid,
                             "PTRACE_GETEVENTMSG");
       log::logline(log::debug, "[%d] tracee %d PTRACE_O_TRACEEXIT status %d",
                    tid, _tracee, static_cast<int>(exit_status));
+    } else if (is_interrupt_stop(wait_status)) {
+      // wait for the non-concurrent section which stopped the tracee to end
+      GROUP_STOP.stopped(tid);
+      log::logline(log::info, "[%d] stopped tracee with tid=%d", tid, _tracee);
+      std::shared_lock lock(TRAP_BARRIER);
+      log::logline(log::info, "[%d] continued tracee with tid=%d", tid,
+                   _tracee);
+    } else if (is_seccomp_event(wait_status)) {
+      if (auto error = trace_syscall(*traps))
+        return error;
     } else if (is_breakpoint_trap(wait_status)) {
       cpu_gp_regs regs(_tracee);
       if (auto err = regs.getregs())
@@ -300,6 +348,18 @@ tracer_error tracer::trace(const registered_traps *traps) {
                    regs.get_stack_pointer());
       const start_trap *strap = traps->find(start_bp_addr);
       if (!strap) {
+        std::shared_lock lock(TRAP_BARRIER);
+        auto stepped = stepper.step_over_return_trap(regs);
+        if (!stepped)
+          return std::move(stepped).error();
+        if (*stepped)
+          continue;
+        // the end of an execution which was not measured
+        stepped = stepper.step_over_end_trap(regs, *traps);
+        if (!stepped)
+          return std::move(stepped).error();
+        if (*stepped)
+          continue;
         log::logline(log::error,
                      "[%d] reached start trap which is not registered as "
                      "a start trap @ 0x%" PRIxPTR " (offset = 0x%" PRIxPTR ")",
@@ -310,14 +370,36 @@ tracer_error tracer::trace(const registered_traps *traps) {
       log::logline(log::info, "[%d] reached starting trap located @ %s", tid,
                    to_string(strap->context()).c_str());
 
-      std::scoped_lock lock(TRAP_BARRIER);
-      log::logline(log::debug, "[%d] entered global tracer barrier", tid);
+      // executions which are not measured neither stop other tracees nor
+      // create a sampler
+      if (auto exec = strap->hit(); exec != start_trap::execution::measured) {
+        std::shared_lock lock(TRAP_BARRIER);
+        bool exhausted = exec == start_trap::execution::exhausted;
+        log::logline(log::debug, "[%d] execution not measured%s", tid,
+                     exhausted ? "; budget exhausted" : "");
+        // a trap which is also the end of another section is never removed
+        if (auto error = stepper.skip_execution(
+                regs, *strap,
+                exhausted && !traps->find(end_addr{start_bp_addr.val()})))
+          return error;
+        continue;
+      }
+
+      // concurrent sections only exclude non-concurrent ones, which keep all
+      // other tracees stopped for their whole duration
+      std::shared_lock shared_barrier(TRAP_BARRIER, std::defer_lock);
+      std::unique_lock barrier(TRAP_BARRIER, std::defer_lock);
+      if (strap->allow_concurrency())
+        shared_barrier.lock();
+      else
+        barrier.lock();
+      log::logline(log::debug, "[%d] entered %s tracer barrier", tid,
+                   strap->allow_concurrency() ? "shared" : "exclusive");
 
       // disable tracing of children during execution of section
-      auto toggler = ptrace_child_toggler::create(pw, tid, _tracee, false);
+      auto toggler = disable_child_tracing(*traps);
       if (!toggler)
-        return std::move(toggler.error());
-      log::logline(log::info, "[%d] child tracing disabled", tid);
+        return std::move(toggler).error();
 
       if (!strap->allow_concurrency()) {
         log::logline(log::info,
@@ -328,21 +410,23 @@ tracer_error tracer::trace(const registered_traps *traps) {
         log::logline(log::info,
                      "[%d] concurrency allowed; not stopping tracees", tid);
 
-      std::optional<std::pair<trap_context, long>> func_return;
+      std::optional<return_frame> func_return;
       if (strap->context().is_function_call()) {
-        auto res = handle_function_entry(regs);
+        auto res = stepper.handle_function_entry(regs, traps->scratch());
         if (!res)
           return std::move(res).error();
         func_return = *std::move(res);
       }
 
-      if (auto error = handle_breakpoint(regs, *strap))
+      // the trap is re-armed as soon as it is stepped over, so that the
+      // executions of concurrent sections by other threads are measured too
+      if (auto error = stepper.handle_breakpoint(regs, *strap, true))
         return error;
       _sampler = strap->create_sampler();
       sampler_promise _promise = _sampler->run();
 
       resume_signal = 0;
-      do {
+      for (bool section_ended = false; !section_ended;) {
         if (pw.ptrace(errnum, PTRACE_CONT, _tracee, 0, resume_signal) == -1)
           return get_syserror(errnum, tracer_errcode::PTRACE_ERROR, tid,
                               "PTRACE_CONT");
@@ -350,20 +434,69 @@ tracer_error tracer::trace(const registered_traps *traps) {
         if (auto error = wait_for_tracee(wait_status))
           return error;
         resume_signal = 0;
+        // children created mid-section, if they remain traced
+        if (is_child_event(wait_status)) {
+          if (auto error = handle_child_event(*traps))
+            return error;
+          continue;
+        }
+        // an interrupt which predates the section
+        if (is_interrupt_stop(wait_status)) {
+          log::logline(log::warning,
+                       "[%d] interrupt ignored mid-section for tracee %d", tid,
+                       _tracee);
+          continue;
+        }
+        // sections bounded by system calls are not measured within others
+        if (is_seccomp_event(wait_status)) {
+          log::logline(log::warning,
+                       "[%d] system call section ignored mid-section for "
+                       "tracee %d",
+                       tid, _tracee);
+          continue;
+        }
         // reached end breakpoint
         if (is_breakpoint_trap(wait_status)) {
-          auto sampling_results = _promise();
           if (auto error = regs.getregs())
             return error;
           log::logline(log::info,
                        "[%d] reached breakpoint @ 0x%" PRIxPTR " (0x%" PRIxPTR
                        ")",
                        tid, regs.get_ip(), regs.get_ip() - entrypoint);
+          regs.rewind_trap();
+          // a recursive invocation reaches the start trap, which is re-armed
+          // once the section starts, so step over it
+          if (regs.get_ip() == start_bp_addr.val()) {
+            log::logline(log::info, "[%d] reached starting trap mid-section",
+                         tid);
+            if (auto error = stepper.handle_breakpoint(regs, *strap, true))
+              return error;
+            continue;
+          }
+          // the return trap of a section of another tracer, which the tracee
+          // is not the target of, or of a deeper recursive invocation
+          bool own_end = func_return
+                             ? func_return->returned(regs)
+                             : traps->find(end_addr{regs.get_ip()},
+                                           start_bp_addr) != nullptr;
+          if (!own_end) {
+            auto stepped = stepper.step_over_return_trap(regs);
+            if (!stepped)
+              return std::move(stepped).error();
+            if (*stepped)
+              continue;
+            stepped = stepper.step_over_end_trap(regs, *traps);
+            if (!stepped)
+              return std::move(stepped).error();
+            if (*stepped)
+              continue;
+          }
+          section_ended = true;
+          auto sampling_results = _promise();
 
           const trap_context *end_ctx = nullptr;
-          regs.rewind_trap();
           if (func_return) {
-            auto [ctx, origword] = *func_return;
+            const trap_context &ctx = func_return->context;
             if (regs.get_ip() != ctx.addr()) {
               log::logline(log::error,
                            "[%d] reached trap @ 0x%" PRIxPTR " (0x%" PRIxPTR
@@ -377,18 +510,9 @@ tracer_error tracer::trace(const registered_traps *traps) {
               return tracer_error(tracer_errcode::NO_TRAP,
                                   "Not a return trap reached");
             }
-            if (auto error = regs.setregs())
+            if (auto error = stepper.handle_function_return(regs, ctx.addr()))
               return error;
-            if (pw.ptrace(errnum, PTRACE_POKEDATA, _tracee, ctx.addr(),
-                          origword) == -1)
-              return get_syserror(errnum, tracer_errcode::PTRACE_ERROR, tid,
-                                  "PTRACE_POKEDATA");
-            log::logline(
-                log::debug,
-                "[%d] reset original word at function return @ 0x%" PRIxPTR
-                " (0x%lx -> 0x%lx)",
-                tid, ctx.addr(), set_trap(origword), origword);
-            end_ctx = &(func_return->first);
+            end_ctx = &ctx;
           } else {
             end_addr end_bp_addr = regs.get_ip();
             const end_trap *etrap = traps->find(end_bp_addr, start_bp_addr);
@@ -406,13 +530,16 @@ tracer_error tracer::trace(const registered_traps *traps) {
             }
             log::logline(log::info, "[%d] reached ending trap located @ %s",
                          tid, to_string(etrap->context()).c_str());
-            if (auto error = handle_breakpoint(regs, *etrap))
+            if (auto error = stepper.handle_breakpoint(regs, *etrap, true))
               return error;
-            if (auto err = reset_trap(*etrap, end_bp_addr.val()))
-              return err;
             end_ctx = &etrap->context();
           }
-          if (auto err = reset_trap(*strap, start_bp_addr.val()))
+          strap->finish();
+          bool remove = strap->exhausted() &&
+                        !traps->find(end_addr{start_bp_addr.val()});
+          if (auto err = remove
+                             ? stepper.remove_trap(*strap, start_bp_addr.val())
+                             : stepper.reset_trap(*strap, start_bp_addr.val()))
             return err;
 
           // if sampling thread generated an error, register execution as a
@@ -425,8 +552,8 @@ tracer_error tracer::trace(const registered_traps *traps) {
                 log::success,
                 "[%d] sampling thread exited successfully with %zu samples",
                 tid, sampling_results->size());
-          _results.push_back(results_entry{strap->context(), *end_ctx,
-                                           std::move(sampling_results)});
+          gather(*strap, results_entry{strap->context(), *end_ctx,
+                                       std::move(sampling_results)});
         } else if (WIFSTOPPED(wait_status)) {
           if (auto error = regs.getregs())
             return error;
@@ -444,15 +571,9 @@ tracer_error tracer::trace(const registered_traps *traps) {
           return {tracer_errcode::UNKNOWN_ERROR,
                   "Tracee received unknown ptrace-stop status mid-section"};
         }
-      } while (!is_breakpoint_trap(wait_status));
+      }
       log::logline(log::info, "[%d] child tracing re-enabled", tid);
-      log::logline(log::debug, "[%d] exited global tracer barrier", tid);
-    } else if (is_isolated_mode_stop(wait_status)) {
-      // try to acquire barrier
-      log::logline(log::info, "[%d] stopped tracee with tid=%d", tid, _tracee);
-      std::scoped_lock lock(TRAP_BARRIER);
-      log::logline(log::info, "[%d] continued tracee with tid=%d", tid,
-                   _tracee);
+      log::logline(log::debug, "[%d] exited tracer barrier", tid);
     } else if (WIFEXITED(wait_status)) {
       log::logline(log::success, "[%d] tracee %d exited with status %d", tid,
                    _tracee, WEXITSTATUS(wait_status));
@@ -482,6 +603,127 @@ tracer_error tracer::trace(const registered_traps *traps) {
   return tracer_error::success();
 }
 
+tracer_error tracer::trace_syscall(const registered_traps &traps) {
+  int errnum;
+  int wait_status;
+  pid_t tid = gettid();
+  ptrace_wrapper &pw = ptrace_wrapper::instance;
+
+  // the message is the data of the filter rule which stopped the tracee, which
+  // is the index of the section
+  unsigned long index;
+  if (pw.ptrace(errnum, PTRACE_GETEVENTMSG, _tracee, 0, &index) == -1)
+    return get_syserror(errnum, tracer_errcode::PTRACE_ERROR, tid,
+                        "PTRACE_GETEVENTMSG");
+  const start_trap *strap = traps.find_syscall(index);
+  if (!strap) {
+    log::logline(log::warning,
+                 "[%d] tracee %d stopped at system call of unknown section %lu",
+                 tid, _tracee, index);
+    return tracer_error::success();
+  }
+  cpu_gp_regs regs(_tracee);
+  if (auto error = regs.getregs())
+    return error;
+  long number = regs.get_syscall_entry().number;
+  log::logline(log::info, "[%d] reached %s @ 0x%" PRIxPTR, tid,
+               to_string(strap->context()).c_str(), regs.get_ip());
+  // system calls have no trap to step over, so executions which are not
+  // measured simply proceed
+  if (auto exec = strap->hit(); exec != start_trap::execution::measured) {
+    log::logline(log::debug, "[%d] execution not measured%s", tid,
+                 exec == start_trap::execution::exhausted
+                     ? "; budget exhausted"
+                     : "");
+    return tracer_error::success();
+  }
+
+  std::shared_lock shared_barrier(TRAP_BARRIER, std::defer_lock);
+  std::unique_lock barrier(TRAP_BARRIER, std::defer_lock);
+  if (strap->allow_concurrency())
+    shared_barrier.lock();
+  else
+    barrier.lock();
+  log::logline(log::debug, "[%d] entered %s tracer barrier", tid,
+               strap->allow_concurrency() ? "shared" : "exclusive");
+
+  auto toggler = disable_child_tracing(traps);
+  if (!toggler)
+    return std::move(toggler).error();
+  if (!strap->allow_concurrency())
+    if (auto error = stop_tracees(*this))
+      return error;
+
+  _sampler = strap->create_sampler();
+  sampler_promise _promise = _sampler->run();
+
+  // the section ends once the system call returns
+  int resume_signal = 0;
+  while (true) {
+    if (pw.ptrace(errnum, PTRACE_SYSCALL, _tracee, 0, resume_signal) == -1)
+      return get_syserror(errnum, tracer_errcode::PTRACE_ERROR, tid,
+                          "PTRACE_SYSCALL");
+    if (auto error = wait_for_tracee(wait_status))
+      return error;
+    resume_signal = 0;
+    if (is_syscall_trap(wait_status))
+      break;
+    // children created mid-section, if they remain traced
+    if (is_child_event(wait_status)) {
+      if (auto error = handle_child_event(traps))
+        return error;
+      continue;
+    }
+    // interrupts which predate the section and other ptrace events
+    if (wait_status >> 16) {
+      log::logline(log::warning,
+                   "[%d] event ignored mid-section for tracee %d (status 0x%x)",
+                   tid, _tracee, wait_status);
+      continue;
+    }
+    if (!WIFSTOPPED(wait_status)) {
+      log::logline(log::error,
+                   "[%d] tracee %d with unknown ptrace-stop status "
+                   "mid-section (status 0x%x)",
+                   tid, _tracee, wait_status);
+      return {tracer_errcode::UNKNOWN_ERROR,
+              "Tracee received unknown ptrace-stop status mid-section"};
+    }
+    resume_signal = WSTOPSIG(wait_status);
+    log::logline(log::warning, "[%d] received a signal mid-section: %s", tid,
+                 strsignal(resume_signal));
+  }
+  auto sampling_results = _promise();
+  strap->finish();
+
+  if (auto error = regs.getregs())
+    return error;
+  trap_context end_ctx{system_call_return{
+      {regs.get_ip(), nullptr}, number, regs.get_syscall_return()}};
+  log::logline(log::info, "[%d] reached %s", tid,
+               to_string(end_ctx).c_str());
+  if (!sampling_results)
+    log::logline(log::error, "[%d] sampling thread exited with error", tid);
+  else
+    log::logline(log::success,
+                 "[%d] sampling thread exited successfully with %zu samples",
+                 tid, sampling_results->size());
+  gather(*strap, results_entry{strap->context(), std::move(end_ctx),
+                               std::move(sampling_results), index});
+  return tracer_error::success();
+}
+
+void tracer::gather(const start_trap &strap, results_entry &&entry) {
+  if (const results_consumer &consume = strap.consumer())
+    consume(std::move(entry));
+  else
+    _results.emplace_back(std::move(entry));
+}
+
+gathered_entry::gathered_entry(results_entry &&entry)
+    : start(std::move(entry.start)), end(std::move(entry.end)),
+      values(compact(entry.values)), syscall(entry.syscall) {}
+
 // operator overloads
 
 bool tep::operator==(const tracer &lhs, const tracer &rhs) {
@@ -491,20 +733,3 @@ bool tep::operator==(const tracer &lhs, const tracer &rhs) {
 bool tep::operator!=(const tracer &lhs, const tracer &rhs) {
   return lhs.tracee() != rhs.tracee();
 }
-
-tracer_error tep::tracer::reset_trap(const trap &t, uintptr_t addr) const {
-  int errnum;
-  pid_t tid = gettid();
-  auto &pw = ptrace_wrapper::instance;
-  if (pw.ptrace(errnum, PTRACE_POKEDATA, _tracee, addr,
-                set_trap(t.origword())) == -1) {
-    return get_syserror(errnum, tracer_errcode::PTRACE_ERROR, tid,
-                        "PTRACE_POKEDATA");
-  }
-  log::logline(log::debug,
-               "[%d] reset %s trap word @ 0x%" PRIxPTR " (0x%" PRIxPTR
-               "), 0x%lx -> 0x%lx",
-               tid, to_string(t.context()).c_str(), addr, addr - _ep,
-               t.origword(), set_trap(t.origword()));
-  return tracer_error::success();
-}
@@ -3,11 +3,16 @@
 #pragma once
 
 #include <condition_variable>
+#include <csignal>
 #include <future>
 #include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <unordered_map>
 
+#include "compact_execution.hpp"
 #include "error.hpp"
+#include "group_stop.hpp"
 #include "reader_container.hpp"
 #include "sampler.hpp"
 #include "trap_context.hpp"
@@ -18,8 +23,10 @@
 namespace tep {
 
 class cpu_gp_regs;
+class mem_file;
+class ptrace_child_toggler;
 class registered_traps;
-class trap;
+class start_trap;
 
 template <typename R> using tracer_expected = nonstd::expected<R, tracer_error>;
 
@@ -27,14 +34,35 @@ struct results_entry {
   trap_context start;
   trap_context end;
   sampler_expected values;
+  // the index of the section, if it is bounded by a system call
+  std::optional<size_t> syscall = std::nullopt;
+};
+
+// an execution kept until tracing ends, whose samples are compacted as soon
+// as its section ends, so that at most one execution per tracee is expanded
+// at any time
+struct gathered_entry {
+  trap_context start;
+  trap_context end;
+  nonstd::expected<compact_execution, std::error_code> values;
+  std::optional<size_t> syscall;
+
+  explicit gathered_entry(results_entry &&entry);
 };
 
 class tracer {
 public:
-  using gathered_results = std::vector<results_entry>;
+  using gathered_results = std::vector<gathered_entry>;
+
+  // sent to a tracer thread to make it interrupt its tracee
+  static constexpr int interrupt_signal = SIGUSR1;
 
 private:
-  static std::mutex TRAP_BARRIER;
+  // held shared by the tracers handling concurrent sections and other
+  // events, and exclusively by non-concurrent sections
+  static std::shared_mutex TRAP_BARRIER;
+  // the group-stop of the non-concurrent section being executed, if any
+  static group_stop GROUP_STOP;
 
 private:
   std::future<tep::tracer_error> _tracer_ftr;
@@ -42,8 +70,12 @@ private:
   mutable std::mutex _children_mx;
   std::vector<std::unique_ptr<tracer>> _children;
   const tracer *_parent;
+  // the thread attached to the tracee, which is signaled to interrupt it
+  mutable std::mutex _tid_mx;
+  pid_t _tid;
 
   std::unique_ptr<sampler> _sampler;
+  std::unique_ptr<mem_file> _mem;
 
   pid_t _tracee_tgid;
   pid_t _tracee;
@@ -55,7 +87,8 @@ public:
          uintptr_t ep, std::launch policy);
 
   tracer(const registered_traps &traps, pid_t tracee_pid, pid_t tracee_tid,
-         uintptr_t ep, std::launch policy, const tracer *parent);
+         uintptr_t ep, std::launch policy, const tracer *parent,
+         const cpu_gp_regs &released, std::promise<void> &adopted);
 
   ~tracer();
 
@@ -65,17 +98,26 @@ public:
   tracer_expected<gathered_results> results();
 
 private:
-  void add_child(const registered_traps &traps, pid_t new_child);
-
+  tracer_error add_child(const registered_traps &traps, pid_t new_child);
+  // adds the child whose creation the tracee is stopped at
+  tracer_error handle_child_event(const registered_traps &traps);
+  // disables tracing of children during a section, unless they must be traced
+  tracer_expected<std::optional<ptrace_child_toggler>>
+  disable_child_tracing(const registered_traps &traps) const;
+
+  static void interrupt_attached_tracee(int);
+  tracer_error attach_thread();
+  void detach_thread();
   tracer_error stop_tracees(const tracer &excl) const;
   tracer_error stop_self() const;
   tracer_error wait_for_tracee(int &wait_status) const;
-  tracer_error reset_trap(const trap &, uintptr_t addr) const;
-  tracer_error handle_breakpoint(cpu_gp_regs &regs, const trap &) const;
   tracer_error trace(const registered_traps *traps);
-
-  tracer_expected<std::pair<trap_context, long>>
-  handle_function_entry(const cpu_gp_regs &) const;
+  tracer_error trace_syscall(const registered_traps &traps);
+  // hands the results to the consumer of the section, if any
+  void gather(const start_trap &strap, results_entry &&entry);
+  tracer_error adopt_and_trace(const registered_traps *traps,
+                               cpu_gp_regs released,
+                               std::promise<void> *adopted);
 };
 
 // operator overloads
@@ -1,5 +1,6 @@
 // trap.cpp
 
+#include <algorithm>
 #include <cassert>
 #include <iomanip>
 #include <iostream>
@@ -63,13 +64,17 @@ std::ostream &tep::operator<<(std::ostream &os, const trap &t) {
   return os;
 }
 
-trap::trap(long origword, trap_context ctx) noexcept
-    : _origword(origword), _context(std::move(ctx)) {}
+trap::trap(trap_context ctx) noexcept
+    : _origword(0), _context(std::move(ctx)) {}
 
 long trap::origword() const noexcept { return _origword; }
 
 const trap_context &trap::context() const noexcept { return _context; }
 
+const displaced_insn *trap::displaced() const noexcept {
+  return _displaced ? &*_displaced : nullptr;
+}
+
 void trap::print(std::ostream &os) const {
   os << context() << " [";
   std::ios::fmtflags flags(os.flags());
@@ -86,8 +91,55 @@ std::unique_ptr<sampler> start_trap::create_sampler() const {
   return _creator();
 }
 
-end_trap::end_trap(long origword, trap_context ctx, start_addr addr)
-    : trap(origword, std::move(ctx)), _start(addr) {}
+void start_trap::consume_results(results_consumer consumer) {
+  _consumer = std::move(consumer);
+}
+
+const results_consumer &start_trap::consumer() const noexcept {
+  return _consumer;
+}
+
+start_trap::execution start_trap::hit() const noexcept {
+  // counted as active before the hit, so that whoever sees the last measured
+  // hit also sees its execution as not yet ended
+  _counters->active.fetch_add(1);
+  uint64_t hit = _counters->hits.fetch_add(1);
+  execution exec = hit % _budget.every ? execution::skipped
+                                       : execution::measured;
+  // hits which race with the removal of the trap are not measured either
+  if (_budget.max_executions &&
+      hit > uint64_t{_budget.max_executions - 1} * _budget.every)
+    exec = execution::exhausted;
+  if (exec != execution::measured)
+    _counters->active.fetch_sub(1);
+  return exec;
+}
+
+void start_trap::finish() const noexcept {
+  [[maybe_unused]] uint32_t active = _counters->active.fetch_sub(1);
+  assert(active);
+}
+
+bool start_trap::exhausted() const noexcept {
+  return _budget.max_executions &&
+         _counters->hits.load() >
+             uint64_t{_budget.max_executions - 1} * _budget.every;
+}
+
+bool start_trap::finished() const noexcept {
+  return exhausted() && !_counters->active.load();
+}
+
+uint64_t start_trap::skipped() const noexcept {
+  uint64_t hits = _counters->hits.load(std::memory_order_relaxed);
+  uint64_t measured = hits / _budget.every + (hits % _budget.every != 0);
+  if (_budget.max_executions)
+    measured = std::min<uint64_t>(measured, _budget.max_executions);
+  return hits - measured;
+}
+
+end_trap::end_trap(trap_context ctx, start_addr addr)
+    : trap(std::move(ctx)), _start(addr) {}
 
 start_addr end_trap::associated_with() const noexcept { return _start; }
 
@@ -108,6 +160,11 @@ std::pair<const end_trap *, bool> registered_traps::insert(end_addr a,
   return {&it->second, inserted};
 }
 
+size_t registered_traps::insert(start_trap &&st) {
+  _syscall_traps.push_back(std::move(st));
+  return _syscall_traps.size() - 1;
+}
+
 const start_trap *registered_traps::find(start_addr addr) const {
   return find_impl(*this, addr);
 }
@@ -116,6 +173,13 @@ const end_trap *registered_traps::find(end_addr ea, start_addr sa) const {
   return find_impl(*this, ea, sa);
 }
 
+const end_trap *registered_traps::find(end_addr ea) const {
+  auto it = _end_traps.find(ea);
+  if (it == _end_traps.end())
+    return nullptr;
+  return &it->second;
+}
+
 start_trap *registered_traps::find(start_addr addr) {
   return find_impl(*this, addr);
 }
@@ -124,6 +188,76 @@ end_trap *registered_traps::find(end_addr ea, start_addr sa) {
   return find_impl(*this, ea, sa);
 }
 
+const start_trap *registered_traps::find_syscall(size_t index) const {
+  if (index >= _syscall_traps.size())
+    return nullptr;
+  return &_syscall_traps[index];
+}
+
+start_trap *registered_traps::find_syscall(size_t index) {
+  if (index >= _syscall_traps.size())
+    return nullptr;
+  return &_syscall_traps[index];
+}
+
+bool registered_traps::has_syscalls() const noexcept {
+  return !_syscall_traps.empty();
+}
+
+std::vector<uintptr_t> registered_traps::addresses() const {
+  std::vector<uintptr_t> addrs;
+  addrs.reserve(_start_traps.size() + _end_traps.size());
+  for (const auto &[addr, t] : _start_traps)
+    addrs.push_back(addr.val());
+  for (const auto &[addr, t] : _end_traps)
+    addrs.push_back(addr.val());
+  std::sort(addrs.begin(), addrs.end());
+  addrs.erase(std::unique(addrs.begin(), addrs.end()), addrs.end());
+  return addrs;
+}
+
+void registered_traps::set_origwords(const std::vector<uintptr_t> &addrs,
+                                     const std::vector<long> &words) {
+  assert(addrs.size() == words.size());
+  for (size_t ix = 0; ix < addrs.size(); ix++) {
+    if (auto it = _start_traps.find(addrs[ix]); it != _start_traps.end())
+      it->second._origword = words[ix];
+    if (auto it = _end_traps.find(addrs[ix]); it != _end_traps.end())
+      it->second._origword = words[ix];
+  }
+}
+
+std::vector<long>
+registered_traps::origwords(const std::vector<uintptr_t> &addrs) const {
+  std::vector<long> words;
+  words.reserve(addrs.size());
+  for (uintptr_t addr : addrs) {
+    if (auto it = _start_traps.find(addr); it != _start_traps.end())
+      words.push_back(it->second.origword());
+    else if (auto it = _end_traps.find(addr); it != _end_traps.end())
+      words.push_back(it->second.origword());
+    else
+      assert(false);
+  }
+  return words;
+}
+
+void registered_traps::set_displaced(uintptr_t addr,
+                                     const displaced_insn &insn) {
+  if (auto it = _start_traps.find(addr); it != _start_traps.end())
+    it->second._displaced = insn;
+  if (auto it = _end_traps.find(addr); it != _end_traps.end())
+    it->second._displaced = insn;
+}
+
+void registered_traps::set_scratch_area(std::unique_ptr<scratch_area> area) {
+  _scratch = std::move(area);
+}
+
+scratch_area *registered_traps::scratch() const noexcept {
+  return _scratch.get();
+}
+
 template <typename T>
 auto registered_traps::find_impl(T &instance, start_addr addr)
     -> decltype(instance.find(addr)) {
@@ -2,21 +2,29 @@
 
 #pragma once
 
+#include "displaced_step.hpp"
 #include "trap_context.hpp"
 
+#include <atomic>
 #include <chrono>
 #include <cstdint>
 #include <filesystem>
 #include <functional>
 #include <memory>
+#include <optional>
 #include <unordered_map>
 #include <variant>
+#include <vector>
 
 namespace tep {
 
 class sampler;
+struct results_entry;
 
 using sampler_creator = std::function<std::unique_ptr<sampler>()>;
+// consumes the results of each execution of a section as it completes,
+// instead of them being gathered until tracing ends
+using results_consumer = std::function<void(results_entry &&)>;
 
 // trap related classes
 
@@ -56,17 +64,23 @@ struct addr_bounds_hash {
 
 class trap {
 private:
+  friend class registered_traps;
+
   long _origword;
   trap_context _context;
+  std::optional<displaced_insn> _displaced;
 
 public:
-  trap(long origword, trap_context) noexcept;
+  // the original word is only known once the trap is installed
+  trap(trap_context) noexcept;
 
   trap(trap &&) = default;
   trap &operator=(trap &&) = default;
 
   long origword() const noexcept;
   const trap_context &context() const noexcept;
+  // the relocated instruction, if the trap is stepped over out-of-line
+  const displaced_insn *displaced() const noexcept;
 
   friend std::ostream &operator<<(std::ostream &, const trap &);
 
@@ -76,20 +90,63 @@ protected:
   virtual void print(std::ostream &) const;
 };
 
+// the executions of a section which are measured: every <every>-th one and,
+// if <max_executions> is non-zero, no more than that
+struct execution_budget {
+  uint32_t every = 1;
+  uint32_t max_executions = 0;
+};
+
 class start_trap : public trap {
+public:
+  enum class execution {
+    measured,
+    skipped,
+    // the trap can be removed, since no further executions are measured
+    exhausted,
+  };
+
 private:
   bool _allow_concurrency;
+  execution_budget _budget;
   sampler_creator _creator;
+  results_consumer _consumer;
+  // shared by all tracers
+  struct counters {
+    // the number of times the trap was hit
+    std::atomic<uint64_t> hits{0};
+    // the measured executions which have not yet ended
+    std::atomic<uint32_t> active{0};
+  };
+  std::unique_ptr<counters> _counters;
 
 public:
   template <typename Creator>
-  start_trap(long origword, trap_context ctx, bool allow_concurrency,
+  start_trap(trap_context ctx, bool allow_concurrency, execution_budget budget,
              Creator &&callable)
-      : trap(origword, std::move(ctx)), _allow_concurrency(allow_concurrency),
-        _creator(std::forward<Creator>(callable)) {}
+      : trap(std::move(ctx)), _allow_concurrency(allow_concurrency),
+        _budget(budget), _creator(std::forward<Creator>(callable)),
+        _consumer(), _counters(std::make_unique<counters>()) {}
 
   bool allow_concurrency() const noexcept;
   std::unique_ptr<sampler> create_sampler() const;
+
+  // must be set before tracing starts
+  void consume_results(results_consumer consumer);
+  const results_consumer &consumer() const noexcept;
+
+  // counts a hit of the trap and returns how the execution is handled
+  execution hit() const noexcept;
+  // ends an execution which hit() returned as measured
+  void finish() const noexcept;
+  // whether the last execution to be measured has started, after which the
+  // trap is removed instead of reset
+  bool exhausted() const noexcept;
+  // whether the last execution to be measured has also ended, after which the
+  // end traps of the section are removed too
+  bool finished() const noexcept;
+  // the number of hits whose execution was not measured
+  uint64_t skipped() const noexcept;
 };
 
 class end_trap : public trap {
@@ -97,7 +154,7 @@ private:
   start_addr _start;
 
 public:
-  end_trap(long origword, trap_context, start_addr);
+  end_trap(trap_context, start_addr);
 
   start_addr associated_with() const noexcept;
 
@@ -112,10 +169,16 @@ private:
   using end_traps = std::unordered_map<end_addr, end_trap, end_addr::hash>;
   start_traps _start_traps;
   end_traps _end_traps;
+  std::unique_ptr<scratch_area> _scratch;
+  // sections bounded by system calls, indexed by the data the seccomp filter
+  // of the tracee reports them with
+  std::vector<start_trap> _syscall_traps;
 
 public:
   std::pair<const start_trap *, bool> insert(start_addr, start_trap &&);
   std::pair<const end_trap *, bool> insert(end_addr, end_trap &&);
+  // registers a section bounded by a system call and returns its index
+  size_t insert(start_trap &&);
 
   // finds the start_trap associated with start_addr
   // returns nullptr if not found
@@ -129,6 +192,37 @@ public:
   const end_trap *find(end_addr, start_addr) const;
   end_trap *find(end_addr, start_addr);
 
+  // finds the end_trap at end_addr, regardless of its section
+  // returns nullptr if not found
+  const end_trap *find(end_addr) const;
+
+  // finds the section bounded by a system call with the given index
+  // returns nullptr if not found
+  const start_trap *find_syscall(size_t index) const;
+  start_trap *find_syscall(size_t index);
+  // whether any section is bounded by a system call, in which case the target
+  // has a seccomp filter which fails its selected system calls with ENOSYS
+  // in threads and processes which are not traced
+  bool has_syscalls() const noexcept;
+
+  // addresses of all registered traps, in ascending order and without
+  // duplicates
+  std::vector<uintptr_t> addresses() const;
+
+  // records the original words of the traps at the given addresses,
+  // once those traps have been installed
+  void set_origwords(const std::vector<uintptr_t> &addrs,
+                     const std::vector<long> &words);
+  // the original words of the traps at the given addresses
+  std::vector<long> origwords(const std::vector<uintptr_t> &addrs) const;
+
+  // records the relocated instruction of the traps at the given address
+  void set_displaced(uintptr_t addr, const displaced_insn &insn);
+
+  // scratch area for instructions relocated while tracing, if any
+  void set_scratch_area(std::unique_ptr<scratch_area> area);
+  scratch_area *scratch() const noexcept;
+
 private:
   template <typename T>
   static auto find_impl(T &instance, start_addr addr)
@@ -0,0 +1,279 @@
+// trap_stepper.cpp
+
+#include "trap_stepper.hpp"
+#include "displaced_step.hpp"
+#include "error.hpp"
+#include "log.hpp"
+#include "ptrace_misc.hpp"
+#include "ptrace_wrapper.hpp"
+#include "registers.hpp"
+#include "trap.hpp"
+#include "trap_types.hpp"
+#include "util.hpp"
+
+#include <nonstd/expected.hpp>
+
+#include <cassert>
+#include <sstream>
+
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace tep;
+
+template <typename T> static std::string to_string(const T &obj) {
+  std::stringstream ss;
+  ss << obj;
+  return ss.str();
+}
+
+// definition of static variables
+
+trap_word_locks trap_stepper::TRAP_WORDS;
+return_traps trap_stepper::RETURN_TRAPS;
+
+// methods
+
+trap_stepper::trap_stepper(pid_t tracee, const mem_file &mem,
+                           uintptr_t ep) noexcept
+    : _tracee(tracee), _mem(&mem), _ep(ep) {}
+
+pid_t trap_stepper::tracee() const noexcept { return _tracee; }
+
+tracer_error trap_stepper::wait_for_tracee(int &wait_status) const {
+  pid_t waited_pid = waitpid(_tracee, &wait_status, __WALL);
+  if (waited_pid == -1)
+    return get_syserror(errno, tracer_errcode::SYSTEM_ERROR, gettid(),
+                        "waitpid");
+  assert(waited_pid == _tracee);
+  return tracer_error::success();
+}
+
+tracer_error trap_stepper::handle_breakpoint(cpu_gp_regs &regs, const trap &t,
+                                             bool rearm) const {
+  // displaced traps are never removed, so there is nothing to serialize
+  std::unique_lock<std::mutex> lock;
+  if (!t.displaced())
+    lock = std::unique_lock(TRAP_WORDS[regs.get_ip()]);
+  return step_over(regs, t.origword(), t.displaced(), rearm);
+}
+
+nonstd::expected<bool, tracer_error>
+trap_stepper::step_over_return_trap(cpu_gp_regs &regs) const {
+  uintptr_t addr = regs.get_ip();
+  std::scoped_lock lock(TRAP_WORDS[addr]);
+  auto rtrap = RETURN_TRAPS.find(addr);
+  if (!rtrap) {
+    // the stop may have been reported after the last section which shared the
+    // trap removed it, in which case the original instruction is executed
+    auto word = read_word(*_mem, addr);
+    if (!word)
+      return nonstd::expected<bool, tracer_error>::unexpected_type{
+          std::move(word).error()};
+    if (set_trap(*word) == *word)
+      return false;
+    log::logline(log::info,
+                 "[%d] reached return trap @ 0x%" PRIxPTR " (0x%" PRIxPTR
+                 ") which has since been removed",
+                 gettid(), addr, addr - _ep);
+    if (auto error = regs.setregs())
+      return nonstd::expected<bool, tracer_error>::unexpected_type{
+          std::move(error)};
+    return true;
+  }
+  log::logline(log::info,
+               "[%d] stepping over return trap @ 0x%" PRIxPTR " (0x%" PRIxPTR
+               ") shared with other sections",
+               gettid(), addr, addr - _ep);
+  if (auto error = step_over(regs, rtrap->origword, rtrap->displaced, true))
+    return nonstd::expected<bool, tracer_error>::unexpected_type{
+        std::move(error)};
+  return true;
+}
+
+nonstd::expected<bool, tracer_error>
+trap_stepper::step_over_end_trap(cpu_gp_regs &regs,
+                                 const registered_traps &traps) const {
+  uintptr_t addr = regs.get_ip();
+  const end_trap *etrap = traps.find(end_addr{addr});
+  if (!etrap)
+    return false;
+  const start_trap *strap = traps.find(etrap->associated_with());
+  assert(strap);
+  // a trap which is also the start of another section is never removed
+  bool remove = strap->finished() && !traps.find(start_addr{addr});
+  log::logline(log::info,
+               "[%d] reached ending trap located @ %s outside of its section",
+               gettid(), to_string(etrap->context()).c_str());
+  if (auto error = skip_execution(regs, *etrap, remove))
+    return nonstd::expected<bool, tracer_error>::unexpected_type{
+        std::move(error)};
+  return true;
+}
+
+tracer_error trap_stepper::step_over(cpu_gp_regs &regs, long origword,
+                                     const displaced_insn *insn,
+                                     bool rearm) const {
+  ptrace_wrapper &pw = ptrace_wrapper::instance;
+  int errnum;
+  int wait_status;
+  pid_t tid = gettid();
+  uintptr_t bp_addr = regs.get_ip();
+
+  if (insn) {
+    // the trap stays in place; single-step the relocated instruction instead
+    regs.set_ip(insn->slot);
+    if (auto error = regs.setregs())
+      return error;
+    log::logline(log::debug,
+                 "[%d] stepping displaced instruction of 0x%" PRIxPTR
+                 " (0x%" PRIxPTR ") @ 0x%" PRIxPTR,
+                 tid, bp_addr, bp_addr - _ep, insn->slot);
+  } else {
+    // set the registers and write the original instruction
+    if (auto error = regs.setregs())
+      return error;
+    if (auto error = write_trap_bytes(*_mem, bp_addr, origword))
+      return error;
+    log::logline(log::debug,
+                 "[%d] reset original word @ 0x%" PRIxPTR " (0x%" PRIxPTR
+                 "), 0x%lx -> 0x%lx",
+                 tid, bp_addr, bp_addr - _ep, set_trap(origword), origword);
+  }
+
+  // single-step and reset the trap instruction
+  if (pw.ptrace(errnum, PTRACE_SINGLESTEP, _tracee, 0, 0) == -1)
+    return get_syserror(errnum, tracer_errcode::PTRACE_ERROR, tid,
+                        "PTRACE_SINGLESTEP");
+  if (auto error = wait_for_tracee(wait_status))
+    return error;
+
+  // an interrupt requested when a non-concurrent section started is reported
+  // before the instruction is executed, so single-step again and re-issue the
+  // interrupt, which then stops the tracee as soon as it is resumed
+  bool interrupted = is_interrupt_stop(wait_status);
+  if (interrupted) {
+    log::logline(log::info,
+                 "[%d] tracee %d interrupted during single-step; stepping again",
+                 tid, _tracee);
+    if (pw.ptrace(errnum, PTRACE_SINGLESTEP, _tracee, 0, 0) == -1)
+      return get_syserror(errnum, tracer_errcode::PTRACE_ERROR, tid,
+                          "PTRACE_SINGLESTEP");
+    if (auto error = wait_for_tracee(wait_status))
+      return error;
+  }
+
+  if (!is_breakpoint_trap(wait_status)) {
+    log::logline(log::error,
+                 "[%d] tried to single-step but process ended"
+                 " unexpectedly and, as such, tracing cannot continue",
+                 tid);
+    return tracer_error(tracer_errcode::UNKNOWN_ERROR);
+  }
+
+  if (auto error = regs.getregs())
+    return error;
+  if (insn)
+    if (auto error = finish_displaced_step(regs, bp_addr, *insn))
+      return error;
+  log::logline(log::info,
+               "[%d] single-stepped @ 0x%" PRIxPTR " (0x%" PRIxPTR ")", tid,
+               regs.get_ip(), regs.get_ip() - _ep);
+  if (interrupted)
+    if (auto error = interrupt_tracee(tid, _tracee))
+      return error;
+
+  if (!insn && rearm) {
+    if (auto error = write_trap_bytes(*_mem, bp_addr, set_trap(origword)))
+      return error;
+    log::logline(log::debug,
+                 "[%d] reset trap word @ 0x%" PRIxPTR " (0x%" PRIxPTR
+                 "), 0x%lx -> 0x%lx",
+                 tid, bp_addr, bp_addr - _ep, origword, set_trap(origword));
+  }
+
+  return tracer_error::success();
+}
+
+bool return_frame::returned(const cpu_gp_regs &regs) const noexcept {
+  return regs.get_ip() == context.addr() &&
+         regs.get_stack_pointer() >= stack_pointer;
+}
+
+nonstd::expected<return_frame, tracer_error>
+trap_stepper::handle_function_entry(const cpu_gp_regs &regs,
+                                    scratch_area *scratch) const {
+  using unexpected =
+      nonstd::expected<return_frame, tracer_error>::unexpected_type;
+  auto ret_addr = regs.get_return_address();
+  if (!ret_addr)
+    return unexpected{std::move(ret_addr).error()};
+  trap_context func_end_ctx{function_return{*ret_addr, nullptr}};
+  uintptr_t ret_sp = regs.get_return_stack_pointer();
+  log::logline(log::debug,
+               "function return address @ 0x%" PRIxPTR
+               ", stack pointer @ 0x%" PRIxPTR,
+               func_end_ctx.addr(), ret_sp);
+  std::scoped_lock lock(TRAP_WORDS[func_end_ctx.addr()]);
+  if (auto error = RETURN_TRAPS.insert(*_mem, func_end_ctx.addr(), scratch))
+    return unexpected{std::move(error)};
+  return return_frame{std::move(func_end_ctx), ret_sp};
+}
+
+tracer_error trap_stepper::handle_function_return(cpu_gp_regs &regs,
+                                                  uintptr_t addr) const {
+  bool shared;
+  {
+    std::scoped_lock lock(TRAP_WORDS[addr]);
+    if (auto error = RETURN_TRAPS.remove(*_mem, addr))
+      return error;
+    shared = RETURN_TRAPS.find(addr).has_value();
+  }
+  if (!shared)
+    return regs.setregs();
+  // the trap remains if other sections are yet to return there
+  auto stepped = step_over_return_trap(regs);
+  if (!stepped)
+    return std::move(stepped).error();
+  return tracer_error::success();
+}
+
+tracer_error trap_stepper::reset_trap(const trap &t, uintptr_t addr) const {
+  // traps stepped over out-of-line are never removed
+  if (t.displaced())
+    return tracer_error::success();
+  std::scoped_lock lock(TRAP_WORDS[addr]);
+  pid_t tid = gettid();
+  if (auto error = write_trap_bytes(*_mem, addr, set_trap(t.origword())))
+    return error;
+  log::logline(log::debug,
+               "[%d] reset %s trap word @ 0x%" PRIxPTR " (0x%" PRIxPTR
+               "), 0x%lx -> 0x%lx",
+               tid, to_string(t.context()).c_str(), addr, addr - _ep,
+               t.origword(), set_trap(t.origword()));
+  return tracer_error::success();
+}
+
+tracer_error trap_stepper::remove_trap(const trap &t, uintptr_t addr) const {
+  std::scoped_lock lock(TRAP_WORDS[addr]);
+  if (auto error = write_trap_bytes(*_mem, addr, t.origword()))
+    return error;
+  log::logline(log::info,
+               "[%d] removed %s trap word @ 0x%" PRIxPTR " (0x%" PRIxPTR
+               "), 0x%lx -> 0x%lx",
+               gettid(), to_string(t.context()).c_str(), addr, addr - _ep,
+               set_trap(t.origword()), t.origword());
+  return tracer_error::success();
+}
+
+tracer_error trap_stepper::skip_execution(cpu_gp_regs &regs, const trap &t,
+                                          bool remove) const {
+  if (!remove)
+    return handle_breakpoint(regs, t, true);
+  // the original instruction is executed once the tracee is resumed
+  uintptr_t addr = regs.get_ip();
+  if (auto error = regs.setregs())
+    return error;
+  return remove_trap(t, addr);
+}
@@ -0,0 +1,80 @@
+// trap_stepper.hpp
+
+#pragma once
+
+#include "shared_traps.hpp"
+#include "trap_context.hpp"
+
+#include <util/expectedfwd.hpp>
+
+#include <cstdint>
+#include <sys/types.h>
+
+namespace tep {
+
+class cpu_gp_regs;
+class mem_file;
+class registered_traps;
+class scratch_area;
+class tracer_error;
+class trap;
+struct displaced_insn;
+
+// the return of the invocation of a function which started a section; the
+// invocations of a recursive function share the return address of all but the
+// outermost of them, so the return is also keyed by the stack pointer the
+// caller has once it returns, which is lower for deeper invocations
+struct return_frame {
+  trap_context context;
+  uintptr_t stack_pointer;
+
+  // whether the tracee, stopped at a trap, has returned from the invocation
+  bool returned(const cpu_gp_regs &) const noexcept;
+};
+
+// steps a single tracee over the traps it reaches; the traps inserted at the
+// return address of functions while tracing are shared by all tracees
+class trap_stepper {
+  static trap_word_locks TRAP_WORDS;
+  static return_traps RETURN_TRAPS;
+
+  pid_t _tracee;
+  const mem_file *_mem;
+  uintptr_t _ep;
+
+public:
+  trap_stepper(pid_t tracee, const mem_file &mem, uintptr_t ep) noexcept;
+
+  pid_t tracee() const noexcept;
+
+  tracer_error reset_trap(const trap &, uintptr_t addr) const;
+  // removes a trap for good, once no further executions are measured
+  tracer_error remove_trap(const trap &, uintptr_t addr) const;
+  // steps over a trap whose execution is not measured, or removes it
+  tracer_error skip_execution(cpu_gp_regs &regs, const trap &,
+                              bool remove) const;
+  tracer_error handle_breakpoint(cpu_gp_regs &regs, const trap &,
+                                 bool rearm) const;
+  nonstd::expected<bool, tracer_error>
+  step_over_return_trap(cpu_gp_regs &regs) const;
+  // steps over the end trap of an execution which is not measured, or removes
+  // it once no further executions of its section are measured
+  nonstd::expected<bool, tracer_error>
+  step_over_end_trap(cpu_gp_regs &regs, const registered_traps &) const;
+  tracer_error step_over(cpu_gp_regs &regs, long origword,
+                         const displaced_insn *insn, bool rearm) const;
+
+  // inserts a trap at the return address of the function just entered, which
+  // deeper invocations returning to the same address share
+  nonstd::expected<return_frame, tracer_error>
+  handle_function_entry(const cpu_gp_regs &, scratch_area *scratch) const;
+  // removes the return trap of a section which has ended and steps over it if
+  // the sections of other tracees still share it
+  tracer_error handle_function_return(cpu_gp_regs &regs,
+                                      uintptr_t addr) const;
+
+private:
+  tracer_error wait_for_tracee(int &wait_status) const;
+};
+
+} // namespace tep
@@ -3,6 +3,7 @@
 #include "dbg/dwarf.hpp"
 #include "dbg/elf.hpp"
 #include "output/output_writer.hpp"
+#include "syscall_types.hpp"
 
 #include <util/concat.hpp>
 
@@ -113,6 +114,24 @@ static void to_json(nlohmann::json &j, const function_return &x) {
     j["compilation_unit"] = nullptr;
 }
 
+static void to_json(nlohmann::json &j, const system_call &x) {
+  nlohmann::json jsys;
+  jsys["number"] = x.number;
+  if (auto name = syscall_name(x.number); !name.empty())
+    jsys["name"] = name;
+  else
+    jsys["name"] = nullptr;
+  j["system_call"] = std::move(jsys);
+}
+
+static void to_json(nlohmann::json &j, const system_call_return &x) {
+  nlohmann::json jsys;
+  jsys["number"] = x.number;
+  jsys["return_value"] = x.retval;
+  j["system_call_return"] = std::move(jsys);
+  j["absolute_address"] = address_to_hex_string(x.value);
+}
+
 static void to_json(nlohmann::json &j, const inline_function &x) {
   to_json(j, static_cast<const address &>(x));
   nlohmann::json jfunc;
@@ -151,6 +170,16 @@ std::string to_string(const source_line &x) {
   return cmmn::concat("source_line:", address_to_hex_string(x.value));
 }
 
+std::string to_string(const system_call &x) {
+  if (auto name = syscall_name(x.number); !name.empty())
+    return cmmn::concat("system_call:", std::string(name));
+  return cmmn::concat("system_call:", std::to_string(x.number));
+}
+
+std::string to_string(const system_call_return &x) {
+  return cmmn::concat("system_call_return:", address_to_hex_string(x.value));
+}
+
 std::ostream &operator<<(std::ostream &os, const address &x) {
   os << to_string(x);
   return os;
@@ -176,6 +205,16 @@ std::ostream &operator<<(std::ostream &os, const source_line &x) {
   return os;
 }
 
+std::ostream &operator<<(std::ostream &os, const system_call &x) {
+  os << to_string(x);
+  return os;
+}
+
+std::ostream &operator<<(std::ostream &os, const system_call_return &x) {
+  os << to_string(x);
+  return os;
+}
+
 output_writer &operator<<(output_writer &ow, const address &x) {
   ow.json = x;
   return ow;
@@ -200,4 +239,14 @@ output_writer &operator<<(output_writer &ow, const source_line &x) {
   ow.json = x;
   return ow;
 }
+
+output_writer &operator<<(output_writer &ow, const system_call &x) {
+  ow.json = x;
+  return ow;
+}
+
+output_writer &operator<<(output_writer &ow, const system_call_return &x) {
+  ow.json = x;
+  return ow;
+}
 } // namespace tep
@@ -35,21 +35,39 @@ struct source_line : address {
   const dbg::source_line *line;
 };
 
+// the entry of a system call which bounds a section; the address is that of
+// the system call instruction, if known
+struct system_call : address {
+  long number;
+};
+
+// the exit of a system call, along with its return value
+struct system_call_return : address {
+  long number;
+  long retval;
+};
+
 std::string to_string(const address &);
 std::string to_string(const function_call &);
 std::string to_string(const function_return &);
 std::string to_string(const inline_function &);
 std::string to_string(const source_line &);
+std::string to_string(const system_call &);
+std::string to_string(const system_call_return &);
 
 std::ostream &operator<<(std::ostream &, const address &);
 std::ostream &operator<<(std::ostream &, const function_call &);
 std::ostream &operator<<(std::ostream &, const function_return &);
 std::ostream &operator<<(std::ostream &, const inline_function &);
 std::ostream &operator<<(std::ostream &, const source_line &);
+std::ostream &operator<<(std::ostream &, const system_call &);
+std::ostream &operator<<(std::ostream &, const system_call_return &);
 
 output_writer &operator<<(output_writer &, const address &);
 output_writer &operator<<(output_writer &, const function_call &);
 output_writer &operator<<(output_writer &, const function_return &);
 output_writer &operator<<(output_writer &, const inline_function &);
 output_writer &operator<<(output_writer &, const source_line &);
+output_writer &operator<<(output_writer &, const system_call &);
+output_writer &operator<<(output_writer &, const system_call_return &);
 } // namespace tep
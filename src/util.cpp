@@ -2,6 +2,8 @@
 
 #include "util.hpp"
 
+#include <cerrno>
+#include <climits>
 #include <cstdarg>
 #include <cstdio>
 #include <cstring>
@@ -34,6 +36,51 @@ int tep::get_entrypoint_addr(pid_t pid, uintptr_t &addr) {
   return 0;
 }
 
+int tep::get_load_address(pid_t pid, uintptr_t &addr) {
+  char filename[24];
+  if (snprintf(filename, 24, "/proc/%d/exe", pid) >= 24)
+    return -1;
+  char exe[PATH_MAX];
+  ssize_t len = readlink(filename, exe, sizeof(exe) - 1);
+  if (len == -1)
+    return -1;
+  exe[len] = '\0';
+
+  if (snprintf(filename, 24, "/proc/%d/maps", pid) >= 24)
+    return -1;
+  FILE *maps = fopen(filename, "r");
+  if (maps == nullptr)
+    return -1;
+
+  // other libraries or anonymous mappings may lie below the executable once
+  // the process has been running for a while, so the first mapping of the
+  // executable is looked for by its path
+  char line[PATH_MAX + 128];
+  bool found = false;
+  while (!found && fgets(line, sizeof(line), maps)) {
+    uintptr_t start;
+    int path_start = 0;
+    if (sscanf(line, "%" SCNxPTR "-%*x %*s %*x %*x:%*x %*u %n", &start,
+               &path_start) < 1 ||
+        !path_start)
+      continue;
+    char *path = line + path_start;
+    path[strcspn(path, "\n")] = '\0';
+    if (strcmp(path, exe) == 0) {
+      addr = start;
+      found = true;
+    }
+  }
+
+  if (fclose(maps) != 0)
+    return -1;
+  if (!found) {
+    errno = ENOENT;
+    return -1;
+  }
+  return 0;
+}
+
 #if defined(__x86_64__) || defined(__i386__)
 
 long tep::set_trap(long word) {
@@ -62,6 +109,41 @@ long tep::set_trap(long word) { return word; }
 
 #endif // __x86_64__ || __i386__
 
+#if defined(__x86_64__)
+
+long tep::set_syscall(long word) {
+  // syscall
+  return (word & ~0xffff) | 0x050f;
+}
+
+#elif defined(__i386__)
+
+long tep::set_syscall(long word) {
+  // int 0x80
+  return (word & ~0xffff) | 0x80cd;
+}
+
+#elif defined(__powerpc64__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+
+long tep::set_syscall(long word) {
+  // sc
+  return (word & 0xffffffff) | (0x44000002L << 32);
+}
+
+#elif defined(__powerpc64__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+
+long tep::set_syscall(long word) {
+  constexpr static const long mask = 0xffffffff;
+  // sc
+  return (word & ~mask) | 0x44000002;
+}
+
+#else
+
+long tep::set_syscall(long word) { return word; }
+
+#endif // defined(__x86_64__)
+
 #if __GLIBC__ == 2 && __GLIBC_MINOR__ < 32
 
 const char *tep::sig_str(int signal) { return strsignal(signal); }
@@ -93,6 +175,18 @@ bool tep::is_exit_event(int wait_status) {
   return wait_status >> 8 == (SIGTRAP | (PTRACE_EVENT_EXIT << 8));
 }
 
+bool tep::is_exec_event(int wait_status) {
+  return wait_status >> 8 == (SIGTRAP | (PTRACE_EVENT_EXEC << 8));
+}
+
+bool tep::is_seccomp_event(int wait_status) {
+  return wait_status >> 8 == (SIGTRAP | (PTRACE_EVENT_SECCOMP << 8));
+}
+
+bool tep::is_interrupt_stop(int wait_status) {
+  return wait_status >> 8 == (SIGTRAP | (PTRACE_EVENT_STOP << 8));
+}
+
 bool tep::is_breakpoint_trap(int wait_status) {
   return WIFSTOPPED(wait_status) && !(WSTOPSIG(wait_status) & 0x80) &&
          (WSTOPSIG(wait_status) == SIGTRAP);
@@ -111,10 +205,12 @@ int tep::get_ptrace_exitkill() {
   return PTRACE_O_EXITKILL;
 }
 
-int tep::get_ptrace_opts(bool trace_children) {
+int tep::get_ptrace_opts(bool trace_children, bool exitkill) {
   int opts = 0;
-  // kill the tracee when the profiler errors
-  opts = get_ptrace_exitkill();
+  // kill the tracee when the profiler errors, unless it was already running
+  // before being attached to
+  if (exitkill)
+    opts = get_ptrace_exitkill();
   if (trace_children) {
     // trace threads being spawned using clone()
     opts |= PTRACE_O_TRACECLONE;
@@ -127,5 +223,8 @@ int tep::get_ptrace_opts(bool trace_children) {
   opts |= PTRACE_O_TRACEEXIT;
   // distinguish normal traps from syscall traps
   opts |= PTRACE_O_TRACESYSGOOD;
+  // stop at the system calls selected by the seccomp filter of the tracee,
+  // which would otherwise fail with ENOSYS
+  opts |= PTRACE_O_TRACESECCOMP;
   return opts;
 }
@@ -15,19 +15,34 @@ inline pid_t gettid() { return syscall(SYS_gettid); }
 
 namespace tep {
 int get_entrypoint_addr(pid_t pid, uintptr_t &addr);
+// the start of the lowest mapping of the executable of a running process
+int get_load_address(pid_t pid, uintptr_t &addr);
+
+// number of bytes of the trap instruction set by set_trap()
+#if defined(__x86_64__) || defined(__i386__)
+constexpr size_t trap_length = 1;
+#elif defined(__powerpc64__)
+constexpr size_t trap_length = 4;
+#else
+constexpr size_t trap_length = 0;
+#endif // defined(__x86_64__) || defined(__i386__)
 
 long set_trap(long word);
+long set_syscall(long word);
 
 bool is_clone_event(int wait_status);
 bool is_vfork_event(int wait_status);
 bool is_fork_event(int wait_status);
 bool is_child_event(int wait_status);
 bool is_exit_event(int wait_status);
+bool is_exec_event(int wait_status);
+bool is_seccomp_event(int wait_status);
+bool is_interrupt_stop(int wait_status);
 bool is_breakpoint_trap(int wait_status);
 bool is_syscall_trap(int wait_status);
 
 const char *sig_str(int signal);
 
 int get_ptrace_exitkill();
-int get_ptrace_opts(bool trace_children);
+int get_ptrace_opts(bool trace_children, bool exitkill = true);
 } // namespace tep